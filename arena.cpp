@@ -0,0 +1,37 @@
+#include <cstdint>
+#include <cstdlib>
+
+#include "arena.hpp"
+
+Arena::~Arena() {
+    for (auto it = destructors.rbegin(); it != destructors.rend(); it++) {
+        it->first(it->second);
+    }
+
+    for (char *block : blocks) {
+        free(block);
+    }
+}
+
+void *Arena::allocate(size_t size, size_t alignment) {
+    size_t padding = (alignment - ((uintptr_t)current % alignment)) % alignment;
+
+    if (current == NULL || padding + size > remaining) {
+        // Oversized requests get a block of their own
+        size_t block_size = size + alignment > BLOCK_SIZE ? size + alignment : BLOCK_SIZE;
+        char *block = (char *)malloc(block_size);
+
+        blocks.push_back(block);
+        current = block;
+        remaining = block_size;
+        padding = (alignment - ((uintptr_t)current % alignment)) % alignment;
+    }
+
+    void *ret = current + padding;
+
+    current += padding + size;
+    remaining -= padding + size;
+    bytes_used += size;
+
+    return ret;
+}
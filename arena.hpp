@@ -0,0 +1,86 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Bump allocator for everything that lives exactly as long as a compilation
+// unit (the token stream, Ast_Nodes). Nothing is freed individually, the
+// whole arena is released at once when it is destroyed.
+struct Arena {
+    static const size_t BLOCK_SIZE = 64 * 1024;
+
+    std::vector<char *> blocks;
+    char *current = NULL;
+    size_t remaining = 0;
+    size_t bytes_used = 0;
+
+    // Objects with non-trivial destructors (anything holding a std::string or
+    // std::vector) are destroyed in reverse order of creation with the arena
+    std::vector<std::pair<void (*)(void *), void *>> destructors;
+
+    Arena() {}
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena();
+
+    void *allocate(size_t size, size_t alignment);
+
+    template <typename T, typename... Args>
+    T *make(Args &&... args) {
+        T *object = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+        if (std::is_trivially_destructible<T>::value == false) {
+            destructors.push_back(std::make_pair(&destroy<T>, (void *)object));
+        }
+
+        return object;
+    }
+
+    template <typename T>
+    static void destroy(void *object) {
+        ((T *)object)->~T();
+    }
+};
+
+// Lets standard containers draw their storage from an arena. Deallocation is
+// a no-op, so containers that grow a lot should be reserved up front.
+template <typename T>
+struct Arena_Allocator {
+    typedef T value_type;
+
+    Arena *arena;
+
+    Arena_Allocator(Arena *arena) {
+        this->arena = arena;
+    }
+
+    template <typename U>
+    Arena_Allocator(const Arena_Allocator<U> &other) {
+        this->arena = other.arena;
+    }
+
+    T *allocate(size_t count) {
+        return (T *)arena->allocate(count * sizeof(T), alignof(T));
+    }
+
+    void deallocate(T *pointer, size_t count) {}
+};
+
+template <typename T>
+using Arena_Vector = std::vector<T, Arena_Allocator<T>>;
+
+template <typename T, typename U>
+bool operator==(const Arena_Allocator<T> &a, const Arena_Allocator<U> &b) {
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool operator!=(const Arena_Allocator<T> &a, const Arena_Allocator<U> &b) {
+    return a.arena != b.arena;
+}
+
+#endif
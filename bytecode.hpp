@@ -0,0 +1,97 @@
+#ifndef BYTECODE_H
+#define BYTECODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "parser.hpp"
+#include "memo.hpp"
+#include "typer.hpp"
+
+// Operands are stored inline after the opcode, little endian.
+// u8 = 1 byte, u16 = 2 bytes, u32 = 4 bytes.
+enum Op_Code : uint8_t {
+    OP_CONSTANT,        // u32 constant index
+    OP_VOID,
+    OP_POP,
+
+    OP_LOAD_LOCAL,      // u16 slot
+    OP_STORE_LOCAL,     // u16 slot
+    OP_DECLARE_LOCAL,   // u16 slot, u8 data type
+    OP_CLEAR_LOCALS,    // u16 first slot, u16 count
+    OP_LOAD_OUTER,      // u8 hops, u16 slot
+    OP_STORE_OUTER,     // u8 hops, u16 slot
+
+    OP_ADD, OP_SUBTRACT, OP_MULTIPLY, OP_DIVIDE, OP_MODULO, OP_EXPONENT,
+    OP_EQUALS, OP_NOT_EQUALS, OP_LESS_THAN, OP_GREATER_THAN, OP_LESS_THAN_EQUALS, OP_GREATER_THAN_EQUALS,
+    OP_AND, OP_OR,
+    OP_NOT, OP_NEGATE, OP_POSITIVE,
+
+    OP_ARRAY,           // u16 item count
+
+    OP_JUMP,            // u32 target
+    OP_JUMP_IF_FALSE,   // u32 target
+
+    OP_LOOP_PREPARE,    // u16 base slot
+    OP_LOOP_TEST,       // u16 base slot, u16 it slot, u32 exit target
+    OP_LOOP_NEXT,       // u16 base slot, u32 test target
+    OP_PAR_PREPARE,     // u16 it slot
+    OP_PAR_TEST,        // u16 it slot, u32 exit target
+    OP_PAR_NEXT,        // u32 test target
+
+    OP_CALL,            // u32 function index, u8 hops
+    OP_CALL_NATIVE,     // u32 native call index, u8 arg count
+    OP_CHECK_ARG,       // u8 arg index, u8 data type
+    OP_TAIL_CALL,       // Reruns the current function with the args on top of the stack
+    OP_RETURN,
+    OP_RETURN_VOID
+};
+
+struct Chunk {
+    std::vector<uint8_t> code;
+    std::vector<Value> constants;
+    std::vector<Ast_Function_Call *> native_calls;
+
+    // Sparse map from instruction offset to the node it was compiled from,
+    // only consulted when reporting errors so it is kept out of the code stream.
+    std::vector<std::pair<uint32_t, Ast_Node *>> origins;
+
+    Ast_Node *origin_at(uint32_t offset);
+};
+
+struct Bytecode_Function {
+    std::string name;
+    Data_Type return_type;
+    int arity;
+    int depth;
+    int frame_size;
+    int max_stack;
+    Chunk chunk;
+    Code_Site site;
+
+    // Shared with the bug's Ast_Function_Definition, NULL unless it is pure
+    Memo_Table *memo;
+
+    // Bug this was compiled from, which the JIT counts calls on. NULL for the
+    // top level of the script.
+    Ast_Function_Definition *definition;
+
+    Bytecode_Function(std::string name, Data_Type return_type, int arity, int depth, Code_Site site) {
+        this->name = name;
+        this->return_type = return_type;
+        this->arity = arity;
+        this->depth = depth;
+        this->frame_size = 0;
+        this->max_stack = 0;
+        this->site = site;
+        this->memo = NULL;
+        this->definition = NULL;
+    }
+};
+
+struct Program {
+    // Index 0 is always the top level of the script
+    std::vector<Bytecode_Function *> functions;
+};
+
+#endif
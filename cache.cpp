@@ -0,0 +1,803 @@
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+#ifdef _WIN32
+#include <direct.h>
+#include <process.h>
+#include <windows.h>
+#define getpid _getpid
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+#include "cache.hpp"
+#include "gc.hpp"
+#include "memo.hpp"
+#include "shel_lib.hpp"
+
+// Bump whenever the layout below or any of the annotations the passes leave
+// on the tree change. Keys also take in a hash of the interpreter itself, so a
+// rebuild that changes any pass never trusts a tree written by the old one.
+static const uint32_t CACHE_FORMAT_VERSION = 2;
+static const char CACHE_MAGIC[8] = { 'S', 'H', 'E', 'L', 'T', 'R', 'E', 'E' };
+
+// Written in place of the node type for NULL children, and for variables
+// that were already written, which are followed by the earlier node's index.
+// 'now x += 1' uses the same Ast_Variable on both sides of the assignment.
+static const uint8_t NULL_NODE = 0xFF;
+static const uint8_t SHARED_NODE = 0xFE;
+
+static std::string cache_dir;
+static bool is_cache_dir_set = false;
+
+void set_cache_dir(const std::string &dir) {
+    cache_dir = dir;
+    is_cache_dir_set = true;
+}
+
+const std::string &get_cache_dir() {
+    if (is_cache_dir_set) return cache_dir;
+
+    const char *dir = getenv("SHEL_CACHE_DIR");
+    const char *home = getenv("HOME");
+
+    if (dir != NULL) cache_dir = dir;
+    else if (home != NULL && home[0] != '\0') cache_dir = std::string(home) + "/.cache/shel";
+
+    is_cache_dir_set = true;
+    return cache_dir;
+}
+
+// FNV-1a style, but taking 8 bytes at a time so hashing a big source or tree
+// costs next to nothing next to lexing it
+static uint64_t hash_bytes(const char *data, size_t size, uint64_t hash) {
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+
+        hash = (hash ^ word) * 0x100000001b3ULL;
+        hash ^= hash >> 29;
+    }
+
+    for (; i < size; i++) hash = (hash ^ (unsigned char)data[i]) * 0x100000001b3ULL;
+
+    return hash;
+}
+
+static std::string get_cache_path(uint64_t key) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%016llx.shc", (unsigned long long)key);
+
+    return get_cache_dir() + name;
+}
+
+static bool make_dir(const std::string &path) {
+#ifdef _WIN32
+    return _mkdir(path.c_str()) == 0 || errno == EEXIST;
+#else
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+// Makes every missing directory along the path, like mkdir -p
+static bool make_dirs(const std::string &path) {
+    for (size_t i = 1; i <= path.size(); i++) {
+        if (i < path.size() && path[i] != '/' && path[i] != '\\') continue;
+        if (make_dir(path.substr(0, i)) == false) return false;
+    }
+
+    return true;
+}
+
+// Read only view of a whole cache file. It's mapped where mmap is available,
+// so the tree is built straight out of the page cache without copying it.
+struct Cache_File {
+    const char *data = NULL;
+    size_t size = 0;
+
+#ifdef _WIN32
+    std::string contents;
+
+    bool open(const std::string &path) {
+        std::ifstream in_file(path, std::ios::binary);
+        if (!in_file) return false;
+
+        std::stringstream sstr;
+        sstr << in_file.rdbuf();
+        contents = sstr.str();
+
+        data = contents.data();
+        size = contents.size();
+        return true;
+    }
+#else
+    void *mapping = NULL;
+
+    bool open(const std::string &path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        struct stat info;
+
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            close(fd);
+            return false;
+        }
+
+        mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if (mapping == MAP_FAILED) {
+            mapping = NULL;
+            return false;
+        }
+
+        data = (const char *)mapping;
+        size = info.st_size;
+        return true;
+    }
+
+    ~Cache_File() {
+        if (mapping != NULL) munmap(mapping, size);
+    }
+#endif
+};
+
+static std::string get_executable_path() {
+#ifdef _WIN32
+    char path[MAX_PATH];
+    DWORD length = GetModuleFileNameA(NULL, path, sizeof(path));
+
+    return length > 0 && length < sizeof(path) ? std::string(path, length) : "";
+#elif defined(__APPLE__)
+    char path[4096];
+    uint32_t size = sizeof(path);
+
+    return _NSGetExecutablePath(path, &size) == 0 ? path : "";
+#else
+    return "/proc/self/exe";
+#endif
+}
+
+// Hashed once per run, the interpreter is small enough that it costs well
+// under a millisecond. False when the executable can't be read, which turns
+// the cache off rather than risk loading trees from another build.
+static bool get_build_hash(uint64_t *hash) {
+    static uint64_t build_hash = 0;
+    static int is_hashed = -1;
+
+    if (is_hashed == -1) {
+        Cache_File file;
+        is_hashed = file.open(get_executable_path());
+
+        if (is_hashed) {
+            build_hash = hash_bytes((const char *)&CACHE_FORMAT_VERSION, sizeof(CACHE_FORMAT_VERSION), 0xcbf29ce484222325ULL);
+            build_hash = hash_bytes(file.data, file.size, build_hash);
+        }
+    }
+
+    *hash = build_hash;
+    return is_hashed == 1;
+}
+
+static bool get_cache_key(const std::string &source, uint64_t *key) {
+    uint64_t build_hash;
+    if (get_build_hash(&build_hash) == false) return false;
+
+    *key = hash_bytes(source.data(), source.size(), build_hash);
+    return true;
+}
+
+// Nodes are written depth first, each as its type, the fields every node has
+// and then its own fields and children. Calls to bugs are written without
+// their definition, which can come later in the tree, and are linked up by a
+// table of node indices at the end.
+struct Tree_Writer {
+    std::string out;
+    uint32_t node_count = 0;
+    std::unordered_map<Ast_Node *, uint32_t> indices;
+    std::vector<std::pair<uint32_t, Ast_Function_Definition *>> calls;
+
+    // Cleared for anything the format can't represent
+    bool is_valid = true;
+
+    template <typename T>
+    void put(T value) {
+        out.append((const char *)&value, sizeof(T));
+    }
+
+    void put_string(const std::string &text) {
+        put<uint32_t>(text.size());
+        out += text;
+    }
+
+    void put_token(const Token &token) {
+        put<uint8_t>(token.type);
+        put<uint32_t>(token.flags);
+        put<uint32_t>(token.site.offset);
+        put<uint32_t>(token.length);
+    }
+
+    template <typename T>
+    void put_nodes(const std::vector<T *> &nodes) {
+        put<uint32_t>(nodes.size());
+        for (T *node : nodes) put_node(node);
+    }
+
+    void put_node(Ast_Node *node);
+    void put_links();
+};
+
+void Tree_Writer::put_node(Ast_Node *node) {
+    if (node == NULL) {
+        put<uint8_t>(NULL_NODE);
+        return;
+    }
+
+    uint32_t index = node_count++;
+
+    // Only the nodes that can be shared or linked to are looked up, trees
+    // have far too many nodes to put every one of them through the map
+    if (node->node_type == Ast_Node::Type::VARIABLE || node->node_type == Ast_Node::Type::FUNCTION_DEFINITION) {
+        auto shared = indices.insert(std::make_pair(node, index));
+
+        if (shared.second == false) {
+            node_count--;
+            put<uint8_t>(SHARED_NODE);
+            put<uint32_t>(shared.first->second);
+            return;
+        }
+    }
+
+    put<uint8_t>(node->node_type);
+    put<uint8_t>(node->data_type);
+    put<uint8_t>(node->is_type_checked);
+    put<uint32_t>(node->site.offset);
+
+    switch (node->node_type) {
+        case Ast_Node::Type::BINARY_OP: {
+            auto *binary_op = (Ast_Binary_Op *)node;
+            put_token(binary_op->op);
+            put_node(binary_op->left);
+            put_node(binary_op->right);
+            break;
+        }
+        case Ast_Node::Type::UNARY_OP: {
+            auto *unary_op = (Ast_Unary_Op *)node;
+            put_token(unary_op->op);
+            put_node(unary_op->node);
+            break;
+        }
+        case Ast_Node::Type::LITERAL: {
+            Value value = ((Ast_Literal *)node)->value;
+            put<uint8_t>(value.data_type);
+
+            if (value.data_type == Data_Type::NUM) put<float>(value.num);
+            else if (value.data_type == Data_Type::BOOL) put<uint8_t>(value.boolean);
+            else if (value.data_type == Data_Type::STR) put_string(value.str->text());
+            else is_valid = false;
+            break;
+        }
+        case Ast_Node::Type::ARRAY:
+            put_nodes(((Ast_Array *)node)->items);
+            break;
+        case Ast_Node::Type::BLOCK: {
+            auto *block = (Ast_Block *)node;
+            int32_t return_index = -1;
+
+            for (size_t i = 0; i < block->children.size(); i++) {
+                if (block->children[i] == block->return_node) return_index = i;
+            }
+
+            if (block->return_node != NULL && return_index == -1) is_valid = false;
+
+            put_nodes(block->children);
+            put<int32_t>(return_index);
+            put<int32_t>(block->frame_size);
+            break;
+        }
+        case Ast_Node::Type::IF: {
+            auto *if_node = (Ast_If *)node;
+            put_node(if_node->comparison);
+            put_node(if_node->success);
+            put_node(if_node->failure);
+            break;
+        }
+        case Ast_Node::Type::WHILE: {
+            auto *while_node = (Ast_While *)node;
+            put_node(while_node->comparison);
+            put_node(while_node->body);
+            break;
+        }
+        case Ast_Node::Type::LOOP: {
+            auto *loop_node = (Ast_Loop *)node;
+            put_node(loop_node->start);
+            put_node(loop_node->to);
+            put_node(loop_node->step);
+            put_node(loop_node->body);
+            put<uint8_t>(loop_node->is_parallel);
+            put_node(loop_node->reduction);
+            if (loop_node->reduction != NULL) put_token(loop_node->reduce_op);
+            break;
+        }
+        case Ast_Node::Type::ASSIGNMENT: {
+            auto *assignment = (Ast_Assignment *)node;
+            put_node(assignment->left);
+            put_node(assignment->right);
+            put<uint8_t>(assignment->is_first_assign);
+            break;
+        }
+        case Ast_Node::Type::VARIABLE: {
+            // The name is always the token's text, so it's rebuilt from that
+            auto *var = (Ast_Variable *)node;
+            put_token(var->token);
+            put<uint8_t>(var->type);
+            put<int32_t>(var->depth);
+            put<int32_t>(var->slot);
+            break;
+        }
+        case Ast_Node::Type::FUNCTION_DEFINITION: {
+            auto *def = (Ast_Function_Definition *)node;
+            put<uint8_t>(def->memo != NULL);
+            put_string(def->name);
+            put_nodes(def->args);
+            put_node(def->block);
+            break;
+        }
+        case Ast_Node::Type::FUNCTION_CALL: {
+            auto *call = (Ast_Function_Call *)node;
+            put_string(call->name);
+            put_nodes(call->args);
+            put<uint32_t>(call->args_start_site.offset);
+            put<uint8_t>(call->native != NULL);
+            put<int32_t>(call->depth);
+            put<uint32_t>(call->format_pieces.size());
+            for (const std::string &piece : call->format_pieces) put_string(piece);
+
+            if (call->definition != NULL) calls.push_back(std::make_pair(index, call->definition));
+            break;
+        }
+        case Ast_Node::Type::RETURN: {
+            auto *return_node = (Ast_Return *)node;
+            put_node(return_node->value);
+            put<uint8_t>(return_node->is_tail_call);
+            break;
+        }
+        case Ast_Node::Type::EMPTY:
+            break;
+    }
+}
+
+void Tree_Writer::put_links() {
+    put<uint32_t>(calls.size());
+
+    for (auto &call : calls) {
+        auto def = indices.find(call.second);
+
+        if (def == indices.end()) {
+            is_valid = false;
+            return;
+        }
+
+        put<uint32_t>(call.first);
+        put<uint32_t>(def->second);
+    }
+}
+
+// Mirror of Tree_Writer. Every read is bounds checked and every node type and
+// link is checked against what should be there, so a damaged file is noticed
+// and thrown away instead of crashing the engine later on.
+struct Tree_Reader {
+    Arena *arena;
+    const std::string *source;
+    unsigned int file_id;
+
+    const char *data;
+    size_t size;
+    size_t position = 0;
+    bool is_valid = true;
+
+    std::vector<Ast_Node *> nodes;
+    std::vector<Ast_Function_Call *> calls;
+    std::vector<Ast_Function_Definition *> memoized;
+
+    Tree_Reader(Arena *arena, const std::string *source, unsigned int file_id, const char *data, size_t size) {
+        this->arena = arena;
+        this->source = source;
+        this->file_id = file_id;
+        this->data = data;
+        this->size = size;
+    }
+
+    template <typename T>
+    T get() {
+        T value;
+
+        if (size - position < sizeof(T)) {
+            is_valid = false;
+            memset(&value, 0, sizeof(T));
+            return value;
+        }
+
+        memcpy(&value, data + position, sizeof(T));
+        position += sizeof(T);
+        return value;
+    }
+
+    template <typename T>
+    T get_enum(T last) {
+        uint8_t value = get<uint8_t>();
+        if (value > last) is_valid = false;
+
+        return is_valid ? (T)value : (T)0;
+    }
+
+    Code_Site get_site() {
+        Code_Site site;
+        site.file_id = file_id;
+        site.offset = get<uint32_t>();
+
+        if (site.offset > source->size()) is_valid = false;
+        return site;
+    }
+
+    std::string get_string();
+    Token get_token();
+    Ast_Node *get_node(bool is_nullable);
+
+    template <typename T>
+    T *get_node(Ast_Node::Type type, bool is_nullable) {
+        Ast_Node *node = get_node(is_nullable);
+        if (node != NULL && node->node_type != type) is_valid = false;
+
+        return is_valid ? (T *)node : NULL;
+    }
+
+    template <typename T>
+    std::vector<T *> get_nodes(Ast_Node::Type type) {
+        std::vector<T *> result;
+        uint32_t count = get<uint32_t>();
+
+        for (uint32_t i = 0; i < count && is_valid; i++) result.push_back(get_node<T>(type, false));
+        return result;
+    }
+
+    std::vector<Ast_Node *> get_nodes();
+    void get_links();
+};
+
+std::string Tree_Reader::get_string() {
+    uint32_t length = get<uint32_t>();
+
+    if (size - position < length) {
+        is_valid = false;
+        return "";
+    }
+
+    std::string text(data + position, length);
+    position += length;
+    return text;
+}
+
+Token Tree_Reader::get_token() {
+    Token token;
+    token.type = get_enum(Token::Type::END_OF_FILE);
+    token.flags = get<uint32_t>();
+    token.site = get_site();
+    token.length = get<uint32_t>();
+
+    if (is_valid == false || source->size() - token.site.offset < token.length) {
+        is_valid = false;
+        token.site.offset = 0;
+        token.length = 0;
+    }
+
+    token.text = source->data() + token.site.offset;
+    return token;
+}
+
+std::vector<Ast_Node *> Tree_Reader::get_nodes() {
+    std::vector<Ast_Node *> result;
+    uint32_t count = get<uint32_t>();
+
+    for (uint32_t i = 0; i < count && is_valid; i++) result.push_back(get_node(false));
+    return result;
+}
+
+Ast_Node *Tree_Reader::get_node(bool is_nullable) {
+    uint8_t type = get<uint8_t>();
+
+    if (is_valid == false) return NULL;
+
+    if (type == NULL_NODE) {
+        if (is_nullable == false) is_valid = false;
+        return NULL;
+    }
+
+    // Only a node that has been read in full can be shared, never one of
+    // its own ancestors
+    if (type == SHARED_NODE) {
+        uint32_t shared = get<uint32_t>();
+
+        if (is_valid == false || shared >= nodes.size() || nodes[shared] == NULL) {
+            is_valid = false;
+            return NULL;
+        }
+
+        return nodes[shared];
+    }
+
+    if (type > Ast_Node::Type::EMPTY) {
+        is_valid = false;
+        return NULL;
+    }
+
+    Data_Type data_type = get_enum(Data_Type::ANY);
+    bool is_type_checked = get<uint8_t>() != 0;
+    Code_Site site = get_site();
+
+    // Reserved before the children are read so indices match the writer's
+    size_t index = nodes.size();
+    nodes.push_back(NULL);
+
+    Ast_Node *node = NULL;
+
+    switch ((Ast_Node::Type)type) {
+        case Ast_Node::Type::BINARY_OP: {
+            Token op = get_token();
+            Ast_Node *left = get_node(false);
+            Ast_Node *right = get_node(false);
+            node = arena->make<Ast_Binary_Op>(left, right, op);
+            break;
+        }
+        case Ast_Node::Type::UNARY_OP: {
+            Token op = get_token();
+            node = arena->make<Ast_Unary_Op>(op, get_node(false));
+            break;
+        }
+        case Ast_Node::Type::LITERAL: {
+            Data_Type value_type = get_enum(Data_Type::ANY);
+            Value value;
+
+            if (value_type == Data_Type::NUM) value = num_value(get<float>());
+            else if (value_type == Data_Type::BOOL) value = bool_value(get<uint8_t>() != 0);
+            else if (value_type == Data_Type::STR) value = str_value(allocate_literal_str(arena, get_string()));
+            else is_valid = false;
+
+            node = arena->make<Ast_Literal>(value, site);
+            break;
+        }
+        case Ast_Node::Type::ARRAY:
+            node = arena->make<Ast_Array>(get_nodes(), site);
+            break;
+        case Ast_Node::Type::BLOCK: {
+            auto *block = arena->make<Ast_Block>(get_nodes(), site);
+            int32_t return_index = get<int32_t>();
+            block->frame_size = get<int32_t>();
+
+            if (return_index >= (int32_t)block->children.size() || return_index < -1) {
+                is_valid = false;
+            } else if (return_index != -1 && is_valid) {
+                Ast_Node *return_node = block->children[return_index];
+
+                if (return_node->node_type != Ast_Node::Type::RETURN) is_valid = false;
+                block->return_node = (Ast_Return *)return_node;
+            }
+
+            node = block;
+            break;
+        }
+        case Ast_Node::Type::IF: {
+            Ast_Node *comparison = get_node(true);
+            auto *success = get_node<Ast_Block>(Ast_Node::Type::BLOCK, false);
+            auto *if_node = arena->make<Ast_If>(comparison, success, site);
+            if_node->failure = get_node<Ast_If>(Ast_Node::Type::IF, true);
+            node = if_node;
+            break;
+        }
+        case Ast_Node::Type::WHILE: {
+            Ast_Node *comparison = get_node(false);
+            auto *body = get_node<Ast_Block>(Ast_Node::Type::BLOCK, false);
+            node = arena->make<Ast_While>(comparison, body, site);
+            break;
+        }
+        case Ast_Node::Type::LOOP: {
+            Ast_Node *start = get_node(false);
+            Ast_Node *to = get_node(false);
+            Ast_Node *step = get_node(false);
+            auto *body = get_node<Ast_Block>(Ast_Node::Type::BLOCK, false);
+            auto *loop_node = arena->make<Ast_Loop>(start, to, step, body, site);
+            loop_node->is_parallel = get<uint8_t>() != 0;
+            loop_node->reduction = get_node<Ast_Variable>(Ast_Node::Type::VARIABLE, true);
+            if (loop_node->reduction != NULL) loop_node->reduce_op = get_token();
+            node = loop_node;
+            break;
+        }
+        case Ast_Node::Type::ASSIGNMENT: {
+            auto *left = get_node<Ast_Variable>(Ast_Node::Type::VARIABLE, false);
+            Ast_Node *right = get_node(false);
+            bool is_first_assign = get<uint8_t>() != 0;
+            node = arena->make<Ast_Assignment>(left, right, is_first_assign, site);
+            break;
+        }
+        case Ast_Node::Type::VARIABLE: {
+            auto *var = arena->make<Ast_Variable>(get_token());
+            var->type = get_enum(Data_Type::ANY);
+            var->depth = get<int32_t>();
+            var->slot = get<int32_t>();
+            node = var;
+            break;
+        }
+        case Ast_Node::Type::FUNCTION_DEFINITION: {
+            // Memoized bugs are listed in the same order the Memoizer finds them
+            bool is_memoized = get<uint8_t>() != 0;
+            size_t memo_index = memoized.size();
+            if (is_memoized) memoized.push_back(NULL);
+
+            std::string name = get_string();
+            std::vector<Ast_Variable *> args = get_nodes<Ast_Variable>(Ast_Node::Type::VARIABLE);
+            auto *block = get_node<Ast_Block>(Ast_Node::Type::BLOCK, false);
+            auto *def = arena->make<Ast_Function_Definition>(block, data_type, args, name, site);
+
+            if (is_memoized) {
+                def->memo = arena->make<Memo_Table>(args.size());
+                memoized[memo_index] = def;
+            }
+
+            node = def;
+            break;
+        }
+        case Ast_Node::Type::FUNCTION_CALL: {
+            std::string name = get_string();
+            std::vector<Ast_Node *> args = get_nodes();
+            Code_Site args_start_site = get_site();
+            auto *call = arena->make<Ast_Function_Call>(name, args, site, args_start_site);
+
+            // Natives are looked up again, host applications may not have
+            // registered the same ones as whatever wrote the file
+            if (get<uint8_t>() != 0) {
+                call->native = find_native_function(name);
+                if (call->native == NULL) is_valid = false;
+            }
+
+            call->depth = get<int32_t>();
+            uint32_t piece_count = get<uint32_t>();
+
+            for (uint32_t i = 0; i < piece_count && is_valid; i++) call->format_pieces.push_back(get_string());
+
+            calls.push_back(call);
+            node = call;
+            break;
+        }
+        case Ast_Node::Type::RETURN: {
+            auto *return_node = arena->make<Ast_Return>(get_node(false), site);
+            return_node->is_tail_call = get<uint8_t>() != 0;
+            node = return_node;
+            break;
+        }
+        case Ast_Node::Type::EMPTY:
+            node = arena->make<Ast_Empty>(site);
+            break;
+    }
+
+    node->data_type = data_type;
+    node->is_type_checked = is_type_checked;
+    node->site = site;
+    nodes[index] = node;
+
+    return node;
+}
+
+void Tree_Reader::get_links() {
+    uint32_t count = get<uint32_t>();
+
+    for (uint32_t i = 0; i < count && is_valid; i++) {
+        uint32_t call_index = get<uint32_t>();
+        uint32_t def_index = get<uint32_t>();
+
+        if (call_index >= nodes.size() || def_index >= nodes.size()
+            || nodes[call_index]->node_type != Ast_Node::Type::FUNCTION_CALL || nodes[def_index]->node_type != Ast_Node::Type::FUNCTION_DEFINITION) {
+            is_valid = false;
+            return;
+        }
+
+        ((Ast_Function_Call *)nodes[call_index])->definition = (Ast_Function_Definition *)nodes[def_index];
+    }
+
+    // Every call has to have been bound to something, same as after resolving
+    for (Ast_Function_Call *call : calls) {
+        if (call->native == NULL && call->definition == NULL) is_valid = false;
+    }
+}
+
+struct Cache_Header {
+    char magic[8];
+    uint64_t key;
+    uint64_t source_size;
+
+    // Of everything after the header. Slots and depths can't be checked
+    // against anything, so a damaged file is only caught here.
+    uint64_t checksum;
+    int32_t folded_count;
+};
+
+bool load_cached_tree(Compilation_Unit *unit, const std::string &source) {
+    uint64_t key;
+    if (get_cache_dir().empty() || get_cache_key(source, &key) == false) return false;
+
+    Cache_File file;
+
+    if (file.open(get_cache_path(key)) == false) return false;
+
+    Cache_Header header;
+
+    if (file.size < sizeof(header)) return false;
+    memcpy(&header, file.data, sizeof(header));
+
+    // The name alone could be a hash collision
+    if (memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 || header.key != key || header.source_size != source.size()) return false;
+    if (hash_bytes(file.data + sizeof(header), file.size - sizeof(header), key) != header.checksum) return false;
+
+    Tree_Reader reader(&unit->arena, &unit->lexer->file_string, unit->lexer->file_id, file.data, file.size);
+    reader.position = sizeof(header);
+
+    auto *root = reader.get_node<Ast_Block>(Ast_Node::Type::BLOCK, false);
+    reader.get_links();
+
+    if (reader.is_valid == false || reader.position != file.size) return false;
+
+    unit->root = root;
+    unit->folded_count = header.folded_count;
+    unit->memoized = reader.memoized;
+    unit->is_from_cache = true;
+    return true;
+}
+
+void save_cached_tree(Compilation_Unit *unit, const std::string &source) {
+    uint64_t key;
+    if (get_cache_dir().empty() || get_cache_key(source, &key) == false) return;
+
+    Tree_Writer writer;
+
+    Cache_Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.key = key;
+    header.source_size = source.size();
+    header.folded_count = unit->folded_count;
+    writer.put(header);
+
+    writer.put_node(unit->root);
+    writer.put_links();
+
+    if (writer.is_valid == false || make_dirs(get_cache_dir()) == false) return;
+
+    header.checksum = hash_bytes(writer.out.data() + sizeof(header), writer.out.size() - sizeof(header), header.key);
+    memcpy(&writer.out[0], &header, sizeof(header));
+
+    // Written under a name of its own and moved into place, so other runs of
+    // the same script never see a half written file
+    std::string path = get_cache_path(header.key);
+    std::string temp_path = path + "." + std::to_string(getpid()) + ".tmp";
+
+    std::ofstream out_file(temp_path, std::ios::binary);
+    out_file.write(writer.out.data(), writer.out.size());
+    out_file.close();
+
+    if (!out_file || rename(temp_path.c_str(), path.c_str()) != 0) remove(temp_path.c_str());
+}
@@ -0,0 +1,28 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <string>
+#include "unit.hpp"
+
+// Compiled trees are kept on disk so running an unchanged script again skips
+// lexing, parsing and every pass over the tree. Each cache file holds the tree
+// exactly as the engines get it, resolved, checked and memoized, and is named
+// after a hash of the source and the interpreter build that wrote it. Editing
+// the script or rebuilding the interpreter just looks for a different file,
+// so stale trees are never loaded, they're left behind until the directory is
+// cleared.
+//
+// The cache is best effort. Anything that can't be read or written, or doesn't
+// match what it claims to be, falls back to compiling the source as normal.
+
+// Defaults to $SHEL_CACHE_DIR, or $HOME/.cache/shel. An empty dir turns the
+// cache off.
+void set_cache_dir(const std::string &dir);
+const std::string &get_cache_dir();
+
+// Fills in unit->root from the cache, the unit's lexer has to have been made
+// for source first so sites point into it. False if there's no usable tree.
+bool load_cached_tree(Compilation_Unit *unit, const std::string &source);
+void save_cached_tree(Compilation_Unit *unit, const std::string &source);
+
+#endif
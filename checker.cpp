@@ -0,0 +1,353 @@
+#include <sstream>
+
+#include "checker.hpp"
+#include "logger.hpp"
+#include "shel_lib.hpp"
+
+bool is_type_allowed(Data_Type actual, Data_Type expected) {
+    return actual == expected || actual == Data_Type::ANY || expected == Data_Type::ANY;
+}
+
+std::string get_arg_type_error(std::string bug_name, int index, Data_Type expected, Data_Type actual) {
+    std::stringstream ss;
+    ss << "Arg " << index + 1 << " of '" << bug_name << "' must be of type '" << data_type_to_string(expected)
+        << "', got expression of type '" << data_type_to_string(actual) << "'";
+
+    return ss.str();
+}
+
+static bool is_operand_type_valid(Token::Type op, Data_Type type) {
+    switch (op) {
+        case Token::Type::OP_PLUS:
+        case Token::Type::OP_PLUS_EQUALS:
+            return type == Data_Type::NUM || type == Data_Type::STR;
+        case Token::Type::COMPARE_EQUALS:
+        case Token::Type::COMPARE_NOT_EQUALS:
+            return type == Data_Type::NUM || type == Data_Type::STR || type == Data_Type::BOOL;
+        case Token::Type::LOGICAL_AND:
+        case Token::Type::LOGICAL_OR:
+            return type == Data_Type::BOOL;
+        default:
+            return type == Data_Type::NUM;
+    }
+}
+
+// + and * reduce nums, and/or reduce bools
+Data_Type get_reduce_type(Token::Type op) {
+    return op == Token::Type::OP_PLUS || op == Token::Type::OP_MULTIPLY ? Data_Type::NUM : Data_Type::BOOL;
+}
+
+void Checker::check(Ast_Block *root) {
+    scopes.push_back(Checker_Scope(root->frame_size));
+    check_block(root);
+    scopes.pop_back();
+}
+
+void Checker::check_block(Ast_Block *block) {
+    std::vector<Ast_Function_Definition *> pending;
+
+    for (Ast_Node *child : block->children) {
+        if (child->node_type == Ast_Node::Type::FUNCTION_DEFINITION) {
+            pending.push_back((Ast_Function_Definition *)child);
+        } else {
+            check_statement(child);
+        }
+    }
+
+    // Bug bodies are checked once every declaration in the block has been
+    // seen, same as the resolver
+    for (Ast_Function_Definition *def : pending) {
+        check_function(def);
+    }
+}
+
+void Checker::check_scoped_block(Ast_Block *block) {
+    scopes.push_back(Checker_Scope(block->frame_size));
+    check_block(block);
+    scopes.pop_back();
+}
+
+void Checker::check_function(Ast_Function_Definition *def) {
+    scopes.push_back(Checker_Scope(def->block->frame_size));
+    functions.push_back(def);
+
+    // Cleared by check_return if any return can't be proven to match
+    def->is_type_checked = true;
+
+    for (size_t i = 0; i < def->args.size(); i++) {
+        declare_slot(i, def->args[i]->data_type);
+    }
+
+    check_block(def->block);
+
+    functions.pop_back();
+    scopes.pop_back();
+}
+
+void Checker::check_statement(Ast_Node *node) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BLOCK:
+            check_block((Ast_Block *)node);
+            break;
+        case Ast_Node::Type::RETURN:
+            check_return((Ast_Return *)node);
+            break;
+        case Ast_Node::Type::IF: {
+            for (auto *if_node = (Ast_If *)node; if_node != NULL; if_node = if_node->failure) {
+                if (if_node->comparison != NULL) check_condition(if_node->comparison);
+                check_scoped_block(if_node->success);
+            }
+            break;
+        }
+        case Ast_Node::Type::WHILE: {
+            auto *while_node = (Ast_While *)node;
+            check_condition(while_node->comparison);
+            check_scoped_block(while_node->body);
+            break;
+        }
+        case Ast_Node::Type::LOOP: {
+            auto *loop_node = (Ast_Loop *)node;
+            Ast_Node *controls[] = { loop_node->start, loop_node->to, loop_node->step };
+
+            loop_node->is_type_checked = true;
+
+            for (Ast_Node *control : controls) {
+                Data_Type type = check_expression(control);
+
+                if (is_type_allowed(type, Data_Type::NUM) == false) {
+                    report_fatal_error("Attempted to use non-num expression as control in a from loop", loop_node->site);
+                }
+
+                if (type == Data_Type::ANY) loop_node->is_type_checked = false;
+            }
+
+            Data_Type reduce_type = Data_Type::VOID;
+
+            if (loop_node->reduction != NULL) {
+                Ast_Variable *reduction = loop_node->reduction;
+                reduce_type = get_reduce_type(loop_node->reduce_op.type);
+                reduction->data_type = *get_slot_type(reduction->depth, reduction->slot);
+
+                if (reduction->data_type == Data_Type::VOID) reduction->data_type = Data_Type::ANY;
+
+                if (is_type_allowed(reduction->data_type, reduce_type) == false) {
+                    std::stringstream ss;
+                    ss << "Cannot reduce variable of type '" << data_type_to_string(reduction->data_type) << "' with '" << loop_node->reduce_op.value() << "'";
+                    report_fatal_error(ss.str(), reduction->site);
+                }
+            }
+
+            // 'it' is always the first slot of the loop body, followed by the
+            // body's copy of the reduce variable
+            scopes.push_back(Checker_Scope(loop_node->body->frame_size));
+            declare_slot(0, Data_Type::NUM);
+            if (loop_node->reduction != NULL) declare_slot(1, reduce_type);
+            check_block(loop_node->body);
+            scopes.pop_back();
+            break;
+        }
+        case Ast_Node::Type::FUNCTION_CALL:
+            check_function_call((Ast_Function_Call *)node);
+            break;
+        case Ast_Node::Type::ASSIGNMENT:
+            check_assignment((Ast_Assignment *)node);
+            break;
+        default:
+            break;
+    }
+}
+
+void Checker::check_return(Ast_Return *node) {
+    Data_Type type = check_expression(node->value);
+
+    // Returning from the top level ends the script, whatever the value
+    if (functions.empty()) return;
+
+    Ast_Function_Definition *def = functions.back();
+
+    if (is_type_allowed(type, def->data_type) == false) {
+        std::stringstream ss;
+        ss << "Unexpected return type from function - wanted " << data_type_to_string(def->data_type)
+            << ", but got " << data_type_to_string(type);
+        report_fatal_error(ss.str(), node->site);
+    }
+
+    if (type == Data_Type::ANY) def->is_type_checked = false;
+}
+
+void Checker::check_assignment(Ast_Assignment *node) {
+    Ast_Variable *var = node->left;
+    Data_Type type = check_expression(node->right);
+
+    if (node->is_first_assign) {
+        if (is_type_allowed(type, var->data_type) == false) {
+            std::stringstream ss;
+            ss << "Tried to assign expression of type '" <<  data_type_to_string(type)
+                << "' to variable of type '" << data_type_to_string(var->data_type) << "'";
+            report_fatal_error(ss.str(), node->right->site);
+        }
+
+        node->is_type_checked = type != Data_Type::ANY;
+        declare_slot(var->slot, var->data_type);
+        return;
+    }
+
+    var->data_type = *get_slot_type(var->depth, var->slot);
+
+    if (is_type_allowed(type, var->data_type) == false) {
+        std::stringstream ss;
+        ss << "Tried to reassign variable of type '" <<  data_type_to_string(var->data_type)
+            << "' to expression of type '" << data_type_to_string(type) << "'";
+        report_fatal_error(ss.str(), node->right->site);
+    }
+
+    node->is_type_checked = type != Data_Type::ANY && var->data_type != Data_Type::ANY;
+}
+
+void Checker::check_condition(Ast_Node *node) {
+    if (is_type_allowed(check_expression(node), Data_Type::BOOL) == false) {
+        report_fatal_error("Invalid comparison", node->site);
+    }
+}
+
+Data_Type Checker::check_expression(Ast_Node *node) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BINARY_OP:
+            node->data_type = check_binary_op((Ast_Binary_Op *)node);
+            break;
+        case Ast_Node::Type::UNARY_OP:
+            node->data_type = check_unary_op((Ast_Unary_Op *)node);
+            break;
+        case Ast_Node::Type::ARRAY:
+            for (Ast_Node *item : ((Ast_Array *)node)->items) check_expression(item);
+            node->data_type = Data_Type::ARRAY;
+            break;
+        case Ast_Node::Type::FUNCTION_CALL:
+            node->data_type = check_function_call((Ast_Function_Call *)node);
+            break;
+        case Ast_Node::Type::VARIABLE: {
+            auto *var = (Ast_Variable *)node;
+            var->data_type = *get_slot_type(var->depth, var->slot);
+
+            // Only reachable through a bug reading a variable that is never
+            // declared in its scope before the end of the block
+            if (var->data_type == Data_Type::VOID) var->data_type = Data_Type::ANY;
+            break;
+        }
+        default:
+            // Literals are typed by the parser, empty expressions are void
+            break;
+    }
+
+    return node->data_type;
+}
+
+Data_Type Checker::check_binary_op(Ast_Binary_Op *node) {
+    Data_Type left = check_expression(node->left);
+    Data_Type right = check_expression(node->right);
+    Token::Type op = node->op.type;
+
+    if (left != Data_Type::ANY && right != Data_Type::ANY && left != right) {
+        report_fatal_error("Cannot perform binary operations on two mismatched expression types", node->op.site);
+    }
+
+    Data_Type types[] = { left, right };
+
+    for (Data_Type type : types) {
+        if (type != Data_Type::ANY && is_operand_type_valid(op, type) == false) {
+            std::stringstream ss;
+            ss << "Cannot perform '" << node->op.value() << "' on expressions of type '" << data_type_to_string(type) << "'";
+            report_fatal_error(ss.str(), node->op.site);
+        }
+    }
+
+    node->is_type_checked = left != Data_Type::ANY && right != Data_Type::ANY;
+
+    if (node->op.flags & Token::Flags::COMPARISON || node->op.flags & Token::Flags::LOGICAL) return Data_Type::BOOL;
+    if (op != Token::Type::OP_PLUS && op != Token::Type::OP_PLUS_EQUALS) return Data_Type::NUM;
+
+    // '+' is the only operator that works on more than one type
+    return left != Data_Type::ANY ? left : right;
+}
+
+Data_Type Checker::check_unary_op(Ast_Unary_Op *node) {
+    Data_Type type = check_expression(node->node);
+    Data_Type expected = node->op.type == Token::Type::LOGICAL_NOT ? Data_Type::BOOL : Data_Type::NUM;
+
+    if (is_type_allowed(type, expected) == false) {
+        std::stringstream ss;
+        ss << "Attempted invalid unary operation on " << data_type_to_string(type) << " value";
+        report_fatal_error(ss.str(), node->op.site);
+    }
+
+    node->is_type_checked = type != Data_Type::ANY;
+
+    return expected;
+}
+
+Data_Type Checker::check_function_call(Ast_Function_Call *call) {
+    std::vector<Data_Type> arg_types;
+
+    for (Ast_Node *arg : call->args) {
+        arg_types.push_back(check_expression(arg));
+    }
+
+    call->is_type_checked = true;
+
+    if (call->definition != NULL) {
+        auto *def = call->definition;
+
+        // Arg count was already checked by the resolver
+        for (size_t i = 0; i < arg_types.size(); i++) {
+            Data_Type expected = def->args[i]->data_type;
+
+            if (is_type_allowed(arg_types[i], expected) == false) {
+                report_fatal_error(get_arg_type_error(call->name, i, expected, arg_types[i]), call->args[i]->site);
+            }
+
+            if (arg_types[i] == Data_Type::ANY) call->is_type_checked = false;
+        }
+
+        return def->data_type;
+    }
+
+    Native_Function *native = call->native;
+
+    if (native->arity == -1) {
+        // print only formats when given more than one arg
+        if (arg_types.size() > 1 && is_type_allowed(arg_types[0], Data_Type::STR) == false) {
+            report_fatal_error(get_arg_type_error(call->name, 0, Data_Type::STR, arg_types[0]), call->args[0]->site);
+        }
+
+        if (arg_types.size() > 1 && arg_types[0] == Data_Type::ANY) call->is_type_checked = false;
+
+        return native->return_type;
+    }
+
+    // Arg count was already checked by the resolver
+    for (size_t i = 0; i < arg_types.size(); i++) {
+        Data_Type expected = native->arg_types[i];
+
+        if (is_type_allowed(arg_types[i], expected) == false) {
+            report_fatal_error(get_arg_type_error(call->name, i, expected, arg_types[i]), call->args[i]->site);
+        }
+
+        if (arg_types[i] == Data_Type::ANY && expected != Data_Type::ANY) call->is_type_checked = false;
+    }
+
+    return native->return_type;
+}
+
+void Checker::declare_slot(int slot, Data_Type data_type) {
+    Data_Type &declared = scopes.back().slots[slot];
+
+    if (declared == Data_Type::VOID) {
+        declared = data_type;
+    } else if (declared != data_type) {
+        declared = Data_Type::ANY;
+    }
+}
+
+Data_Type *Checker::get_slot_type(int depth, int slot) {
+    return &scopes[scopes.size() - 1 - depth].slots[slot];
+}
@@ -0,0 +1,55 @@
+#ifndef CHECKER_H
+#define CHECKER_H
+
+#include <string>
+#include <vector>
+#include "parser.hpp"
+
+struct Checker_Scope {
+    // Declared type of each slot, VOID until the slot's declaration has been
+    // seen and ANY if it is redeclared with a different type
+    std::vector<Data_Type> slots;
+
+    Checker_Scope(int frame_size) {
+        this->slots.resize(frame_size, Data_Type::VOID);
+    }
+};
+
+// Runs after the resolver and fills in data_type on every expression node,
+// rejecting ill-typed programs before anything is executed. It walks scopes
+// in the same order as the resolver, so the (depth, slot) pairs it bound
+// index straight into the checker's own scopes.
+//
+// Items read out of an arr are typed ANY as arrs aren't homogeneous. Nodes
+// that only see known types are marked is_type_checked and the engines skip
+// their runtime checks on them, anything touching an ANY is still checked
+// when it runs.
+struct Checker {
+    std::vector<Checker_Scope> scopes;
+
+    // Bugs whose bodies are being checked, innermost last
+    std::vector<Ast_Function_Definition *> functions;
+
+    void check(Ast_Block *root);
+
+    void check_block(Ast_Block *block);
+    void check_scoped_block(Ast_Block *block);
+    void check_function(Ast_Function_Definition *def);
+    void check_statement(Ast_Node *node);
+    void check_return(Ast_Return *node);
+    void check_assignment(Ast_Assignment *node);
+    void check_condition(Ast_Node *node);
+    Data_Type check_expression(Ast_Node *node);
+    Data_Type check_binary_op(Ast_Binary_Op *node);
+    Data_Type check_unary_op(Ast_Unary_Op *node);
+    Data_Type check_function_call(Ast_Function_Call *call);
+
+    void declare_slot(int slot, Data_Type data_type);
+    Data_Type *get_slot_type(int depth, int slot);
+};
+
+bool is_type_allowed(Data_Type actual, Data_Type expected);
+std::string get_arg_type_error(std::string bug_name, int index, Data_Type expected, Data_Type actual);
+Data_Type get_reduce_type(Token::Type op);
+
+#endif
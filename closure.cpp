@@ -0,0 +1,768 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "checker.hpp"
+#include "closure.hpp"
+#include "gc.hpp"
+#include "jit.hpp"
+#include "logger.hpp"
+#include "memo.hpp"
+#include "par.hpp"
+#include "shel_lib.hpp"
+
+// Left operands only need holding in temporaries while the right is worked
+// out when they point into the heap
+static bool is_heap_type(Data_Type type) {
+    return type != Data_Type::NUM && type != Data_Type::BOOL;
+}
+
+// Bound by the resolver but not assigned yet, e.g. an outer variable
+// declared after the bug reading it was called
+static inline Value read_variable(Scope *scope, Ast_Variable *var) {
+    Value value = *get_slot(scope, var->depth, var->slot);
+    if (value.data_type == Data_Type::VOID) report_fatal_error(get_unassigned_variable_error(var->name), var->token.site);
+
+    return value;
+}
+
+// Ops on nums the checker has proved, baked into closures by make_num_op and
+// make_num_compare
+struct Num_Add           { static float apply(float left, float right) { return left + right; } };
+struct Num_Subtract      { static float apply(float left, float right) { return left - right; } };
+struct Num_Multiply      { static float apply(float left, float right) { return left * right; } };
+struct Num_Divide        { static float apply(float left, float right) { return left / right; } };
+struct Num_Modulo        { static float apply(float left, float right) { return float(int(left) % int(right)); } };
+struct Num_Exponent      { static float apply(float left, float right) { return pow(left, right); } };
+struct Num_Equal         { static bool apply(float left, float right) { return left == right; } };
+struct Num_Not_Equal     { static bool apply(float left, float right) { return left != right; } };
+struct Num_Greater       { static bool apply(float left, float right) { return left > right; } };
+struct Num_Greater_Equal { static bool apply(float left, float right) { return left >= right; } };
+struct Num_Less          { static bool apply(float left, float right) { return left < right; } };
+struct Num_Less_Equal    { static bool apply(float left, float right) { return left <= right; } };
+
+// A literal on the right is the most common case by far, e.g. 'n % 2' or
+// 'i < 100', and is read straight out of the closure, as is a variable on the
+// left of one. Otherwise the left is always worked out first, so each side
+// gets a statement of its own.
+template <typename Op>
+static Expr_Closure make_num_op(Expr_Closure left, Expr_Closure right, Ast_Node *left_node, Ast_Node *right_node) {
+    if (right_node->node_type == Ast_Node::Type::LITERAL) {
+        float constant = ((Ast_Literal *)right_node)->value.num;
+
+        if (left_node->node_type == Ast_Node::Type::VARIABLE) {
+            auto *var = (Ast_Variable *)left_node;
+            return [var, constant](Interpreter *interp, Scope *scope) { return num_value(Op::apply(read_variable(scope, var).num, constant)); };
+        }
+
+        return [left, constant](Interpreter *interp, Scope *scope) { return num_value(Op::apply(left(interp, scope).num, constant)); };
+    }
+
+    return [left, right](Interpreter *interp, Scope *scope) {
+        float left_num = left(interp, scope).num;
+        return num_value(Op::apply(left_num, right(interp, scope).num));
+    };
+}
+
+template <typename Op>
+static Bool_Closure make_num_compare(Expr_Closure left, Expr_Closure right, Ast_Node *left_node, Ast_Node *right_node) {
+    if (right_node->node_type == Ast_Node::Type::LITERAL) {
+        float constant = ((Ast_Literal *)right_node)->value.num;
+
+        if (left_node->node_type == Ast_Node::Type::VARIABLE) {
+            auto *var = (Ast_Variable *)left_node;
+            return [var, constant](Interpreter *interp, Scope *scope) { return Op::apply(read_variable(scope, var).num, constant); };
+        }
+
+        return [left, constant](Interpreter *interp, Scope *scope) { return Op::apply(left(interp, scope).num, constant); };
+    }
+
+    return [left, right](Interpreter *interp, Scope *scope) {
+        float left_num = left(interp, scope).num;
+        return Op::apply(left_num, right(interp, scope).num);
+    };
+}
+
+static void fail_if_reassign_invalid(Interpreter *interp, Scope *scope, Ast_Assignment *node, Value *slot, Value expr) {
+    Ast_Variable *var = node->left;
+
+    if (slot->data_type == Data_Type::VOID) {
+        std::stringstream ss;
+        ss << "Attempted to reassign variable with the name '" << var->name << "', but none by that name exists.";
+        report_fatal_error(ss.str(), var->site);
+    }
+
+    if (node->is_type_checked == false && slot->data_type != expr.data_type) {
+        std::stringstream ss;
+        ss << "Tried to reassign variable of type '" <<  data_type_to_string(slot->data_type)
+            << "' to expression of type '" << data_type_to_string(expr.data_type) << "'";
+        report_fatal_error(ss.str(), node->right->site);
+    }
+
+    if (interp->par_stack != NULL) interp->fail_if_outside_par_loop(scope, var);
+}
+
+// Same as walk_par_chunk, with the body already compiled
+static void run_par_chunk(Interpreter *interp, Scope *scope, Ast_Loop *loop_node, const Stmt_Closure &body, float from, float step, size_t first, size_t last, Value *partial) {
+    Scope body_scope(scope, &interp->stack, loop_node->body->frame_size);
+    std::vector<Value> *outer_par_stack = interp->par_stack;
+    size_t outer_par_floor = interp->par_floor;
+    int first_cleared = loop_node->reduction != NULL ? 2 : 1;
+    Value ret;
+
+    interp->par_stack = &interp->stack;
+    interp->par_floor = body_scope.base;
+
+    if (loop_node->reduction != NULL) *get_slot(&body_scope, 0, 1) = get_reduce_identity(loop_node->reduce_op.type);
+
+    for (size_t i = first; i < last; i++) {
+        body_scope.clear(first_cleared);
+        *get_slot(&body_scope, 0, 0) = num_value(get_par_iteration(from, step, i));
+
+        // The resolver rejects returns from the body itself
+        body(interp, &body_scope, &ret);
+    }
+
+    if (loop_node->reduction != NULL) *partial = *get_slot(&body_scope, 0, 1);
+
+    interp->par_stack = outer_par_stack;
+    interp->par_floor = outer_par_floor;
+}
+
+// Same as walk_par_loop, the workers are Interpreters that only hold the
+// runtime state of their thread
+static void run_par_loop(Interpreter *interp, Scope *scope, Ast_Loop *loop_node, const Stmt_Closure &body, float from, float to, float step) {
+    Ast_Variable *reduction = loop_node->reduction;
+    Value total;
+
+    if (reduction != NULL) {
+        total = interp->get_variable(scope, reduction);
+        fail_if_reduction_invalid(loop_node, total);
+    }
+
+    size_t count = count_par_iterations(from, to, step, loop_node->site);
+    size_t chunk_size = get_par_chunk_size(count);
+    size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+    std::vector<Value> partials(chunk_count);
+    unsigned int epoch = next_par_epoch();
+    Thread_Pool *pool = get_thread_pool();
+
+    if (interp->is_worker || pool->worker_count == 1 || chunk_count < 2) {
+        unsigned int outer_epoch = par_epoch;
+        par_epoch = epoch;
+
+        for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+            run_par_chunk(interp, scope, loop_node, body, from, step, chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size), &partials[chunk]);
+        }
+
+        par_epoch = outer_epoch;
+    } else {
+        while (interp->workers.size() < (size_t)pool->worker_count) {
+            auto *worker = new Interpreter(interp->unit);
+            worker->is_worker = true;
+            interp->workers.push_back(worker);
+        }
+
+        heap.is_threaded = true;
+
+        pool->run(chunk_count, [&](int worker, size_t chunk) {
+            par_epoch = epoch;
+            run_par_chunk(interp->workers[worker], scope, loop_node, body, from, step, chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size), &partials[chunk]);
+            par_epoch = 0;
+        });
+
+        heap.is_threaded = false;
+    }
+
+    if (reduction == NULL) return;
+
+    for (Value partial : partials) total = reduce_values(loop_node->reduce_op.type, total, partial);
+
+    if (interp->par_stack != NULL) interp->fail_if_outside_par_loop(scope, reduction);
+    *get_slot(scope, reduction->depth, reduction->slot) = total;
+}
+
+Closure_Function *Closure_Engine::get_function(Ast_Function_Definition *def) {
+    auto found = functions.find(def);
+    if (found != functions.end()) return found->second;
+
+    auto *function = new Closure_Function(def);
+    functions[def] = function;
+    function->body = compile_block(def->block);
+
+    return function;
+}
+
+Expr_Closure Closure_Engine::compile_expression(Ast_Node *node) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BINARY_OP:
+            return compile_binary_op((Ast_Binary_Op *)node);
+        case Ast_Node::Type::UNARY_OP:
+            return compile_unary_op((Ast_Unary_Op *)node);
+        case Ast_Node::Type::LITERAL: {
+            Value value = ((Ast_Literal *)node)->value;
+            return [value](Interpreter *interp, Scope *scope) { return value; };
+        }
+        case Ast_Node::Type::ARRAY:
+            return compile_array((Ast_Array *)node);
+        case Ast_Node::Type::FUNCTION_CALL:
+            return compile_call((Ast_Function_Call *)node);
+        case Ast_Node::Type::VARIABLE:
+            return compile_variable((Ast_Variable *)node);
+        default:
+            return [](Interpreter *interp, Scope *scope) { return Value(); };
+    }
+}
+
+Expr_Closure Closure_Engine::compile_variable(Ast_Variable *var) {
+    return [var](Interpreter *interp, Scope *scope) { return read_variable(scope, var); };
+}
+
+Expr_Closure Closure_Engine::compile_binary_op(Ast_Binary_Op *node) {
+    Expr_Closure left = compile_expression(node->left);
+    Expr_Closure right = compile_expression(node->right);
+    Token::Type op = node->op.type;
+
+    if (node->op.flags & Token::Flags::COMPARISON || node->op.flags & Token::Flags::LOGICAL) {
+        if (node->is_type_checked == false) {
+            return [node, left, right](Interpreter *interp, Scope *scope) {
+                Value left_value = left(interp, scope);
+                interp->temporaries.push_back(left_value);
+                Value right_value = right(interp, scope);
+                interp->temporaries.pop_back();
+
+                fail_if_binary_op_invalid(left_value, right_value, node->op);
+                return bool_value(compare_values(node, left_value, right_value));
+            };
+        }
+
+        Bool_Closure condition = compile_condition(node);
+        return [condition](Interpreter *interp, Scope *scope) { return bool_value(condition(interp, scope)); };
+    }
+
+    if (node->is_type_checked && node->left->data_type == Data_Type::NUM) {
+        switch (op) {
+            case Token::Type::OP_PLUS:
+            case Token::Type::OP_PLUS_EQUALS:
+                return make_num_op<Num_Add>(left, right, node->left, node->right);
+            case Token::Type::OP_MINUS:
+            case Token::Type::OP_MINUS_EQUALS:
+                return make_num_op<Num_Subtract>(left, right, node->left, node->right);
+            case Token::Type::OP_MULTIPLY:
+            case Token::Type::OP_MULTIPLY_EQUALS:
+                return make_num_op<Num_Multiply>(left, right, node->left, node->right);
+            case Token::Type::OP_DIVIDE:
+            case Token::Type::OP_DIVIDE_EQUALS:
+                return make_num_op<Num_Divide>(left, right, node->left, node->right);
+            case Token::Type::OP_MODULO:
+            case Token::Type::OP_MODULO_EQUALS:
+                return make_num_op<Num_Modulo>(left, right, node->left, node->right);
+            case Token::Type::OP_EXPONENT:
+            case Token::Type::OP_EXPONENT_EQUALS:
+                return make_num_op<Num_Exponent>(left, right, node->left, node->right);
+            default:
+                break;
+        }
+    }
+
+    // Everything else goes the way walk_binary_op_node does
+    return [node, op, left, right](Interpreter *interp, Scope *scope) {
+        Value left_value = left(interp, scope);
+        interp->temporaries.push_back(left_value);
+        Value right_value = right(interp, scope);
+        interp->temporaries.pop_back();
+
+        if (node->is_type_checked == false) fail_if_binary_op_invalid(left_value, right_value, node->op);
+
+        switch (op) {
+            case Token::Type::OP_PLUS:
+            case Token::Type::OP_PLUS_EQUALS:
+                if (left_value.data_type == Data_Type::NUM) return num_value(left_value.num + right_value.num);
+                if (left_value.data_type == Data_Type::STR) return str_value(concat_strs(left_value.str, right_value.str));
+
+                report_fatal_error("Attempted to '+' incompatible expressions", node->op.site);
+                return Value();
+            case Token::Type::OP_MINUS:
+            case Token::Type::OP_MINUS_EQUALS:
+                return num_value(left_value.num - right_value.num);
+            case Token::Type::OP_MULTIPLY:
+            case Token::Type::OP_MULTIPLY_EQUALS:
+                return num_value(left_value.num * right_value.num);
+            case Token::Type::OP_DIVIDE:
+            case Token::Type::OP_DIVIDE_EQUALS:
+                return num_value(left_value.num / right_value.num);
+            case Token::Type::OP_MODULO:
+            case Token::Type::OP_MODULO_EQUALS:
+                return num_value(float(int(left_value.num) % int(right_value.num)));
+            case Token::Type::OP_EXPONENT:
+            case Token::Type::OP_EXPONENT_EQUALS:
+                return num_value(pow(left_value.num, right_value.num));
+            default:
+                return Value();
+        }
+    };
+}
+
+Expr_Closure Closure_Engine::compile_unary_op(Ast_Unary_Op *node) {
+    Expr_Closure operand = compile_expression(node->node);
+    Data_Type type = node->node->data_type;
+    Token::Type op = node->op.type;
+
+    if (type == Data_Type::NUM && op == Token::Type::OP_MINUS) {
+        return [operand](Interpreter *interp, Scope *scope) { return num_value(-operand(interp, scope).num); };
+    }
+
+    if (type == Data_Type::BOOL && op == Token::Type::LOGICAL_NOT) {
+        return [operand](Interpreter *interp, Scope *scope) { return bool_value(!operand(interp, scope).boolean); };
+    }
+
+    return [node, operand](Interpreter *interp, Scope *scope) { return apply_unary_op(node, operand(interp, scope)); };
+}
+
+Expr_Closure Closure_Engine::compile_array(Ast_Array *array) {
+    std::vector<Expr_Closure> items;
+    for (Ast_Node *item : array->items) items.push_back(compile_expression(item));
+
+    return [items](Interpreter *interp, Scope *scope) {
+        size_t temporaries_start = interp->temporaries.size();
+
+        for (const Expr_Closure &item : items) {
+            interp->temporaries.push_back(item(interp, scope));
+        }
+
+        std::vector<Value> values(interp->temporaries.begin() + temporaries_start, interp->temporaries.end());
+        interp->temporaries.resize(temporaries_start);
+
+        return array_value(allocate_array(values));
+    };
+}
+
+// Same as walk_function_call, see there for how args, memo keys and self
+// tail calls are kept
+Expr_Closure Closure_Engine::compile_call(Ast_Function_Call *call) {
+    if (call->definition == NULL) return compile_native_call(call);
+
+    Ast_Function_Definition *def = call->definition;
+    Closure_Function *function = get_function(def);
+    std::vector<Expr_Closure> args;
+
+    for (Ast_Node *arg : call->args) args.push_back(compile_expression(arg));
+
+    return [call, def, function, args](Interpreter *interp, Scope *scope) {
+        fail_if_stack_overflow(call);
+
+        size_t temporaries_start = interp->temporaries.size();
+
+        for (const Expr_Closure &arg : args) {
+            interp->temporaries.push_back(arg(interp, scope));
+        }
+
+        Jit_Function *jit = call->is_type_checked ? get_jit_function(def, interp->is_worker) : NULL;
+
+        if (jit != NULL) {
+            Memo_Table *memo = interp->is_worker ? NULL : def->memo;
+            Value *jit_args = &interp->temporaries[temporaries_start];
+            Value result;
+
+            if (memo == NULL || memo->lookup(jit_args, &result) == false) {
+                result = call_jit_function(jit, jit_args, interp->is_worker);
+                if (memo != NULL) memo->insert(jit_args, result);
+            }
+
+            interp->temporaries.resize(temporaries_start);
+            return result;
+        }
+
+        Scope func_scope(get_scope(scope, call->depth), &interp->stack, def->block->frame_size);
+        interp->bind_args(&func_scope, call, temporaries_start);
+
+        Value block_return;
+        bool has_returned;
+
+        Memo_Table *memo = interp->is_worker ? NULL : def->memo;
+        Value *memo_args = &interp->stack[func_scope.base];
+
+        if (memo != NULL) {
+            if (memo->lookup(memo_args, &block_return)) return block_return;
+            interp->memo_keys.insert(interp->memo_keys.end(), memo_args, memo_args + memo->arity);
+        }
+
+        bool is_profiled = is_profiling && interp->is_worker == false;
+
+        if (is_profiled) {
+            interp->profile_frames.back().site = call->site;
+            interp->profile_frames.push_back(Profile_Frame(def, def->site));
+        }
+
+        while ((has_returned = function->body(interp, &func_scope, &block_return)) && interp->tail_call != NULL) {
+            Ast_Function_Call *next = interp->tail_call;
+            interp->tail_call = NULL;
+
+            func_scope.clear(0);
+            interp->bind_args(&func_scope, next, temporaries_start);
+        }
+
+        if (is_profiled) interp->profile_frames.pop_back();
+
+        if (has_returned == false) {
+            if (def->data_type != Data_Type::VOID) report_fatal_error(get_missing_return_error(def->name, def->data_type), def->site);
+            return Value();
+        }
+
+        if (def->is_type_checked == false && block_return.data_type != def->data_type) {
+            report_fatal_error(get_return_type_error(def->data_type, block_return.data_type), def->block->return_node->site);
+        }
+
+        if (memo != NULL) {
+            memo->insert(interp->memo_keys.data() + interp->memo_keys.size() - memo->arity, block_return);
+            interp->memo_keys.resize(interp->memo_keys.size() - memo->arity);
+        }
+
+        return block_return;
+    };
+}
+
+Expr_Closure Closure_Engine::compile_native_call(Ast_Function_Call *call) {
+    std::vector<Expr_Closure> args;
+    for (Ast_Node *arg : call->args) args.push_back(compile_expression(arg));
+
+    return [call, args](Interpreter *interp, Scope *scope) {
+        size_t temporaries_start = interp->temporaries.size();
+
+        for (const Expr_Closure &arg : args) {
+            interp->temporaries.push_back(arg(interp, scope));
+        }
+
+        Native_Args native_args(interp->temporaries.data() + temporaries_start, args.size());
+
+        if (call->is_type_checked == false) fail_if_native_args_invalid(call, native_args);
+
+        Value ret = call->format_pieces.empty() ? call->native->handler(native_args, call->site) : print_compiled(call->format_pieces, native_args);
+        interp->temporaries.resize(temporaries_start);
+
+        return ret;
+    };
+}
+
+// Same results and errors as evaluate_node_to_bool
+Bool_Closure Closure_Engine::compile_condition(Ast_Node *node) {
+    if (node->node_type == Ast_Node::Type::BINARY_OP) {
+        auto *comparison = (Ast_Binary_Op *)node;
+        Expr_Closure left = compile_expression(comparison->left);
+        Expr_Closure right = compile_expression(comparison->right);
+        Data_Type type = comparison->left->data_type;
+
+        if (comparison->is_type_checked && type == Data_Type::NUM) {
+            switch (comparison->op.type) {
+                case Token::Type::COMPARE_EQUALS:
+                    return make_num_compare<Num_Equal>(left, right, comparison->left, comparison->right);
+                case Token::Type::COMPARE_NOT_EQUALS:
+                    return make_num_compare<Num_Not_Equal>(left, right, comparison->left, comparison->right);
+                case Token::Type::COMPARE_GREATER_THAN:
+                    return make_num_compare<Num_Greater>(left, right, comparison->left, comparison->right);
+                case Token::Type::COMPARE_GREATER_THAN_EQUALS:
+                    return make_num_compare<Num_Greater_Equal>(left, right, comparison->left, comparison->right);
+                case Token::Type::COMPARE_LESS_THAN:
+                    return make_num_compare<Num_Less>(left, right, comparison->left, comparison->right);
+                case Token::Type::COMPARE_LESS_THAN_EQUALS:
+                    return make_num_compare<Num_Less_Equal>(left, right, comparison->left, comparison->right);
+                default:
+                    break;
+            }
+        }
+
+        if (comparison->is_type_checked && type == Data_Type::BOOL) {
+            switch (comparison->op.type) {
+                case Token::Type::COMPARE_EQUALS:
+                    return [left, right](Interpreter *interp, Scope *scope) {
+                        bool left_bool = left(interp, scope).boolean;
+                        return left_bool == right(interp, scope).boolean;
+                    };
+                case Token::Type::COMPARE_NOT_EQUALS:
+                    return [left, right](Interpreter *interp, Scope *scope) {
+                        bool left_bool = left(interp, scope).boolean;
+                        return left_bool != right(interp, scope).boolean;
+                    };
+                // Both sides are always worked out, same as in the walker
+                case Token::Type::LOGICAL_AND:
+                    return [left, right](Interpreter *interp, Scope *scope) {
+                        bool left_bool = left(interp, scope).boolean;
+                        bool right_bool = right(interp, scope).boolean;
+                        return left_bool && right_bool;
+                    };
+                case Token::Type::LOGICAL_OR:
+                    return [left, right](Interpreter *interp, Scope *scope) {
+                        bool left_bool = left(interp, scope).boolean;
+                        bool right_bool = right(interp, scope).boolean;
+                        return left_bool || right_bool;
+                    };
+                default:
+                    break;
+            }
+        }
+
+        bool is_left_rooted = comparison->is_type_checked == false || is_heap_type(type);
+
+        return [comparison, left, right, is_left_rooted](Interpreter *interp, Scope *scope) {
+            Value left_value = left(interp, scope);
+            if (is_left_rooted) interp->temporaries.push_back(left_value);
+            Value right_value = right(interp, scope);
+            if (is_left_rooted) interp->temporaries.pop_back();
+
+            return compare_values(comparison, left_value, right_value);
+        };
+    }
+
+    bool is_evaluated = node->node_type == Ast_Node::Type::UNARY_OP || node->node_type == Ast_Node::Type::LITERAL
+        || node->node_type == Ast_Node::Type::VARIABLE || node->node_type == Ast_Node::Type::FUNCTION_CALL;
+
+    if (is_evaluated == false) {
+        return [node](Interpreter *interp, Scope *scope) {
+            report_fatal_error("Invalid comparison", node->site);
+            return false;
+        };
+    }
+
+    Expr_Closure value = compile_expression(node);
+
+    if (node->data_type == Data_Type::BOOL) {
+        return [value](Interpreter *interp, Scope *scope) { return value(interp, scope).boolean; };
+    }
+
+    return [node, value](Interpreter *interp, Scope *scope) {
+        Value result = value(interp, scope);
+        if (result.data_type != Data_Type::BOOL) report_fatal_error("Invalid comparison", node->site);
+
+        return result.boolean;
+    };
+}
+
+Stmt_Closure Closure_Engine::compile_block(Ast_Block *block) {
+    std::vector<Stmt_Closure> children;
+    std::vector<Code_Site> sites;
+
+    for (Ast_Node *child : block->children) {
+        // Definitions do nothing when run, bugs are compiled when calls to them are
+        if (child->node_type == Ast_Node::Type::FUNCTION_DEFINITION || child->node_type == Ast_Node::Type::EMPTY) continue;
+
+        children.push_back(compile_statement(child));
+        sites.push_back(child->site);
+    }
+
+    return [children, sites](Interpreter *interp, Scope *scope, Value *ret) {
+        for (size_t i = 0; i < children.size(); i++) {
+            // Statement boundaries are still the only points where the collector runs
+            if (heap.should_collect()) interp->collect_garbage(scope);
+
+            bool has_returned = children[i](interp, scope, ret);
+
+            if (profile_ticks.load(std::memory_order_relaxed) != interp->seen_profile_ticks) interp->sample_profile(sites[i]);
+            if (has_returned) return true;
+        }
+
+        return false;
+    };
+}
+
+Stmt_Closure Closure_Engine::compile_statement(Ast_Node *node) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BLOCK:
+            return compile_block((Ast_Block *)node);
+        case Ast_Node::Type::RETURN:
+            return compile_return((Ast_Return *)node);
+        case Ast_Node::Type::IF:
+            return compile_if((Ast_If *)node);
+        case Ast_Node::Type::WHILE:
+            return compile_while((Ast_While *)node);
+        case Ast_Node::Type::LOOP:
+            return compile_loop((Ast_Loop *)node);
+        case Ast_Node::Type::FUNCTION_CALL: {
+            // Value of a bug called as a statement is discarded
+            Expr_Closure call = compile_call((Ast_Function_Call *)node);
+
+            return [call](Interpreter *interp, Scope *scope, Value *ret) {
+                call(interp, scope);
+                return false;
+            };
+        }
+        case Ast_Node::Type::ASSIGNMENT:
+            return compile_assignment((Ast_Assignment *)node);
+        default:
+            return [](Interpreter *interp, Scope *scope, Value *ret) { return false; };
+    }
+}
+
+struct Closure_Branch {
+    // Empty for the else branch
+    Bool_Closure condition;
+    Stmt_Closure body;
+    int frame_size;
+};
+
+Stmt_Closure Closure_Engine::compile_if(Ast_If *if_node) {
+    std::vector<Closure_Branch> branches;
+
+    for (; if_node != NULL; if_node = if_node->failure) {
+        Closure_Branch branch;
+
+        if (if_node->comparison != NULL) branch.condition = compile_condition(if_node->comparison);
+        branch.body = compile_block(if_node->success);
+        branch.frame_size = if_node->success->frame_size;
+
+        branches.push_back(branch);
+    }
+
+    return [branches](Interpreter *interp, Scope *scope, Value *ret) {
+        for (const Closure_Branch &branch : branches) {
+            if (branch.condition == nullptr || branch.condition(interp, scope)) {
+                Scope success_scope(scope, &interp->stack, branch.frame_size);
+                return branch.body(interp, &success_scope, ret);
+            }
+        }
+
+        return false;
+    };
+}
+
+Stmt_Closure Closure_Engine::compile_while(Ast_While *while_node) {
+    Bool_Closure condition = compile_condition(while_node->comparison);
+    Stmt_Closure body = compile_block(while_node->body);
+    int frame_size = while_node->body->frame_size;
+
+    return [condition, body, frame_size](Interpreter *interp, Scope *scope, Value *ret) {
+        Scope body_scope(scope, &interp->stack, frame_size);
+
+        while (condition(interp, scope)) {
+            body_scope.clear(0);
+            if (body(interp, &body_scope, ret)) return true;
+        }
+
+        return false;
+    };
+}
+
+Stmt_Closure Closure_Engine::compile_loop(Ast_Loop *loop_node) {
+    Expr_Closure start = compile_expression(loop_node->start);
+    Expr_Closure to = compile_expression(loop_node->to);
+    Expr_Closure step = compile_expression(loop_node->step);
+    Stmt_Closure body = compile_block(loop_node->body);
+
+    return [loop_node, start, to, step, body](Interpreter *interp, Scope *scope, Value *ret) {
+        Value from_value = start(interp, scope);
+        Value to_value = to(interp, scope);
+        Value step_value = step(interp, scope);
+
+        bool is_control_invalid = from_value.data_type != Data_Type::NUM || to_value.data_type != Data_Type::NUM || step_value.data_type != Data_Type::NUM;
+
+        if (loop_node->is_type_checked == false && is_control_invalid) {
+            report_fatal_error("Attempted to use non-num expression as control in a from loop", loop_node->site);
+        }
+
+        float from_num = from_value.num;
+        float to_num = to_value.num;
+        float step_num = step_value.num;
+
+        if (step_num < 0 && from_num < to_num) report_fatal_error("from < to but step value is negative", loop_node->site);
+        if (step_num > 0 && from_num > to_num) report_fatal_error("to > from but step value is positive", loop_node->site);
+        if (step_num == 0) report_fatal_error("step value cannot be 0", loop_node->site);
+
+        if (loop_node->is_parallel) {
+            run_par_loop(interp, scope, loop_node, body, from_num, to_num, step_num);
+            return false;
+        }
+
+        bool is_going_up = to_num > from_num;
+
+        Scope body_scope(scope, &interp->stack, loop_node->body->frame_size);
+
+        for (float i = from_num; is_going_up ? i < to_num : i > to_num; i += step_num) {
+            body_scope.clear(1);
+
+            // 'it' is always the first slot of the loop body
+            *get_slot(&body_scope, 0, 0) = num_value(i);
+
+            if (body(interp, &body_scope, ret)) return true;
+        }
+
+        return false;
+    };
+}
+
+Stmt_Closure Closure_Engine::compile_return(Ast_Return *ret_node) {
+    if (ret_node->is_tail_call) {
+        auto *call = (Ast_Function_Call *)ret_node->value;
+        std::vector<Expr_Closure> args;
+
+        for (Ast_Node *arg : call->args) args.push_back(compile_expression(arg));
+
+        // Args are left on temporaries for the call to rebind, as in walk_from_root
+        return [call, args](Interpreter *interp, Scope *scope, Value *ret) {
+            for (const Expr_Closure &arg : args) {
+                interp->temporaries.push_back(arg(interp, scope));
+            }
+
+            interp->tail_call = call;
+            return true;
+        };
+    }
+
+    Expr_Closure value = compile_expression(ret_node->value);
+
+    return [value](Interpreter *interp, Scope *scope, Value *ret) {
+        *ret = value(interp, scope);
+        return true;
+    };
+}
+
+// The slot is only looked up once the right side is worked out, as that can
+// grow the stack out from under it
+Stmt_Closure Closure_Engine::compile_assignment(Ast_Assignment *node) {
+    Expr_Closure right = compile_expression(node->right);
+    int depth = node->left->depth;
+    int slot = node->left->slot;
+
+    if (node->is_first_assign == false) {
+        return [node, right, depth, slot](Interpreter *interp, Scope *scope, Value *ret) {
+            Value expr = right(interp, scope);
+            Value *target = get_slot(scope, depth, slot);
+
+            fail_if_reassign_invalid(interp, scope, node, target, expr);
+            *target = expr;
+
+            return false;
+        };
+    }
+
+    if (node->is_type_checked) {
+        return [right, depth, slot](Interpreter *interp, Scope *scope, Value *ret) {
+            Value expr = right(interp, scope);
+            *get_slot(scope, depth, slot) = expr;
+
+            return false;
+        };
+    }
+
+    return [node, right, depth, slot](Interpreter *interp, Scope *scope, Value *ret) {
+        Value expr = right(interp, scope);
+
+        if (node->left->data_type != expr.data_type) {
+            std::stringstream ss;
+            ss << "Tried to assign expression of type '" <<  data_type_to_string(expr.data_type)
+                << "' to variable of type '" << data_type_to_string(node->left->data_type) << "'";
+            report_fatal_error(ss.str(), node->right->site);
+        }
+
+        *get_slot(scope, depth, slot) = expr;
+        return false;
+    };
+}
+
+void Closure_Engine::interpret() {
+    Stmt_Closure root = compile_block(unit->root);
+    Scope global_scope(NULL, &interp->stack, unit->root->frame_size);
+
+    if (is_profiling) interp->profile_frames.push_back(Profile_Frame(NULL, unit->root->site));
+
+    Value ret;
+    root(interp, &global_scope, &ret);
+}
@@ -0,0 +1,74 @@
+#ifndef CLOSURE_H
+#define CLOSURE_H
+
+#include <functional>
+#include <unordered_map>
+#include "interp.hpp"
+#include "parser.hpp"
+#include "scope.hpp"
+#include "unit.hpp"
+
+// Third engine, which runs the tree like the walker but turns every node into
+// a closure once before running anything. Whatever can be known about a node
+// up front is decided while making its closure: which operator it applies,
+// whether the checker proved its operand types, how many scopes up its
+// variable lives. Running a node is then a single indirect call, with none of
+// the node_type and op ladders the walker goes down on every visit.
+//
+// Closures are run against an Interpreter, which only serves as the runtime
+// state: the value stack, temporaries, memo keys and par loop workers. Scopes,
+// the collector, memo tables and the JIT are all used exactly as the walker
+// uses them, and results and errors are the same, except that a comparison
+// used as a value only evaluates its operands once, as in the VM.
+
+typedef std::function<Value(Interpreter *interp, Scope *scope)> Expr_Closure;
+typedef std::function<bool(Interpreter *interp, Scope *scope)> Bool_Closure;
+
+// True when a return statement was hit, with the returned value written to ret
+typedef std::function<bool(Interpreter *interp, Scope *scope, Value *ret)> Stmt_Closure;
+
+struct Closure_Function {
+    Ast_Function_Definition *def;
+    Stmt_Closure body;
+
+    Closure_Function(Ast_Function_Definition *def) {
+        this->def = def;
+    }
+};
+
+struct Closure_Engine {
+    Compilation_Unit *unit;
+    Interpreter *interp;
+
+    // Every bug that can be called, made the first time a call to it is
+    // compiled so recursive calls can refer to it before its body is done
+    std::unordered_map<Ast_Function_Definition *, Closure_Function *> functions;
+
+    Closure_Engine(Compilation_Unit *unit) {
+        this->unit = unit;
+        this->interp = new Interpreter(unit);
+    }
+
+    Closure_Function *get_function(Ast_Function_Definition *def);
+
+    Expr_Closure compile_expression(Ast_Node *node);
+    Expr_Closure compile_variable(Ast_Variable *var);
+    Expr_Closure compile_binary_op(Ast_Binary_Op *node);
+    Expr_Closure compile_unary_op(Ast_Unary_Op *node);
+    Expr_Closure compile_array(Ast_Array *array);
+    Expr_Closure compile_call(Ast_Function_Call *call);
+    Expr_Closure compile_native_call(Ast_Function_Call *call);
+    Bool_Closure compile_condition(Ast_Node *node);
+
+    Stmt_Closure compile_block(Ast_Block *block);
+    Stmt_Closure compile_statement(Ast_Node *node);
+    Stmt_Closure compile_if(Ast_If *if_node);
+    Stmt_Closure compile_while(Ast_While *while_node);
+    Stmt_Closure compile_loop(Ast_Loop *loop_node);
+    Stmt_Closure compile_return(Ast_Return *ret_node);
+    Stmt_Closure compile_assignment(Ast_Assignment *node);
+
+    void interpret();
+};
+
+#endif
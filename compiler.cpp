@@ -0,0 +1,584 @@
+#include <algorithm>
+
+#include "compiler.hpp"
+#include "logger.hpp"
+#include "shel_lib.hpp"
+
+static const int MAX_SLOTS = 1 << 16;
+
+Ast_Node *Chunk::origin_at(uint32_t offset) {
+    // Origins are in order of offset, and the profiler looks them up on every sample
+    auto after = std::upper_bound(origins.begin(), origins.end(), offset, [](uint32_t offset, const std::pair<uint32_t, Ast_Node *> &origin) {
+        return offset < origin.first;
+    });
+
+    return after == origins.begin() ? NULL : (after - 1)->second;
+}
+
+int op_stack_effect(Op_Code op) {
+    switch (op) {
+        case OP_CONSTANT:
+        case OP_VOID:
+        case OP_LOAD_LOCAL:
+        case OP_LOAD_OUTER:
+            return 1;
+        case OP_POP:
+        case OP_STORE_LOCAL:
+        case OP_DECLARE_LOCAL:
+        case OP_STORE_OUTER:
+        case OP_ADD: case OP_SUBTRACT: case OP_MULTIPLY: case OP_DIVIDE: case OP_MODULO: case OP_EXPONENT:
+        case OP_EQUALS: case OP_NOT_EQUALS: case OP_LESS_THAN: case OP_GREATER_THAN: case OP_LESS_THAN_EQUALS: case OP_GREATER_THAN_EQUALS:
+        case OP_AND: case OP_OR:
+        case OP_JUMP_IF_FALSE:
+        case OP_RETURN:
+            return -1;
+        case OP_LOOP_PREPARE:
+            return -3;
+        case OP_PAR_PREPARE:
+            return -4;
+        // Variable effects (OP_ARRAY, OP_CALL, OP_CALL_NATIVE) are adjusted by the caller
+        case OP_ARRAY:
+        case OP_CALL:
+        case OP_CALL_NATIVE:
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+Program *Compiler::compile(Ast_Block *root) {
+    auto *main = new Bytecode_Function("main", Data_Type::VOID, 0, 0, root->site);
+    program->functions.push_back(main);
+
+    state = new Function_State(NULL, main);
+
+    push_scope(root);
+    compile_block(root);
+    emit_op(OP_RETURN_VOID, root);
+    pop_scope();
+
+    delete state;
+    state = NULL;
+
+    return program;
+}
+
+void Compiler::compile_function(Ast_Function_Definition *def, int index) {
+    Bytecode_Function *function = program->functions[index];
+    auto *function_state = new Function_State(state, function);
+
+    state = function_state;
+
+    // Args are the first slots of the bug's scope, where OP_CALL leaves them
+    push_scope(def->block);
+    compile_block(def->block);
+    emit_op(OP_RETURN_VOID, def);
+    pop_scope();
+
+    state = function_state->enclosing;
+    delete function_state;
+}
+
+void Compiler::compile_block(Ast_Block *block) {
+    // Bugs are visible to the whole block they are defined in, so they can be
+    // called before their definition and can call each other recursively.
+    // Their bodies are compiled once the block is finished so they can also
+    // see every variable the block declares.
+    std::vector<std::pair<Ast_Function_Definition *, int>> pending;
+
+    for (Ast_Node *child : block->children) {
+        if (child->node_type != Ast_Node::Type::FUNCTION_DEFINITION) continue;
+
+        auto *def = (Ast_Function_Definition *)child;
+        int index = program->functions.size();
+        int depth = state->function->depth + 1;
+
+        program->functions.push_back(new Bytecode_Function(def->name, def->data_type, def->args.size(), depth, def->site));
+        program->functions.back()->memo = def->memo;
+        program->functions.back()->definition = def;
+        function_indices[def] = index;
+        pending.push_back(std::make_pair(def, index));
+    }
+
+    for (Ast_Node *child : block->children) {
+        compile_statement(child);
+    }
+
+    for (auto &p : pending) {
+        compile_function(p.first, p.second);
+    }
+}
+
+void Compiler::compile_scoped_block(Ast_Block *block) {
+    push_scope(block);
+    compile_clear_locals(block, 0);
+    compile_block(block);
+    pop_scope();
+}
+
+void Compiler::compile_statement(Ast_Node *node) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BLOCK:
+            // Bare blocks share the scope of their parent, same as the tree walker
+            compile_block((Ast_Block *)node);
+            break;
+        case Ast_Node::Type::FUNCTION_DEFINITION:
+            // Hoisted and compiled by compile_block
+            break;
+        case Ast_Node::Type::RETURN:
+            compile_return((Ast_Return *)node);
+            break;
+        case Ast_Node::Type::IF:
+            compile_if((Ast_If *)node);
+            break;
+        case Ast_Node::Type::WHILE:
+            compile_while((Ast_While *)node);
+            break;
+        case Ast_Node::Type::LOOP:
+            compile_loop((Ast_Loop *)node);
+            break;
+        case Ast_Node::Type::FUNCTION_CALL:
+            compile_function_call((Ast_Function_Call *)node);
+            emit_op(OP_POP, node);
+            break;
+        case Ast_Node::Type::ASSIGNMENT:
+            compile_assignment((Ast_Assignment *)node);
+            break;
+        default:
+            break;
+    }
+}
+
+void Compiler::compile_expression(Ast_Node *node) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BINARY_OP:
+            compile_binary_op((Ast_Binary_Op *)node);
+            break;
+        case Ast_Node::Type::UNARY_OP:
+            compile_unary_op((Ast_Unary_Op *)node);
+            break;
+        case Ast_Node::Type::LITERAL: {
+            emit_op(OP_CONSTANT, node);
+            emit_u32(add_constant(((Ast_Literal *)node)->value));
+            break;
+        }
+        case Ast_Node::Type::ARRAY: {
+            auto *array = (Ast_Array *)node;
+
+            if (array->items.size() >= MAX_SLOTS) report_fatal_error("Too many items in array literal", node->site);
+
+            for (Ast_Node *item : array->items) {
+                compile_expression(item);
+            }
+
+            emit_op(OP_ARRAY, node);
+            emit_u16(array->items.size());
+            adjust_stack(-(int)array->items.size());
+            break;
+        }
+        case Ast_Node::Type::FUNCTION_CALL:
+            compile_function_call((Ast_Function_Call *)node);
+            break;
+        case Ast_Node::Type::VARIABLE:
+            compile_variable((Ast_Variable *)node);
+            break;
+        default:
+            emit_op(OP_VOID, node);
+            break;
+    }
+}
+
+void Compiler::compile_assignment(Ast_Assignment *node) {
+    // Right hand side is compiled before the declaration so that
+    // 'num x = x + 1;' still sees any outer x, same as the tree walker.
+    compile_expression(node->right);
+
+    if (node->is_first_assign) {
+        int hops = 0, slot = 0;
+        find_slot(node->left, &hops, &slot);
+
+        emit_op(OP_DECLARE_LOCAL, node);
+        emit_u16(slot);
+        emit_u8(node->left->data_type);
+        return;
+    }
+
+    compile_store(node, node->left);
+}
+
+void Compiler::compile_store(Ast_Node *origin, Ast_Variable *var) {
+    int hops = 0, slot = 0;
+    find_slot(var, &hops, &slot);
+
+    if (hops == 0) {
+        emit_op(OP_STORE_LOCAL, origin);
+    } else {
+        emit_op(OP_STORE_OUTER, origin);
+        emit_u8(hops);
+    }
+
+    emit_u16(slot);
+}
+
+void Compiler::compile_function_call(Ast_Function_Call *call) {
+    // The resolver bound every call to either a bug in the script or a native,
+    // and has already checked the arg count of the bug
+    if (call->definition != NULL) {
+        int index = function_indices[call->definition];
+        Bytecode_Function *function = program->functions[index];
+
+        for (int i = 0; i < call->args.size(); i++) {
+            compile_expression(call->args[i]);
+            compile_arg_check(call, i, call->definition->args[i]->data_type);
+        }
+
+        emit_op(OP_CALL, call);
+        emit_u32(index);
+        emit_u8(get_hops(call->depth));
+        adjust_stack(-function->arity);
+        return;
+    }
+
+    if (call->args.size() > 255) report_fatal_error("Too many args passed to native bug", call->args_start_site);
+
+    Native_Function *native = call->native;
+
+    for (int i = 0; i < call->args.size(); i++) {
+        compile_expression(call->args[i]);
+
+        if (native->arity != -1) {
+            compile_arg_check(call, i, native->arg_types[i]);
+        } else if (i == 0 && call->args.size() > 1) {
+            compile_arg_check(call, i, Data_Type::STR);
+        }
+    }
+
+    // Natives were bound by the resolver, so the VM calls straight through the
+    // pointer and passes the site without searching the origins
+    emit_op(OP_CALL_NATIVE, call);
+    emit_u32(add_native_call(call));
+    emit_u8(call->args.size());
+    adjust_stack(-(int)call->args.size());
+}
+
+// Args the checker could only type as ANY are checked as they are passed
+void Compiler::compile_arg_check(Ast_Function_Call *call, int index, Data_Type expected) {
+    if (call->args[index]->data_type != Data_Type::ANY || expected == Data_Type::ANY) return;
+
+    emit_op(OP_CHECK_ARG, call);
+    emit_u8(index);
+    emit_u8(expected);
+}
+
+void Compiler::compile_return(Ast_Return *node) {
+    if (node->value->node_type == Ast_Node::Type::EMPTY) {
+        emit_op(OP_RETURN_VOID, node);
+        return;
+    }
+
+    if (node->is_tail_call) {
+        auto *call = (Ast_Function_Call *)node->value;
+
+        for (int i = 0; i < call->args.size(); i++) {
+            compile_expression(call->args[i]);
+            compile_arg_check(call, i, call->definition->args[i]->data_type);
+        }
+
+        emit_op(OP_TAIL_CALL, call);
+        adjust_stack(-(int)call->args.size());
+        return;
+    }
+
+    compile_expression(node->value);
+    emit_op(OP_RETURN, node);
+}
+
+void Compiler::compile_if(Ast_If *if_node) {
+    std::vector<uint32_t> end_jumps;
+
+    while (if_node != NULL) {
+        uint32_t failure_jump = 0;
+
+        // Comparison is NULL in else node
+        if (if_node->comparison != NULL) {
+            compile_expression(if_node->comparison);
+            failure_jump = emit_jump(OP_JUMP_IF_FALSE, if_node->comparison);
+        }
+
+        compile_scoped_block(if_node->success);
+
+        if (if_node->failure != NULL) end_jumps.push_back(emit_jump(OP_JUMP, if_node));
+        if (if_node->comparison != NULL) patch_u32(failure_jump, current_chunk()->code.size());
+
+        if_node = if_node->failure;
+    }
+
+    for (uint32_t jump : end_jumps) {
+        patch_u32(jump, current_chunk()->code.size());
+    }
+}
+
+void Compiler::compile_while(Ast_While *while_node) {
+    uint32_t start = current_chunk()->code.size();
+
+    compile_expression(while_node->comparison);
+    uint32_t exit_jump = emit_jump(OP_JUMP_IF_FALSE, while_node->comparison);
+
+    compile_scoped_block(while_node->body);
+
+    emit_op(OP_JUMP, while_node);
+    emit_u32(start);
+
+    patch_u32(exit_jump, current_chunk()->code.size());
+}
+
+void Compiler::compile_loop(Ast_Loop *loop_node) {
+    if (loop_node->is_parallel) {
+        compile_par_loop(loop_node);
+        return;
+    }
+
+    compile_expression(loop_node->start);
+    compile_expression(loop_node->to);
+    compile_expression(loop_node->step);
+
+    // Counter, end and step live in hidden slots for the duration of the loop
+    int base = declare_hidden_slot();
+    declare_hidden_slot();
+    declare_hidden_slot();
+
+    emit_op(OP_LOOP_PREPARE, loop_node);
+    emit_u16(base);
+
+    // 'it' is always the first slot of the loop body
+    push_scope(loop_node->body);
+    int it_slot = scopes.back().base;
+
+    uint32_t test = current_chunk()->code.size();
+    emit_op(OP_LOOP_TEST, loop_node);
+    emit_u16(base);
+    emit_u16(it_slot);
+    uint32_t exit_jump = current_chunk()->code.size();
+    emit_u32(0);
+
+    compile_clear_locals(loop_node, 1);
+    compile_block(loop_node->body);
+
+    emit_op(OP_LOOP_NEXT, loop_node);
+    emit_u16(base);
+    emit_u32(test);
+
+    patch_u32(exit_jump, current_chunk()->code.size());
+    pop_scope();
+}
+
+// The VM runs par loops on a single thread, but chunk by chunk exactly as the
+// tree walker would, so reductions come out the same. The loop's counters are
+// kept by the VM rather than in hidden slots, as they can outgrow a num.
+void Compiler::compile_par_loop(Ast_Loop *loop_node) {
+    Ast_Variable *reduction = loop_node->reduction;
+
+    compile_expression(loop_node->start);
+    compile_expression(loop_node->to);
+    compile_expression(loop_node->step);
+
+    if (reduction != NULL) {
+        compile_variable(reduction);
+    } else {
+        emit_op(OP_VOID, loop_node);
+    }
+
+    // The body's copy of the reduce variable always follows 'it'
+    push_scope(loop_node->body);
+    int it_slot = scopes.back().base;
+
+    emit_op(OP_PAR_PREPARE, loop_node);
+    emit_u16(it_slot);
+
+    uint32_t test = current_chunk()->code.size();
+    emit_op(OP_PAR_TEST, loop_node);
+    emit_u16(it_slot);
+    uint32_t exit_jump = current_chunk()->code.size();
+    emit_u32(0);
+
+    compile_clear_locals(loop_node, reduction != NULL ? 2 : 1);
+    compile_block(loop_node->body);
+
+    emit_op(OP_PAR_NEXT, loop_node);
+    emit_u32(test);
+
+    patch_u32(exit_jump, current_chunk()->code.size());
+    pop_scope();
+
+    // The total is left on the stack when the loop exits
+    if (reduction != NULL) {
+        adjust_stack(1);
+        compile_store(reduction, reduction);
+    }
+}
+
+// Every slot of the innermost scope from first_slot on goes back to unassigned,
+// as the tree walker starts each run of an if, while or from body with a fresh
+// scope. Otherwise a bug defined in the body could read a variable the body
+// hasn't assigned yet this time round, left over from the run before.
+void Compiler::compile_clear_locals(Ast_Node *origin, int first_slot) {
+    Compiler_Scope &scope = scopes.back();
+    int count = scope.block->frame_size - first_slot;
+
+    if (count <= 0) return;
+
+    emit_op(OP_CLEAR_LOCALS, origin);
+    emit_u16(scope.base + first_slot);
+    emit_u16(count);
+}
+
+void Compiler::compile_binary_op(Ast_Binary_Op *node) {
+    compile_expression(node->left);
+    compile_expression(node->right);
+
+    switch (node->op.type) {
+        case Token::Type::OP_PLUS:
+        case Token::Type::OP_PLUS_EQUALS:               emit_op(OP_ADD, node); break;
+        case Token::Type::OP_MINUS:
+        case Token::Type::OP_MINUS_EQUALS:              emit_op(OP_SUBTRACT, node); break;
+        case Token::Type::OP_MULTIPLY:
+        case Token::Type::OP_MULTIPLY_EQUALS:           emit_op(OP_MULTIPLY, node); break;
+        case Token::Type::OP_DIVIDE:
+        case Token::Type::OP_DIVIDE_EQUALS:             emit_op(OP_DIVIDE, node); break;
+        case Token::Type::OP_MODULO:
+        case Token::Type::OP_MODULO_EQUALS:             emit_op(OP_MODULO, node); break;
+        case Token::Type::OP_EXPONENT:
+        case Token::Type::OP_EXPONENT_EQUALS:           emit_op(OP_EXPONENT, node); break;
+        case Token::Type::COMPARE_EQUALS:               emit_op(OP_EQUALS, node); break;
+        case Token::Type::COMPARE_NOT_EQUALS:           emit_op(OP_NOT_EQUALS, node); break;
+        case Token::Type::COMPARE_LESS_THAN:            emit_op(OP_LESS_THAN, node); break;
+        case Token::Type::COMPARE_GREATER_THAN:         emit_op(OP_GREATER_THAN, node); break;
+        case Token::Type::COMPARE_LESS_THAN_EQUALS:     emit_op(OP_LESS_THAN_EQUALS, node); break;
+        case Token::Type::COMPARE_GREATER_THAN_EQUALS:  emit_op(OP_GREATER_THAN_EQUALS, node); break;
+        case Token::Type::LOGICAL_AND:                  emit_op(OP_AND, node); break;
+        case Token::Type::LOGICAL_OR:                   emit_op(OP_OR, node); break;
+        default:
+            report_fatal_error("Invalid binary operator", node->op.site);
+            break;
+    }
+}
+
+void Compiler::compile_unary_op(Ast_Unary_Op *node) {
+    compile_expression(node->node);
+
+    switch (node->op.type) {
+        case Token::Type::LOGICAL_NOT: emit_op(OP_NOT, node); break;
+        case Token::Type::OP_MINUS:    emit_op(OP_NEGATE, node); break;
+        case Token::Type::OP_PLUS:     emit_op(OP_POSITIVE, node); break;
+        default:
+            report_fatal_error("Invalid unary operator", node->op.site);
+            break;
+    }
+}
+
+void Compiler::compile_variable(Ast_Variable *node) {
+    int hops = 0, slot = 0;
+    find_slot(node, &hops, &slot);
+
+    if (hops == 0) {
+        emit_op(OP_LOAD_LOCAL, node);
+    } else {
+        emit_op(OP_LOAD_OUTER, node);
+        emit_u8(hops);
+    }
+
+    emit_u16(slot);
+}
+
+// Scopes are opened at the same points as in the resolver, each taking the
+// slots it needs after those already in use in its bug's frame
+void Compiler::push_scope(Ast_Block *block) {
+    int base = state->function->frame_size;
+
+    if (base + block->frame_size > MAX_SLOTS) report_fatal_error("Too many variables declared in one bug", block->site);
+
+    state->function->frame_size += block->frame_size;
+    scopes.push_back(Compiler_Scope(block, base, state->function->depth));
+}
+
+void Compiler::pop_scope() {
+    scopes.pop_back();
+}
+
+int Compiler::declare_hidden_slot() {
+    if (state->function->frame_size >= MAX_SLOTS) report_fatal_error("Too many variables declared in one bug", state->function->site);
+
+    return state->function->frame_size++;
+}
+
+void Compiler::find_slot(Ast_Variable *var, int *hops, int *slot) {
+    *hops = get_hops(var->depth);
+    *slot = scopes[scopes.size() - 1 - var->depth].base + var->slot;
+}
+
+// Frames to follow out to the bug holding the scope depth levels up
+int Compiler::get_hops(int depth) {
+    return state->function->depth - scopes[scopes.size() - 1 - depth].function_depth;
+}
+
+Chunk *Compiler::current_chunk() {
+    return &state->function->chunk;
+}
+
+void Compiler::adjust_stack(int delta) {
+    state->stack_depth += delta;
+
+    if (state->stack_depth > state->function->max_stack) state->function->max_stack = state->stack_depth;
+}
+
+void Compiler::emit_op(Op_Code op, Ast_Node *origin) {
+    Chunk *chunk = current_chunk();
+
+    if (chunk->origins.empty() || chunk->origins.back().second != origin) {
+        chunk->origins.push_back(std::make_pair((uint32_t)chunk->code.size(), origin));
+    }
+
+    chunk->code.push_back(op);
+    adjust_stack(op_stack_effect(op));
+}
+
+void Compiler::emit_u8(uint8_t value) {
+    current_chunk()->code.push_back(value);
+}
+
+void Compiler::emit_u16(uint16_t value) {
+    emit_u8(value & 0xFF);
+    emit_u8((value >> 8) & 0xFF);
+}
+
+void Compiler::emit_u32(uint32_t value) {
+    emit_u16(value & 0xFFFF);
+    emit_u16((value >> 16) & 0xFFFF);
+}
+
+uint32_t Compiler::emit_jump(Op_Code op, Ast_Node *origin) {
+    emit_op(op, origin);
+    uint32_t operand = current_chunk()->code.size();
+    emit_u32(0);
+
+    return operand;
+}
+
+void Compiler::patch_u32(uint32_t offset, uint32_t value) {
+    std::vector<uint8_t> &code = current_chunk()->code;
+
+    code[offset] = value & 0xFF;
+    code[offset + 1] = (value >> 8) & 0xFF;
+    code[offset + 2] = (value >> 16) & 0xFF;
+    code[offset + 3] = (value >> 24) & 0xFF;
+}
+
+uint32_t Compiler::add_constant(Value value) {
+    current_chunk()->constants.push_back(value);
+    return current_chunk()->constants.size() - 1;
+}
+
+uint32_t Compiler::add_native_call(Ast_Function_Call *call) {
+    current_chunk()->native_calls.push_back(call);
+    return current_chunk()->native_calls.size() - 1;
+}
@@ -0,0 +1,91 @@
+#ifndef COMPILER_H
+#define COMPILER_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "bytecode.hpp"
+#include "parser.hpp"
+
+// One of the resolver's scopes, laid out in the frame of the bug it's in.
+// Variables are bound to (depth, slot) by the resolver, so the frame slot is
+// just base + slot of the scope depth levels up.
+struct Compiler_Scope {
+    Ast_Block *block;
+    int base;
+    int function_depth;
+
+    Compiler_Scope(Ast_Block *block, int base, int function_depth) {
+        this->block = block;
+        this->base = base;
+        this->function_depth = function_depth;
+    }
+};
+
+struct Function_State {
+    Function_State *enclosing;
+    Bytecode_Function *function;
+    int stack_depth;
+
+    Function_State(Function_State *enclosing, Bytecode_Function *function) {
+        this->enclosing = enclosing;
+        this->function = function;
+        this->stack_depth = 0;
+    }
+};
+
+struct Compiler {
+    Program *program;
+    Function_State *state;
+
+    // Every scope around the code being compiled, across bugs, innermost last
+    std::vector<Compiler_Scope> scopes;
+
+    // Index into program->functions of every bug hoisted so far
+    std::unordered_map<Ast_Function_Definition *, int> function_indices;
+
+    Compiler() {
+        this->program = new Program();
+        this->state = NULL;
+    }
+
+    Program *compile(Ast_Block *root);
+
+    void compile_function(Ast_Function_Definition *def, int index);
+    void compile_block(Ast_Block *block);
+    void compile_scoped_block(Ast_Block *block);
+    void compile_statement(Ast_Node *node);
+    void compile_expression(Ast_Node *node);
+    void compile_assignment(Ast_Assignment *node);
+    void compile_function_call(Ast_Function_Call *call);
+    void compile_arg_check(Ast_Function_Call *call, int index, Data_Type expected);
+    void compile_return(Ast_Return *node);
+    void compile_if(Ast_If *if_node);
+    void compile_while(Ast_While *while_node);
+    void compile_loop(Ast_Loop *loop_node);
+    void compile_par_loop(Ast_Loop *loop_node);
+    void compile_binary_op(Ast_Binary_Op *node);
+    void compile_unary_op(Ast_Unary_Op *node);
+    void compile_variable(Ast_Variable *node);
+    void compile_store(Ast_Node *origin, Ast_Variable *var);
+    void compile_clear_locals(Ast_Node *origin, int first_slot);
+
+    void push_scope(Ast_Block *block);
+    void pop_scope();
+    int declare_hidden_slot();
+    void find_slot(Ast_Variable *var, int *hops, int *slot);
+    int get_hops(int depth);
+
+    Chunk *current_chunk();
+    void adjust_stack(int delta);
+    void emit_op(Op_Code op, Ast_Node *origin);
+    void emit_u8(uint8_t value);
+    void emit_u16(uint16_t value);
+    void emit_u32(uint32_t value);
+    uint32_t emit_jump(Op_Code op, Ast_Node *origin);
+    void patch_u32(uint32_t offset, uint32_t value);
+    uint32_t add_constant(Value value);
+    uint32_t add_native_call(Ast_Function_Call *call);
+};
+
+#endif
@@ -0,0 +1,169 @@
+#include <climits>
+#include <cmath>
+
+#include "folder.hpp"
+#include "gc.hpp"
+
+void Folder::fold(Ast_Block *root) {
+    fold_block(root);
+}
+
+void Folder::fold_block(Ast_Block *block) {
+    for (Ast_Node *child : block->children) {
+        fold_statement(child);
+    }
+}
+
+void Folder::fold_statement(Ast_Node *node) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BLOCK:
+            fold_block((Ast_Block *)node);
+            break;
+        case Ast_Node::Type::RETURN: {
+            auto *ret = (Ast_Return *)node;
+            ret->value = fold_expression(ret->value);
+            break;
+        }
+        case Ast_Node::Type::IF: {
+            for (auto *if_node = (Ast_If *)node; if_node != NULL; if_node = if_node->failure) {
+                if (if_node->comparison != NULL) if_node->comparison = fold_expression(if_node->comparison);
+                fold_block(if_node->success);
+            }
+            break;
+        }
+        case Ast_Node::Type::WHILE: {
+            auto *while_node = (Ast_While *)node;
+            while_node->comparison = fold_expression(while_node->comparison);
+            fold_block(while_node->body);
+            break;
+        }
+        case Ast_Node::Type::LOOP: {
+            auto *loop_node = (Ast_Loop *)node;
+            loop_node->start = fold_expression(loop_node->start);
+            loop_node->to = fold_expression(loop_node->to);
+            loop_node->step = fold_expression(loop_node->step);
+            fold_block(loop_node->body);
+            break;
+        }
+        case Ast_Node::Type::FUNCTION_DEFINITION:
+            fold_block(((Ast_Function_Definition *)node)->block);
+            break;
+        case Ast_Node::Type::FUNCTION_CALL:
+            fold_expression(node);
+            break;
+        case Ast_Node::Type::ASSIGNMENT: {
+            auto *assignment = (Ast_Assignment *)node;
+            assignment->right = fold_expression(assignment->right);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+Ast_Node *Folder::fold_expression(Ast_Node *node) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BINARY_OP:
+            return fold_binary_op((Ast_Binary_Op *)node);
+        case Ast_Node::Type::UNARY_OP:
+            return fold_unary_op((Ast_Unary_Op *)node);
+        case Ast_Node::Type::ARRAY: {
+            auto *array = (Ast_Array *)node;
+            for (Ast_Node *&item : array->items) item = fold_expression(item);
+            return node;
+        }
+        case Ast_Node::Type::FUNCTION_CALL: {
+            auto *call = (Ast_Function_Call *)node;
+            for (Ast_Node *&arg : call->args) arg = fold_expression(arg);
+            return node;
+        }
+        default:
+            return node;
+    }
+}
+
+Ast_Node *Folder::fold_binary_op(Ast_Binary_Op *node) {
+    node->left = fold_expression(node->left);
+    node->right = fold_expression(node->right);
+
+    if (node->left->node_type != Ast_Node::Type::LITERAL || node->right->node_type != Ast_Node::Type::LITERAL) return node;
+
+    Value left = ((Ast_Literal *)node->left)->value;
+    Value right = ((Ast_Literal *)node->right)->value;
+
+    if (left.data_type != right.data_type) return node;
+
+    // Mirrors the arithmetic in Interpreter::walk_binary_op_node, so a folded
+    // expression gives the same float result the engines would have
+    if (left.data_type == Data_Type::NUM) {
+        float l = left.num;
+        float r = right.num;
+
+        switch (node->op.type) {
+            case Token::Type::OP_PLUS:                     return make_literal(num_value(l + r), node);
+            case Token::Type::OP_MINUS:                    return make_literal(num_value(l - r), node);
+            case Token::Type::OP_MULTIPLY:                 return make_literal(num_value(l * r), node);
+            case Token::Type::OP_DIVIDE:                   return make_literal(num_value(l / r), node);
+            case Token::Type::OP_EXPONENT:                 return make_literal(num_value(pow(l, r)), node);
+            case Token::Type::COMPARE_EQUALS:              return make_literal(bool_value(l == r), node);
+            case Token::Type::COMPARE_NOT_EQUALS:          return make_literal(bool_value(l != r), node);
+            case Token::Type::COMPARE_GREATER_THAN:        return make_literal(bool_value(l > r), node);
+            case Token::Type::COMPARE_GREATER_THAN_EQUALS: return make_literal(bool_value(l >= r), node);
+            case Token::Type::COMPARE_LESS_THAN:           return make_literal(bool_value(l < r), node);
+            case Token::Type::COMPARE_LESS_THAN_EQUALS:    return make_literal(bool_value(l <= r), node);
+            case Token::Type::OP_MODULO: {
+                // The engines truncate to int, which is undefined outside its range
+                bool is_in_range = fabs(l) < INT_MAX && fabs(r) < INT_MAX;
+                if (is_in_range == false || int(r) == 0) return node;
+
+                return make_literal(num_value(float(int(l) % int(r))), node);
+            }
+            default:
+                return node;
+        }
+    }
+
+    if (left.data_type == Data_Type::STR) {
+        switch (node->op.type) {
+            case Token::Type::OP_PLUS:
+                return make_literal(str_value(allocate_literal_str(arena, left.str->text() + right.str->text())), node);
+            case Token::Type::COMPARE_EQUALS:     return make_literal(bool_value(strs_equal(left.str, right.str)), node);
+            case Token::Type::COMPARE_NOT_EQUALS: return make_literal(bool_value(strs_equal(left.str, right.str) == false), node);
+            default:                              return node;
+        }
+    }
+
+    if (left.data_type == Data_Type::BOOL) {
+        switch (node->op.type) {
+            case Token::Type::LOGICAL_AND:        return make_literal(bool_value(left.boolean && right.boolean), node);
+            case Token::Type::LOGICAL_OR:         return make_literal(bool_value(left.boolean || right.boolean), node);
+            case Token::Type::COMPARE_EQUALS:     return make_literal(bool_value(left.boolean == right.boolean), node);
+            case Token::Type::COMPARE_NOT_EQUALS: return make_literal(bool_value(left.boolean != right.boolean), node);
+            default:                              return node;
+        }
+    }
+
+    return node;
+}
+
+Ast_Node *Folder::fold_unary_op(Ast_Unary_Op *node) {
+    node->node = fold_expression(node->node);
+
+    if (node->node->node_type != Ast_Node::Type::LITERAL) return node;
+
+    Value value = ((Ast_Literal *)node->node)->value;
+    Token::Type type = node->op.type;
+
+    if (value.data_type == Data_Type::NUM && type == Token::Type::OP_PLUS) return make_literal(value, node);
+    if (value.data_type == Data_Type::NUM && type == Token::Type::OP_MINUS) return make_literal(num_value(-value.num), node);
+    if (value.data_type == Data_Type::BOOL && type == Token::Type::LOGICAL_NOT) return make_literal(bool_value(!value.boolean), node);
+
+    return node;
+}
+
+Ast_Node *Folder::make_literal(Value value, Ast_Node *replaced) {
+    folded_count++;
+
+    // Errors involving the folded value still point at the operator it came from
+    return arena->make<Ast_Literal>(value, replaced->site);
+}
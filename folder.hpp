@@ -0,0 +1,33 @@
+#ifndef FOLDER_H
+#define FOLDER_H
+
+#include "arena.hpp"
+#include "parser.hpp"
+
+// Runs between parsing and resolution, replacing every unary and binary op
+// whose operands are all literals with the literal it evaluates to, so
+// 'num x = 2 ^ 10 * 3;' reaches the engines as 'num x = 3072;'.
+//
+// Only operations that are guaranteed to succeed are folded. Anything that
+// would be a runtime error (mismatched types, '-' on strs, % 0) is left in
+// the tree so the engines report it exactly as they would have otherwise.
+struct Folder {
+    Arena *arena;
+    int folded_count;
+
+    Folder(Arena *arena) {
+        this->arena = arena;
+        this->folded_count = 0;
+    }
+
+    void fold(Ast_Block *root);
+
+    void fold_block(Ast_Block *block);
+    void fold_statement(Ast_Node *node);
+    Ast_Node *fold_expression(Ast_Node *node);
+    Ast_Node *fold_binary_op(Ast_Binary_Op *node);
+    Ast_Node *fold_unary_op(Ast_Unary_Op *node);
+    Ast_Node *make_literal(Value value, Ast_Node *replaced);
+};
+
+#endif
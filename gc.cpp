@@ -0,0 +1,229 @@
+#include <iostream>
+#include <utility>
+
+#include "gc.hpp"
+#include "par.hpp"
+
+Heap heap;
+
+static const size_t MIN_MAJOR_THRESHOLD = 8 << 20;
+
+Str_Object *allocate_str(std::string value) {
+    auto *str = new Str_Object(std::move(value));
+    heap.track(str, object_size(str));
+
+    return str;
+}
+
+// Below this it's cheaper to copy the text than to keep a rope node around
+static const size_t MIN_ROPE_LENGTH = 64;
+
+Str_Object *concat_strs(Str_Object *left, Str_Object *right) {
+    if (right->length == 0) return left;
+    if (left->length == 0) return right;
+
+    if (left->length + right->length < MIN_ROPE_LENGTH) return allocate_str(left->text() + right->text());
+
+    auto *str = new Str_Object(left, right);
+    heap.track(str, object_size(str));
+
+    return str;
+}
+
+Array_Object *allocate_array(std::vector<Value> items) {
+    auto *array = new Array_Object(items);
+    array->epoch = par_epoch;
+    heap.track(array, object_size(array));
+
+    return array;
+}
+
+Array_Object *allocate_num_array(std::vector<float> nums) {
+    auto *array = new Array_Object(std::move(nums));
+    array->epoch = par_epoch;
+    heap.track(array, object_size(array));
+
+    return array;
+}
+
+// Strs decoded from literals live exactly as long as the tree that holds them,
+// so they come from the unit's arena instead of the heap. They are never on
+// the young or old lists, and starting out old and marked means the collector
+// never traces or sweeps them either.
+Str_Object *allocate_literal_str(Arena *arena, std::string value) {
+    auto *str = arena->make<Str_Object>(value);
+    str->is_old = true;
+    str->is_marked = true;
+
+    return str;
+}
+
+size_t object_size(Heap_Object *object) {
+    switch (object->object_type) {
+        case Data_Type::STR:   return sizeof(Str_Object) + ((Str_Object *)object)->flat_text.capacity();
+        case Data_Type::ARRAY: {
+            auto *array = (Array_Object *)object;
+            return sizeof(Array_Object) + array->nums.capacity() * sizeof(float) + array->items.capacity() * sizeof(Value);
+        }
+        default:               return 0;
+    }
+}
+
+// Must be called whenever a str or arr is stored into an existing array, so that
+// minor collections can find young values that are only referenced from old arrays
+void write_barrier(Array_Object *array) {
+    if (array->is_old && array->is_remembered == false) {
+        array->is_remembered = true;
+        heap.remembered.push_back(array);
+    }
+}
+
+void Heap::track(Heap_Object *object, size_t size) {
+    std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+    if (is_threaded) guard.lock();
+
+    object->next = young;
+    young = object;
+    young_bytes += size;
+}
+
+// Objects that grow in place, arrs reallocating their storage and ropes being
+// flattened, count their new bytes as allocated so append loops still bring on
+// collections
+void Heap::charge_growth(Heap_Object *object, size_t old_size) {
+    size_t size = object_size(object);
+    if (size <= old_size) return;
+
+    std::unique_lock<std::mutex> guard(lock, std::defer_lock);
+    if (is_threaded) guard.lock();
+
+    young_bytes += size - old_size;
+    if (object->is_old) old_bytes += size - old_size;
+}
+
+void Heap::begin_collection() {
+    collection_start = std::chrono::steady_clock::now();
+    is_major = old_bytes >= next_major;
+
+    // Every old array that was written to might hold young values
+    if (is_major == false) {
+        for (Array_Object *array : remembered) {
+            for (Value item : array->items) mark_value(item);
+        }
+    }
+}
+
+void Heap::mark_value(Value value) {
+    if (is_heap_value(value) == false) return;
+
+    Heap_Object *object = value.object;
+
+    if (object->is_marked) return;
+
+    // Old objects are assumed to be live during a minor collection
+    if (object->is_old && is_major == false) return;
+
+    object->is_marked = true;
+    gray.push_back(object);
+}
+
+void Heap::trace_gray() {
+    while (gray.empty() == false) {
+        Heap_Object *object = gray.back();
+        gray.pop_back();
+
+        // Unboxed num arrs leave items empty, so there's nothing to trace
+        if (object->object_type == Data_Type::ARRAY) {
+            for (Value item : ((Array_Object *)object)->items) mark_value(item);
+        }
+
+        // Rope nodes keep their halves alive until they're flattened
+        if (object->object_type == Data_Type::STR && ((Str_Object *)object)->is_flat == false) {
+            mark_value(str_value(((Str_Object *)object)->left));
+            mark_value(str_value(((Str_Object *)object)->right));
+        }
+    }
+}
+
+void Heap::free_object(Heap_Object *object) {
+    stats.objects_freed++;
+    stats.bytes_freed += object_size(object);
+
+    switch (object->object_type) {
+        case Data_Type::STR:   delete (Str_Object *)object; break;
+        case Data_Type::ARRAY: delete (Array_Object *)object; break;
+        default:               break;
+    }
+}
+
+void Heap::finish_collection() {
+    trace_gray();
+
+    // Nothing can point from old to young once the nursery is empty
+    for (Array_Object *array : remembered) array->is_remembered = false;
+    remembered.clear();
+
+    if (is_major) {
+        Heap_Object *survivors = NULL;
+        old_bytes = 0;
+
+        for (Heap_Object *object = old, *next; object != NULL; object = next) {
+            next = object->next;
+
+            if (object->is_marked) {
+                object->is_marked = false;
+                object->next = survivors;
+                survivors = object;
+                old_bytes += object_size(object);
+            } else {
+                free_object(object);
+            }
+        }
+
+        old = survivors;
+    }
+
+    // Promote everything that survived the nursery
+    for (Heap_Object *object = young, *next; object != NULL; object = next) {
+        next = object->next;
+
+        if (object->is_marked) {
+            object->is_marked = false;
+            object->is_old = true;
+            object->next = old;
+            old = object;
+            old_bytes += object_size(object);
+        } else {
+            free_object(object);
+        }
+    }
+
+    young = NULL;
+    young_bytes = 0;
+
+    if (is_major) {
+        next_major = old_bytes * 2 > MIN_MAJOR_THRESHOLD ? old_bytes * 2 : MIN_MAJOR_THRESHOLD;
+        stats.major_collections++;
+    } else {
+        stats.minor_collections++;
+    }
+
+    std::chrono::duration<double, std::milli> pause = std::chrono::steady_clock::now() - collection_start;
+
+    stats.total_pause_ms += pause.count();
+    if (pause.count() > stats.max_pause_ms) stats.max_pause_ms = pause.count();
+
+    stats.live_bytes = old_bytes;
+    if (old_bytes > stats.peak_live_bytes) stats.peak_live_bytes = old_bytes;
+}
+
+void report_gc_stats() {
+    Gc_Stats &stats = heap.stats;
+
+    std::cerr << "[GC] minor collections: " << stats.minor_collections << std::endl;
+    std::cerr << "[GC] major collections: " << stats.major_collections << std::endl;
+    std::cerr << "[GC] total pause: " << stats.total_pause_ms << " ms (max " << stats.max_pause_ms << " ms)" << std::endl;
+    std::cerr << "[GC] freed: " << stats.objects_freed << " objects, " << stats.bytes_freed << " bytes" << std::endl;
+    std::cerr << "[GC] live bytes after last collection: " << stats.live_bytes << " (peak " << stats.peak_live_bytes << ")" << std::endl;
+    std::cerr << "[GC] heap bytes at exit: " << heap.old_bytes + heap.young_bytes << std::endl;
+}
@@ -0,0 +1,78 @@
+#ifndef GC_H
+#define GC_H
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "arena.hpp"
+#include "typer.hpp"
+
+struct Gc_Stats {
+    unsigned int minor_collections = 0;
+    unsigned int major_collections = 0;
+    double total_pause_ms = 0;
+    double max_pause_ms = 0;
+    size_t objects_freed = 0;
+    size_t bytes_freed = 0;
+    size_t live_bytes = 0;
+    size_t peak_live_bytes = 0;
+};
+
+// Non-moving generational mark-sweep collector for strs and arrs.
+//
+// New objects are allocated into the nursery and promoted to the old generation
+// once they survive a minor collection. Minor collections only trace young
+// objects, using the remembered set to find old arrays that had values written
+// into them since the last collection. Major collections trace everything and
+// run whenever the old generation has doubled in size.
+//
+// Collections never start by themselves. Engines poll should_collect() at
+// points where every live value is reachable from their roots, then call
+// begin_collection(), mark_value() for each root and finish_collection().
+//
+// While a par loop has other threads running, objects are tracked under lock
+// and should_collect() always says no, as the other threads' roots can't be
+// seen. Anything they allocate is left in the nursery for after the loop.
+struct Heap {
+    Heap_Object *young = NULL;
+    Heap_Object *old = NULL;
+    size_t young_bytes = 0;
+    size_t old_bytes = 0;
+    size_t nursery_size = 1 << 20;
+    size_t next_major = 8 << 20;
+    bool is_major = false;
+    bool is_threaded = false;
+    std::mutex lock;
+
+    std::vector<Heap_Object *> gray;
+    std::vector<Array_Object *> remembered;
+    std::chrono::steady_clock::time_point collection_start;
+    Gc_Stats stats;
+
+    bool should_collect() {
+        return is_threaded == false && young_bytes >= nursery_size;
+    }
+
+    void track(Heap_Object *object, size_t size);
+    void charge_growth(Heap_Object *object, size_t old_size);
+    void begin_collection();
+    void mark_value(Value value);
+    void finish_collection();
+    void trace_gray();
+    void free_object(Heap_Object *object);
+};
+
+extern Heap heap;
+
+Str_Object *allocate_str(std::string value);
+Str_Object *concat_strs(Str_Object *left, Str_Object *right);
+Array_Object *allocate_array(std::vector<Value> items);
+Array_Object *allocate_num_array(std::vector<float> nums);
+Str_Object *allocate_literal_str(Arena *arena, std::string value);
+size_t object_size(Heap_Object *object);
+void write_barrier(Array_Object *array);
+void report_gc_stats();
+
+#endif
@@ -1,14 +1,38 @@
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <sstream>
 
+#if defined(__linux__) || defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+#include "checker.hpp"
+#include "gc.hpp"
 #include "interp.hpp"
+#include "jit.hpp"
 #include "lexer.hpp"
 #include "logger.hpp"
+#include "memo.hpp"
+#include "par.hpp"
 #include "parser.hpp"
 #include "scope.hpp"
 #include "shel_lib.hpp"
 
+// Times in a row a binary op has to see the same operand types to be quickened
+static const int QUICKEN_AFTER = 8;
+
+// Kept free below the stack limit for whatever runs after the check, which
+// includes reporting the overflow itself
+static const uintptr_t STACK_RESERVE = 256 * 1024;
+
+struct Quicken_Stats {
+    size_t quickened = 0;
+    size_t deoptimized = 0;
+};
+
+static Quicken_Stats quicken_stats;
+
 std::string get_unassigned_variable_error(std::string name) {
     std::stringstream ss;
     ss << "Use of unassigned variable '" << name << "'";
@@ -16,15 +40,15 @@ std::string get_unassigned_variable_error(std::string name) {
     return ss.str();
 }
 
-void fail_if_binary_op_invalid(Data_Atom *left, Data_Atom *right, Token *op) {
-    Data_Type left_t = left->data_type;
-    Data_Type right_t = right->data_type;
+void fail_if_binary_op_invalid(Value left, Value right, Token op) {
+    Data_Type left_t = left.data_type;
+    Data_Type right_t = right.data_type;
 
     if (left_t != right_t) {
-        report_fatal_error("Cannot perform binary operations on two mismatched expression types", op->site);
+        report_fatal_error("Cannot perform binary operations on two mismatched expression types", op.site);
     }
 
-    switch (op->type) {
+    switch (op.type) {
         case Token::Type::OP_PLUS:
         case Token::Type::OP_PLUS_EQUALS:
         case Token::Type::COMPARE_EQUALS:
@@ -34,7 +58,7 @@ void fail_if_binary_op_invalid(Data_Atom *left, Data_Atom *right, Token *op) {
         case Token::Type::LOGICAL_AND:
         case Token::Type::LOGICAL_OR:
             if (left_t != Data_Type::BOOL) {
-                report_fatal_error("Cannot perform logical operations on non bool expressions", op->site);
+                report_fatal_error("Cannot perform logical operations on non bool expressions", op.site);
             }
             return;
         case Token::Type::OP_MINUS:
@@ -53,40 +77,81 @@ void fail_if_binary_op_invalid(Data_Atom *left, Data_Atom *right, Token *op) {
         case Token::Type::COMPARE_LESS_THAN_EQUALS: {
             if (left_t == Data_Type::STR || left_t == Data_Type::BOOL) {
                 std::stringstream ss;
-                ss << "Cannot perform '" << op->value << "' on two string types";
-                report_fatal_error(ss.str(), op->site);
+                ss << "Cannot perform '" << op.value() << "' on two string types";
+                report_fatal_error(ss.str(), op.site);
             }
             return;
         }
         default:
-            report_fatal_error("Invalid binary operator", op->site);
+            report_fatal_error("Invalid binary operator", op.site);
             return;
     }
 }
 
-std::string get_string_from_return_value(Data_Atom *ret) {
-    if (ret->data_type == Data_Type::NUM) return std::to_string(((Num_Atom *)ret)->value);
-    if (ret->data_type == Data_Type::STR) return ((Str_Atom *)ret)->value;
-    if (ret->data_type == Data_Type::BOOL) return std::to_string(((Bool_Atom *)ret)->value);
+std::string get_missing_return_error(std::string name, Data_Type return_type) {
+    std::stringstream ss;
+    ss << "Bug '" << name << "' finished without returning a value of type '" << data_type_to_string(return_type) << "'";
+
+    return ss.str();
+}
+
+std::string get_return_type_error(Data_Type expected, Data_Type actual) {
+    std::stringstream ss;
+    ss << "Unexpected return type from function - wanted " << data_type_to_string(expected) << ", but got " << data_type_to_string(actual);
+
+    return ss.str();
+}
+
+// Only needed for args the checker couldn't type, natives trust what they're given
+void fail_if_native_args_invalid(Ast_Function_Call *call, Native_Args args) {
+    Native_Function *native = call->native;
+
+    if (native->arity == -1) {
+        if (args.size() > 1 && args[0].data_type != Data_Type::STR) {
+            report_fatal_error(get_arg_type_error(call->name, 0, Data_Type::STR, args[0].data_type), call->args[0]->site);
+        }
+
+        return;
+    }
+
+    for (size_t i = 0; i < args.size(); i++) {
+        Data_Type expected = native->arg_types[i];
+
+        if (expected != Data_Type::ANY && args[i].data_type != expected) {
+            report_fatal_error(get_arg_type_error(call->name, i, expected, args[i].data_type), call->args[i]->site);
+        }
+    }
+}
+
+std::string get_string_from_return_value(Value ret) {
+    if (ret.data_type == Data_Type::NUM) return std::to_string(ret.num);
+    if (ret.data_type == Data_Type::STR) return ret.str->text();
+    if (ret.data_type == Data_Type::BOOL) return std::to_string(ret.boolean);
 
     report_fatal_error("");
     return "";
 }
 
-Data_Atom *Interpreter::walk_block_node(Scope *scope, Ast_Block *root) {
+bool Interpreter::walk_block_node(Scope *scope, Ast_Block *root, Value *ret) {
     // @TODO(HIGH) Clean up return weirdness
     // Return doesn't really work as you would expect coming from most languages
     // at the minute in that it only returns from the immediate block. It should
     // really bubble up until it finds a a function definition or leaves global scope.
     for (Ast_Node *child : root->children) {
-        Data_Atom *ret = walk_from_root(scope, child);
-        if (ret != NULL) return ret;
+        // Statement boundaries are the only points where the walker collects,
+        // anything live in the middle of an expression is held in temporaries
+        if (heap.should_collect()) collect_garbage(scope);
+
+        bool has_returned = walk_from_root(scope, child, ret);
+
+        if (profile_ticks.load(std::memory_order_relaxed) != seen_profile_ticks) sample_profile(child->site);
+        if (has_returned) return true;
     }
 
-    return NULL;
+    return false;
 }
 
-Data_Atom *Interpreter::walk_expression(Scope *scope, Ast_Node *node) {
+Value Interpreter::walk_expression(Scope *scope, Ast_Node *node) {
     if (node->node_type == Ast_Node::Type::BINARY_OP) {
         return walk_binary_op_node(scope, (Ast_Binary_Op *)node);
     } else if (node->node_type == Ast_Node::Type::UNARY_OP) {
@@ -100,265 +165,488 @@ Data_Atom *Interpreter::walk_expression(Scope *scope, Ast_Node *node) {
     } else if (node->node_type == Ast_Node::Type::VARIABLE) {
         return get_variable(scope, (Ast_Variable *)node);
     } else {
-        return NULL;
+        return Value();
     }
 }
 
-Data_Atom *Interpreter::walk_binary_op_node(Scope *scope, Ast_Binary_Op *node) {
-    Data_Atom *left = walk_expression(scope, node->left);
-    Data_Atom *right = walk_expression(scope, node->right);
+Value Interpreter::walk_binary_op_node(Scope *scope, Ast_Binary_Op *node) {
+    Value left = walk_expression(scope, node->left);
+    temporaries.push_back(left);
+    Value right = walk_expression(scope, node->right);
+    temporaries.pop_back();
+
+    if (node->quick_op != QUICK_NONE) {
+        if (left.data_type == node->seen_type && right.data_type == node->seen_type) {
+            switch (node->quick_op) {
+                case QUICK_NUM_ADD:       return num_value(left.num + right.num);
+                case QUICK_NUM_SUBTRACT:  return num_value(left.num - right.num);
+                case QUICK_NUM_MULTIPLY:  return num_value(left.num * right.num);
+                case QUICK_NUM_DIVIDE:    return num_value(left.num / right.num);
+                case QUICK_NUM_MODULO:    return num_value(float(int(left.num) % int(right.num)));
+                case QUICK_NUM_EXPONENT:  return num_value(pow(left.num, right.num));
+                case QUICK_STR_CONCAT:    return str_value(concat_strs(left.str, right.str));
+
+                // Comparisons are worked out all over again, as they always
+                // have been, and quickened in evaluate_binary_op_to_bool
+                default:                  return bool_value(evaluate_binary_op_to_bool(scope, node));
+            }
+        }
+
+        deoptimize_binary_op(node);
+    }
 
-    fail_if_binary_op_invalid(left, right, node->op);
+    if (node->is_type_checked == false) fail_if_binary_op_invalid(left, right, node->op);
 
-    if (node->op->type == Token::Type::OP_PLUS || node->op->type == Token::Type::OP_PLUS_EQUALS) {
-        if (left->data_type == Data_Type::NUM) {
-            return new Num_Atom(((Num_Atom *)left)->value + ((Num_Atom *)right)->value);
-        } else if (left->data_type == Data_Type::STR) {
-            return new Str_Atom(((Str_Atom *)left)->value + ((Str_Atom *)right)->value);
+    bool is_comparison = node->op.flags & Token::Flags::COMPARISON || node->op.flags & Token::Flags::LOGICAL;
+    if (is_comparison == false) record_binary_op_types(node, left, right);
+
+    if (node->op.type == Token::Type::OP_PLUS || node->op.type == Token::Type::OP_PLUS_EQUALS) {
+        if (left.data_type == Data_Type::NUM) {
+            return num_value(left.num + right.num);
+        } else if (left.data_type == Data_Type::STR) {
+            return str_value(concat_strs(left.str, right.str));
         } else {
-            report_fatal_error("Attempted to '+' incompatible expressions", node->op->site);
-            return NULL;
+            report_fatal_error("Attempted to '+' incompatible expressions", node->op.site);
+            return Value();
         }
-    } else if (node->op->type == Token::Type::OP_MINUS || node->op->type == Token::Type::OP_MINUS_EQUALS) {
-        return new Num_Atom(((Num_Atom *)left)->value - ((Num_Atom *)right)->value);
-    } else if (node->op->type == Token::Type::OP_MULTIPLY || node->op->type == Token::Type::OP_MULTIPLY_EQUALS) {
-        return new Num_Atom(((Num_Atom *)left)->value * ((Num_Atom *)right)->value);
-    } else if (node->op->type == Token::Type::OP_DIVIDE || node->op->type == Token::Type::OP_DIVIDE_EQUALS) {
-        return new Num_Atom(((Num_Atom *)left)->value / ((Num_Atom *)right)->value);
-    } else if (node->op->type == Token::Type::OP_MODULO || node->op->type == Token::Type::OP_MODULO_EQUALS) {
-        Num_Atom *l = (Num_Atom *)left;
-        Num_Atom *r = (Num_Atom *)right;
-        return new Num_Atom(float(int(l->value) % int(r->value)));
-    } else if (node->op->type == Token::Type::OP_EXPONENT || node->op->type == Token::Type::OP_EXPONENT_EQUALS) {
-        return new Num_Atom(pow(((Num_Atom *)left)->value, ((Num_Atom *)right)->value));
+    } else if (node->op.type == Token::Type::OP_MINUS || node->op.type == Token::Type::OP_MINUS_EQUALS) {
+        return num_value(left.num - right.num);
+    } else if (node->op.type == Token::Type::OP_MULTIPLY || node->op.type == Token::Type::OP_MULTIPLY_EQUALS) {
+        return num_value(left.num * right.num);
+    } else if (node->op.type == Token::Type::OP_DIVIDE || node->op.type == Token::Type::OP_DIVIDE_EQUALS) {
+        return num_value(left.num / right.num);
+    } else if (node->op.type == Token::Type::OP_MODULO || node->op.type == Token::Type::OP_MODULO_EQUALS) {
+        return num_value(float(int(left.num) % int(right.num)));
+    } else if (node->op.type == Token::Type::OP_EXPONENT || node->op.type == Token::Type::OP_EXPONENT_EQUALS) {
+        return num_value(pow(left.num, right.num));
     } else {
-        if (node->op->flags & Token::Flags::COMPARISON || node->op->flags & Token::Flags::LOGICAL) {
-            return new Bool_Atom(evaluate_node_to_bool(scope, node));
+        if (node->op.flags & Token::Flags::COMPARISON || node->op.flags & Token::Flags::LOGICAL) {
+            return bool_value(evaluate_node_to_bool(scope, node));
         }
 
-        return NULL;
+        return Value();
     }
 }
 
-Array_Atom *Interpreter::walk_array_node(Scope *scope, Ast_Array *array) {
-    std::vector<Data_Atom *> items;
+Value Interpreter::walk_array_node(Scope *scope, Ast_Array *array) {
+    size_t temporaries_start = temporaries.size();
 
     for (Ast_Node *item : array->items) {
-        items.push_back(walk_expression(scope, item));
+        temporaries.push_back(walk_expression(scope, item));
     }
 
-    return new Array_Atom(items);
+    std::vector<Value> items(temporaries.begin() + temporaries_start, temporaries.end());
+    temporaries.resize(temporaries_start);
+
+    return array_value(allocate_array(items));
 }
 
-Data_Atom *Interpreter::walk_unary_op_node(Scope *scope, Ast_Unary_Op *node) {
-    Token::Type type = node->op->type;
-    Data_Atom *atom = walk_expression(scope, node->node);
+Value Interpreter::walk_unary_op_node(Scope *scope, Ast_Unary_Op *node) {
+    return apply_unary_op(node, walk_expression(scope, node->node));
+}
+
+Value apply_unary_op(Ast_Unary_Op *node, Value value) {
+    Token::Type type = node->op.type;
 
-    if (atom->data_type == Data_Type::BOOL) {
+    if (value.data_type == Data_Type::BOOL) {
         if (type == Token::Type::LOGICAL_NOT) {
-            return (Bool_Atom *)atom;
+            return bool_value(!value.boolean);
         } else {
             report_fatal_error("Attempted invalid unary operation on bool value", node->site);
-            return NULL;
+            return Value();
         }
     }
 
-    if (atom->data_type == Data_Type::NUM) {
-        Num_Atom *num = (Num_Atom *)atom;
+    if (value.data_type == Data_Type::NUM) {
         if (type == Token::Type::OP_PLUS) {
-            num->value = +num->value;
-            return num;
+            return value;
         } else if (type == Token::Type::OP_MINUS) {
-            num->value = -num->value;
-            return num;
+            return num_value(-value.num);
         } else {
-            report_fatal_error("Attempted invalid unary operation on num value", node->op->site);
-            return NULL;
+            report_fatal_error("Attempted invalid unary operation on num value", node->op.site);
+            return Value();
         }
     }
 
-    report_fatal_error("Attempted invalid unary operation on str value", node->op->site);
-    return NULL;
+    report_fatal_error("Attempted invalid unary operation on str value", node->op.site);
+    return Value();
 }
 
-Data_Atom *Interpreter::walk_function_call(Scope *scope, Ast_Function_Call *call) {
-    Func_With_Success *fs = get_func(scope, call->name);
+void Interpreter::bind_args(Scope *func_scope, Ast_Function_Call *call, size_t temporaries_start) {
+    auto *func_def = call->definition;
 
-    if (fs->was_success) {
-        auto *func_scope = new Scope(scope);
-        auto *func_def = fs->func_def;
+    // Args are always the first slots of the bug's scope
+    for (int i = 0; i < func_def->args.size(); i++) {
+        Value arg = temporaries[temporaries_start + i];
+        Data_Type expected = func_def->args[i]->data_type;
 
-        if (call->args.size() != func_def->args.size()) {
-            std::stringstream ss;
-            ss << "Attempted to call '" << func_def->name << "' with an incorrect number of args. Expected " << func_def->args.size()
-                << ", got " << call->args.size() << ".";
-            report_fatal_error(ss.str(), call->args_start_site);
+        // The checker couldn't see the type of every arg, e.g. one read out of an arr
+        if (call->is_type_checked == false && arg.data_type != expected) {
+            report_fatal_error(get_arg_type_error(call->name, i, expected, arg.data_type), call->args[i]->site);
         }
 
-        // Match calculated values to function names and insert them into the function scope
-        // before we walk the main function block
+        *get_slot(func_scope, 0, i) = arg;
+    }
+
+    temporaries.resize(temporaries_start);
+}
+
+uintptr_t get_stack_limit() {
+    thread_local uintptr_t limit = 0;
+
+    if (limit == 0) {
+        // Without a way to ask, assume there's at least half a megabyte left
+        char here;
+        uintptr_t bottom = (uintptr_t)&here - 512 * 1024;
+
+#if defined(__linux__)
+        pthread_attr_t attributes;
+
+        if (pthread_getattr_np(pthread_self(), &attributes) == 0) {
+            void *address;
+            size_t size;
+
+            if (pthread_attr_getstack(&attributes, &address, &size) == 0) bottom = (uintptr_t)address;
+            pthread_attr_destroy(&attributes);
+        }
+#elif defined(__APPLE__)
+        bottom = (uintptr_t)pthread_get_stackaddr_np(pthread_self()) - pthread_get_stacksize_np(pthread_self());
+#endif
+
+        limit = bottom + STACK_RESERVE;
+    }
+
+    return limit;
+}
+
+void fail_if_stack_overflow(Ast_Function_Call *call) {
+    char here;
+    if ((uintptr_t)&here < get_stack_limit()) report_fatal_error("Stack overflow", call->site);
+}
+
+Value Interpreter::walk_function_call(Scope *scope, Ast_Function_Call *call) {
+    auto *func_def = call->definition;
+    size_t temporaries_start = temporaries.size();
+
+    // The resolver bound every call to either a bug in the script or a native
+    if (func_def != NULL) {
+        // Every call to a bug nests the walker deeper on the thread's stack
+        fail_if_stack_overflow(call);
+
+        // Args are held in temporaries until they are all evaluated, as the
+        // function scope isn't reachable by the collector until its block runs
         for (int i = 0; i < func_def->args.size(); i++) {
-            Ast_Variable *current = func_def->args[i];
-            Data_Atom *expr = walk_expression(scope, call->args[i]);
+            temporaries.push_back(walk_expression(scope, call->args[i]));
+        }
 
-            assign_var(func_scope, current->name, expr);
+        // Compiled code takes its args as they are, so they need to be checked already
+        Jit_Function *jit = call->is_type_checked ? get_jit_function(func_def, is_worker) : NULL;
+
+        if (jit != NULL) {
+            Memo_Table *memo = is_worker ? NULL : func_def->memo;
+            Value *jit_args = &temporaries[temporaries_start];
+            Value result;
+
+            if (memo == NULL || memo->lookup(jit_args, &result) == false) {
+                result = call_jit_function(jit, jit_args, is_worker);
+                if (memo != NULL) memo->insert(jit_args, result);
+            }
+
+            temporaries.resize(temporaries_start);
+            return result;
         }
 
-        Data_Atom *block_return = walk_block_node(func_scope, func_def->block);
+        // Bugs see the scope they were defined in, not the one they're called from
+        Scope func_scope(get_scope(scope, call->depth), &stack, func_def->block->frame_size);
+        bind_args(&func_scope, call, temporaries_start);
 
-        // Programmer didn't write an explicit return statement, so we return void for them
-        if (block_return == NULL || block_return->data_type == Data_Type::VOID) return NULL;
+        Value block_return;
+        bool has_returned;
 
-        if (block_return->data_type != func_def->data_type) {
-            std::stringstream ss;
-            ss << "Unexpected return type from function - wanted " << data_type_to_string(func_def->data_type)
-                << ", but got " << data_type_to_string(block_return->data_type);
-            report_fatal_error(ss.str(), func_def->block->return_node->site);
+        // Args are contiguous at the start of the scope. They can be reassigned
+        // by the body, so the key is kept on memo_keys until the result is in.
+        // Tables aren't shared between threads, so workers go without
+        Memo_Table *memo = is_worker ? NULL : func_def->memo;
+        Value *memo_args = &stack[func_scope.base];
+
+        if (memo != NULL) {
+            if (memo->lookup(memo_args, &block_return)) return block_return;
+            memo_keys.insert(memo_keys.end(), memo_args, memo_args + memo->arity);
+        }
+
+        bool is_profiled = is_profiling && is_worker == false;
+
+        if (is_profiled) {
+            profile_frames.back().site = call->site;
+            profile_frames.push_back(Profile_Frame(func_def, func_def->site));
+        }
+
+        // A self tail call unwinds back to here with its args in temporaries,
+        // and the body is rerun in the same scope instead of nesting a new one
+        while ((has_returned = walk_block_node(&func_scope, func_def->block, &block_return)) && tail_call != NULL) {
+            Ast_Function_Call *next = tail_call;
+            tail_call = NULL;
+
+            func_scope.clear(0);
+            bind_args(&func_scope, next, temporaries_start);
+        }
+
+        if (is_profiled) profile_frames.pop_back();
+
+        if (has_returned == false) {
+            // Programmer didn't write an explicit return statement, which is only fine for void bugs
+            if (func_def->data_type != Data_Type::VOID) report_fatal_error(get_missing_return_error(func_def->name, func_def->data_type), func_def->site);
+            return Value();
+        }
+
+        if (func_def->is_type_checked == false && block_return.data_type != func_def->data_type) {
+            report_fatal_error(get_return_type_error(func_def->data_type, block_return.data_type), func_def->block->return_node->site);
+        }
+
+        if (memo != NULL) {
+            memo->insert(memo_keys.data() + memo_keys.size() - memo->arity, block_return);
+            memo_keys.resize(memo_keys.size() - memo->arity);
         }
 
         return block_return;
     } else {
-        std::vector<Data_Atom *> args;
-
         for (Ast_Node *arg : call->args) {
-            args.push_back(walk_expression(scope, arg));
+            temporaries.push_back(walk_expression(scope, arg));
         }
 
-        Native_Return_Data *ret = call_native_function(call->name, args, call->site);
+        // Args are passed straight out of temporaries, which the native can't
+        // grow, and stay rooted until it returns
+        Native_Args args(temporaries.data() + temporaries_start, call->args.size());
 
-        if (ret->was_success) return ((Data_Atom *)ret->return_value);
+        if (call->is_type_checked == false) fail_if_native_args_invalid(call, args);
 
-        std::stringstream ss;
-        ss << "Attempted to call bug '" << call->name << "', which is either not in scope or does not exist";
-        report_fatal_error(ss.str(), call->site);
+        Value ret = call->format_pieces.empty() ? call->native->handler(args, call->site) : print_compiled(call->format_pieces, args);
+        temporaries.resize(temporaries_start);
 
-        return NULL;
+        return ret;
     }
 }
 
-Data_Atom *Interpreter::walk_if(Scope *scope, Ast_If *if_node) {
+bool Interpreter::walk_if(Scope *scope, Ast_If *if_node, Value *ret) {
     while (if_node != NULL) {
         // Comparison is NULL in else node, so if we get there assume true
         if (if_node->comparison == NULL || evaluate_node_to_bool(scope, if_node->comparison)) {
-            return walk_block_node(new Scope(scope), if_node->success);
+            Scope success_scope(scope, &stack, if_node->success->frame_size);
+            return walk_block_node(&success_scope, if_node->success, ret);
         }
 
         if_node = if_node->failure;
     }
 
-    return NULL;
+    return false;
 }
 
-Data_Atom *Interpreter::walk_while(Scope *scope, Ast_While *while_node) {
-    Data_Atom *ret = NULL;
+bool Interpreter::walk_while(Scope *scope, Ast_While *while_node, Value *ret) {
+    Scope body_scope(scope, &stack, while_node->body->frame_size);
 
     while (evaluate_node_to_bool(scope, while_node->comparison)) {
-        ret = walk_block_node(new Scope(scope), while_node->body);
-
-        if (ret != NULL) break;
+        body_scope.clear(0);
+        if (walk_block_node(&body_scope, while_node->body, ret)) return true;
     }
 
-    return ret;
+    return false;
 }
 
-Data_Atom *Interpreter::walk_loop(Scope *scope, Ast_Loop *loop_node) {
-    Num_Atom *from = (Num_Atom *)walk_expression(scope, loop_node->start);
-    Num_Atom *to = (Num_Atom *)walk_expression(scope, loop_node->to);
-    Num_Atom *step = (Num_Atom *)walk_expression(scope, loop_node->step);
+bool Interpreter::walk_loop(Scope *scope, Ast_Loop *loop_node, Value *ret) {
+    Value from = walk_expression(scope, loop_node->start);
+    Value to = walk_expression(scope, loop_node->to);
+    Value step = walk_expression(scope, loop_node->step);
+
+    bool is_control_invalid = from.data_type != Data_Type::NUM || to.data_type != Data_Type::NUM || step.data_type != Data_Type::NUM;
 
-    if (from->data_type != Data_Type::NUM || to->data_type != Data_Type::NUM || step->data_type != Data_Type::NUM) {
+    if (loop_node->is_type_checked == false && is_control_invalid) {
         report_fatal_error("Attempted to use non-num expression as control in a from loop", loop_node->site);
     }
 
-    if (step->value < 0 && from->value < to->value) {
+    if (step.num < 0 && from.num < to.num) {
         report_fatal_error("from < to but step value is negative", loop_node->site);
     }
 
-    if (step->value > 0 && from->value > to->value) {
+    if (step.num > 0 && from.num > to.num) {
         report_fatal_error("to > from but step value is positive", loop_node->site);
     }
 
-    if (step->value == 0) {
+    if (step.num == 0) {
         report_fatal_error("step value cannot be 0", loop_node->site);
     }
 
-    Data_Atom *ret = NULL;
-    bool is_going_up = to->value > from->value;
+    if (loop_node->is_parallel) {
+        walk_par_loop(scope, loop_node, from.num, to.num, step.num);
+        return false;
+    }
+
+    bool is_going_up = to.num > from.num;
+
+    Scope body_scope(scope, &stack, loop_node->body->frame_size);
 
-    for (float i = from->value; is_going_up ? i < to->value : i > to->value; i += step->value) {
-        auto *body_scope = new Scope(scope);
-        assign_var(body_scope, "it", new Num_Atom(float(i)));
+    for (float i = from.num; is_going_up ? i < to.num : i > to.num; i += step.num) {
+        body_scope.clear(1);
 
-        ret = walk_block_node(body_scope, loop_node->body);
+        // 'it' is always the first slot of the loop body
+        *get_slot(&body_scope, 0, 0) = num_value(i);
 
-        if (ret != NULL) break;
+        if (walk_block_node(&body_scope, loop_node->body, ret)) return true;
     }
 
-    return ret;
+    return false;
 }
 
-Data_Atom *Interpreter::walk_from_root(Scope *scope, Ast_Node *root) {
+void Interpreter::walk_par_loop(Scope *scope, Ast_Loop *loop_node, float from, float to, float step) {
+    Ast_Variable *reduction = loop_node->reduction;
+    Value total;
+
+    if (reduction != NULL) {
+        total = get_variable(scope, reduction);
+        fail_if_reduction_invalid(loop_node, total);
+    }
+
+    size_t count = count_par_iterations(from, to, step, loop_node->site);
+    size_t chunk_size = get_par_chunk_size(count);
+    size_t chunk_count = (count + chunk_size - 1) / chunk_size;
+    std::vector<Value> partials(chunk_count);
+    unsigned int epoch = next_par_epoch();
+    Thread_Pool *pool = get_thread_pool();
+
+    // Workers run nested par loops themselves, the pool is already busy
+    if (is_worker || pool->worker_count == 1 || chunk_count < 2) {
+        unsigned int outer_epoch = par_epoch;
+        par_epoch = epoch;
+
+        for (size_t chunk = 0; chunk < chunk_count; chunk++) {
+            walk_par_chunk(scope, loop_node, from, step, chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size), &partials[chunk]);
+        }
+
+        par_epoch = outer_epoch;
+    } else {
+        while (workers.size() < (size_t)pool->worker_count) {
+            auto *worker = new Interpreter(unit);
+            worker->is_worker = true;
+            workers.push_back(worker);
+        }
+
+        // Even the chunks run on this thread go through a worker, as other
+        // threads are reading this interpreter's stack
+        heap.is_threaded = true;
+
+        pool->run(chunk_count, [&](int worker, size_t chunk) {
+            par_epoch = epoch;
+            workers[worker]->walk_par_chunk(scope, loop_node, from, step, chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size), &partials[chunk]);
+            par_epoch = 0;
+        });
+
+        heap.is_threaded = false;
+    }
+
+    if (reduction == NULL) return;
+
+    for (Value partial : partials) total = reduce_values(loop_node->reduce_op.type, total, partial);
+
+    if (par_stack != NULL) fail_if_outside_par_loop(scope, reduction);
+    *get_slot(scope, reduction->depth, reduction->slot) = total;
+}
+
+// Runs iterations first to last on this interpreter, leaving the value the
+// body's copy of the reduce variable ended up with in partial
+void Interpreter::walk_par_chunk(Scope *scope, Ast_Loop *loop_node, float from, float step, size_t first, size_t last, Value *partial) {
+    Scope body_scope(scope, &stack, loop_node->body->frame_size);
+    std::vector<Value> *outer_par_stack = par_stack;
+    size_t outer_par_floor = par_floor;
+    int first_cleared = loop_node->reduction != NULL ? 2 : 1;
+    Value ret;
+
+    par_stack = &stack;
+    par_floor = body_scope.base;
+
+    if (loop_node->reduction != NULL) *get_slot(&body_scope, 0, 1) = get_reduce_identity(loop_node->reduce_op.type);
+
+    for (size_t i = first; i < last; i++) {
+        body_scope.clear(first_cleared);
+        *get_slot(&body_scope, 0, 0) = num_value(get_par_iteration(from, step, i));
+
+        // The resolver rejects returns from the body itself
+        walk_block_node(&body_scope, loop_node->body, &ret);
+    }
+
+    if (loop_node->reduction != NULL) *partial = *get_slot(&body_scope, 0, 1);
+
+    par_stack = outer_par_stack;
+    par_floor = outer_par_floor;
+}
+
+bool Interpreter::walk_from_root(Scope *scope, Ast_Node *root, Value *ret) {
     if (root->node_type == Ast_Node::Type::BLOCK) {
-        return walk_block_node(scope, (Ast_Block *)root);
-    } else if (root->node_type == Ast_Node::Type::FUNCTION_DEFINITION) {
-        add_function_def_to_scope(scope, (Ast_Function_Definition *)root);
-        return NULL;
+        return walk_block_node(scope, (Ast_Block *)root, ret);
     } else if (root->node_type == Ast_Node::Type::RETURN) {
-        Data_Atom *val = walk_expression(scope, ((Ast_Return *)root)->value);
-        if (val == NULL) return new Data_Atom(); // void return
-        else return val;
+        auto *ret_node = (Ast_Return *)root;
+
+        if (ret_node->is_tail_call) {
+            auto *call = (Ast_Function_Call *)ret_node->value;
+
+            // Statements start with temporaries at the level the enclosing
+            // call left them, which is exactly where it expects the args
+            for (Ast_Node *arg : call->args) {
+                temporaries.push_back(walk_expression(scope, arg));
+            }
+
+            tail_call = call;
+            return true;
+        }
+
+        // Empty return expressions evaluate to void
+        *ret = walk_expression(scope, ret_node->value);
+        return true;
     } else if (root->node_type == Ast_Node::Type::IF) {
-        return walk_if(scope, (Ast_If *)root);
+        return walk_if(scope, (Ast_If *)root, ret);
     } else if (root->node_type == Ast_Node::Type::WHILE) {
-        return walk_while(scope, (Ast_While *)root);
+        return walk_while(scope, (Ast_While *)root, ret);
     } else if (root->node_type == Ast_Node::Type::LOOP) {
-        return walk_loop(scope, (Ast_Loop *)root);
+        return walk_loop(scope, (Ast_Loop *)root, ret);
     } else if (root->node_type == Ast_Node::Type::FUNCTION_CALL) {
-        return walk_function_call(scope, (Ast_Function_Call *)root);
+        // Value of a bug called as a statement is discarded
+        walk_function_call(scope, (Ast_Function_Call *)root);
+        return false;
     } else if (root->node_type == Ast_Node::Type::ASSIGNMENT) {
         walk_assignment_node(scope, (Ast_Assignment *)root);
-        return NULL;
+        return false;
     } else {
-        return NULL;
+        return false;
     }
 }
 
-Data_Atom *Interpreter::get_variable(Scope *scope, Ast_Variable *node) {
-    std::string name = node->name;
-    Var_With_Success *var = get_var(scope, name);
+Value Interpreter::get_variable(Scope *scope, Ast_Variable *node) {
+    Value value = *get_slot(scope, node->depth, node->slot);
 
-    if (var->was_success) {
-        return var->data;
-    } else {
-        report_fatal_error(get_unassigned_variable_error(name), node->token->site);
-        return NULL;
-    }
+    // Bound by the resolver but not assigned yet, e.g. an outer variable
+    // declared after the bug reading it was called
+    if (value.data_type == Data_Type::VOID) report_fatal_error(get_unassigned_variable_error(node->name), node->token.site);
+
+    return value;
 }
 
-Data_Atom *Interpreter::get_data_from_literal(Scope *scope, Ast_Literal *lit) {
-    switch (lit->data_type) {
-        case Data_Type::NUM: return new Num_Atom(std::stof(lit->value));
-        case Data_Type::STR: return new Str_Atom(lit->value);
-        case Data_Type::BOOL: return new Bool_Atom(lit->value == "true" ? true : false);
-        default: return NULL;
-    }
+Value Interpreter::get_data_from_literal(Scope *scope, Ast_Literal *lit) {
+    return lit->value;
 }
 
 bool Interpreter::evaluate_node_to_bool(Scope *scope, Ast_Node *node) {
     if (node->node_type == Ast_Node::Type::BINARY_OP) {
         return evaluate_binary_op_to_bool(scope, (Ast_Binary_Op *)node);
+    } else if (node->node_type == Ast_Node::Type::UNARY_OP) {
+        Value value = walk_unary_op_node(scope, (Ast_Unary_Op *)node);
+        if (value.data_type == Data_Type::BOOL) return value.boolean;
     } else if (node->node_type == Ast_Node::Type::LITERAL) {
         Ast_Literal *lit = (Ast_Literal *)node;
-        if (lit->data_type == Data_Type::BOOL) return lit->value == "true";
+        if (lit->data_type == Data_Type::BOOL) return lit->value.boolean;
     } else if (node->node_type == Ast_Node::Type::VARIABLE) {
-        Data_Atom *atom = get_variable(scope, (Ast_Variable *)node);
-        if (atom->data_type == Data_Type::BOOL) return ((Bool_Atom *)atom)->value;
-    } else if (node->node_type == Ast_Node::Type::BLOCK) {
-        Data_Atom *atom = walk_block_node(scope, (Ast_Block *)node);
-        if (atom->data_type == Data_Type::BOOL) return ((Bool_Atom *)atom)->value;
+        Value value = get_variable(scope, (Ast_Variable *)node);
+        if (value.data_type == Data_Type::BOOL) return value.boolean;
     } else if (node->node_type == Ast_Node::Type::FUNCTION_CALL) {
-        Data_Atom *atom = walk_function_call(scope, (Ast_Function_Call *)node);
-        if (atom->data_type == Data_Type::BOOL) return ((Bool_Atom *)atom)->value;
+        Value value = walk_function_call(scope, (Ast_Function_Call *)node);
+        if (value.data_type == Data_Type::BOOL) return value.boolean;
     }
 
     report_fatal_error("Invalid comparison", node->site);
@@ -366,44 +654,164 @@ bool Interpreter::evaluate_node_to_bool(Scope *scope, Ast_Node *node) {
 }
 
 bool Interpreter::evaluate_binary_op_to_bool(Scope *scope, Ast_Binary_Op *comparison) {
-    Data_Atom *left = walk_expression(scope, comparison->left);
-    Data_Atom *right = walk_expression(scope, comparison->right);
+    Value left = walk_expression(scope, comparison->left);
+    temporaries.push_back(left);
+    Value right = walk_expression(scope, comparison->right);
+    temporaries.pop_back();
+
+    if (comparison->quick_op != QUICK_NONE) {
+        if (left.data_type == comparison->seen_type && right.data_type == comparison->seen_type) {
+            switch (comparison->quick_op) {
+                case QUICK_NUM_EQUALS:              return left.num == right.num;
+                case QUICK_NUM_NOT_EQUALS:          return left.num != right.num;
+                case QUICK_NUM_GREATER_THAN:        return left.num > right.num;
+                case QUICK_NUM_GREATER_THAN_EQUALS: return left.num >= right.num;
+                case QUICK_NUM_LESS_THAN:           return left.num < right.num;
+                case QUICK_NUM_LESS_THAN_EQUALS:    return left.num <= right.num;
+                case QUICK_STR_EQUALS:              return strs_equal(left.str, right.str);
+                case QUICK_STR_NOT_EQUALS:          return strs_equal(left.str, right.str) == false;
+                case QUICK_BOOL_EQUALS:             return left.boolean == right.boolean;
+                case QUICK_BOOL_NOT_EQUALS:         return left.boolean != right.boolean;
+                case QUICK_BOOL_AND:                return left.boolean && right.boolean;
+                case QUICK_BOOL_OR:                 return left.boolean || right.boolean;
+
+                // Arithmetic used as a condition goes the generic way
+                default:                            return compare_values(comparison, left, right);
+            }
+        }
+
+        deoptimize_binary_op(comparison);
+    }
+
+    bool result = compare_values(comparison, left, right);
+    record_binary_op_types(comparison, left, right);
+
+    return result;
+}
+
+static Quick_Op get_quick_op(Token::Type op, Data_Type type) {
+    if (type == Data_Type::NUM) {
+        switch (op) {
+            case Token::Type::OP_PLUS:
+            case Token::Type::OP_PLUS_EQUALS:               return QUICK_NUM_ADD;
+            case Token::Type::OP_MINUS:
+            case Token::Type::OP_MINUS_EQUALS:              return QUICK_NUM_SUBTRACT;
+            case Token::Type::OP_MULTIPLY:
+            case Token::Type::OP_MULTIPLY_EQUALS:           return QUICK_NUM_MULTIPLY;
+            case Token::Type::OP_DIVIDE:
+            case Token::Type::OP_DIVIDE_EQUALS:             return QUICK_NUM_DIVIDE;
+            case Token::Type::OP_MODULO:
+            case Token::Type::OP_MODULO_EQUALS:             return QUICK_NUM_MODULO;
+            case Token::Type::OP_EXPONENT:
+            case Token::Type::OP_EXPONENT_EQUALS:           return QUICK_NUM_EXPONENT;
+            case Token::Type::COMPARE_EQUALS:               return QUICK_NUM_EQUALS;
+            case Token::Type::COMPARE_NOT_EQUALS:           return QUICK_NUM_NOT_EQUALS;
+            case Token::Type::COMPARE_GREATER_THAN:         return QUICK_NUM_GREATER_THAN;
+            case Token::Type::COMPARE_GREATER_THAN_EQUALS:  return QUICK_NUM_GREATER_THAN_EQUALS;
+            case Token::Type::COMPARE_LESS_THAN:            return QUICK_NUM_LESS_THAN;
+            case Token::Type::COMPARE_LESS_THAN_EQUALS:     return QUICK_NUM_LESS_THAN_EQUALS;
+            default:                                        return QUICK_NONE;
+        }
+    }
+
+    if (type == Data_Type::STR) {
+        switch (op) {
+            case Token::Type::OP_PLUS:
+            case Token::Type::OP_PLUS_EQUALS:               return QUICK_STR_CONCAT;
+            case Token::Type::COMPARE_EQUALS:               return QUICK_STR_EQUALS;
+            case Token::Type::COMPARE_NOT_EQUALS:           return QUICK_STR_NOT_EQUALS;
+            default:                                        return QUICK_NONE;
+        }
+    }
+
+    if (type == Data_Type::BOOL) {
+        switch (op) {
+            case Token::Type::COMPARE_EQUALS:               return QUICK_BOOL_EQUALS;
+            case Token::Type::COMPARE_NOT_EQUALS:           return QUICK_BOOL_NOT_EQUALS;
+            case Token::Type::LOGICAL_AND:                  return QUICK_BOOL_AND;
+            case Token::Type::LOGICAL_OR:                   return QUICK_BOOL_OR;
+            default:                                        return QUICK_NONE;
+        }
+    }
+
+    return QUICK_NONE;
+}
+
+// Called once a binary op has gone the generic way and passed its type
+// checks. Nodes are shared with the workers of par loops, which leave the
+// feedback alone and just run whatever form the node is already in.
+void Interpreter::record_binary_op_types(Ast_Binary_Op *node, Value left, Value right) {
+    if (is_worker || node->is_generic) return;
+
+    Data_Type type = left.data_type;
+
+    if (right.data_type != type || type != node->seen_type) {
+        node->seen_type = type;
+        node->seen_count = 0;
+    }
+
+    if (++node->seen_count < QUICKEN_AFTER) return;
+
+    node->quick_op = get_quick_op(node->op.type, type);
+
+    if (node->quick_op == QUICK_NONE) {
+        node->is_generic = true;
+    } else {
+        quicken_stats.quickened++;
+    }
+}
+
+// Operands of another type than the node was quickened for. It goes back to
+// the generic form for good, rather than flip-flopping between the two.
+void Interpreter::deoptimize_binary_op(Ast_Binary_Op *node) {
+    if (is_worker) return;
+
+    node->quick_op = QUICK_NONE;
+    node->is_generic = true;
+    quicken_stats.deoptimized++;
+}
+
+void report_quicken_stats() {
+    std::cerr << "[QUICKEN] binary ops quickened: " << quicken_stats.quickened << std::endl;
+    std::cerr << "[QUICKEN] binary ops deoptimized: " << quicken_stats.deoptimized << std::endl;
+}
 
-    if (left->data_type != right->data_type) {
+bool compare_values(Ast_Binary_Op *comparison, Value left, Value right) {
+    if (comparison->is_type_checked == false && left.data_type != right.data_type) {
         report_fatal_error("Attempted to compare expressions of different data types", comparison->site);
     }
 
-    Data_Type type = left->data_type;
+    Data_Type type = left.data_type;
 
-    switch (comparison->op->type) {
+    switch (comparison->op.type) {
         default:
         case Token::Type::COMPARE_EQUALS:
-            if (type == Data_Type::NUM)  return ((Num_Atom *)left)->value == ((Num_Atom *)right)->value;
-            if (type == Data_Type::STR)  return ((Str_Atom *)left)->value == ((Str_Atom *)right)->value;
-            if (type == Data_Type::BOOL) return ((Bool_Atom *)left)->value == ((Bool_Atom *)right)->value;
+            if (type == Data_Type::NUM)  return left.num == right.num;
+            if (type == Data_Type::STR)  return strs_equal(left.str, right.str);
+            if (type == Data_Type::BOOL) return left.boolean == right.boolean;
             break;
         case Token::Type::COMPARE_NOT_EQUALS:
-            if (type == Data_Type::NUM)  return ((Num_Atom *)left)->value != ((Num_Atom *)right)->value;
-            if (type == Data_Type::STR)  return ((Str_Atom *)left)->value != ((Str_Atom *)right)->value;
-            if (type == Data_Type::BOOL) return ((Bool_Atom *)left)->value != ((Bool_Atom *)right)->value;
+            if (type == Data_Type::NUM)  return left.num != right.num;
+            if (type == Data_Type::STR)  return strs_equal(left.str, right.str) == false;
+            if (type == Data_Type::BOOL) return left.boolean != right.boolean;
             break;
         case Token::Type::COMPARE_GREATER_THAN:
-            if (type == Data_Type::NUM) return ((Num_Atom *)left)->value > ((Num_Atom *)right)->value;
+            if (type == Data_Type::NUM) return left.num > right.num;
             break;
         case Token::Type::COMPARE_GREATER_THAN_EQUALS:
-            if (type == Data_Type::NUM) return ((Num_Atom *)left)->value >= ((Num_Atom *)right)->value;
+            if (type == Data_Type::NUM) return left.num >= right.num;
             break;
         case Token::Type::COMPARE_LESS_THAN:
-            if (type == Data_Type::NUM) return ((Num_Atom *)left)->value < ((Num_Atom *)right)->value;
+            if (type == Data_Type::NUM) return left.num < right.num;
             break;
         case Token::Type::COMPARE_LESS_THAN_EQUALS:
-            if (type == Data_Type::NUM) return ((Num_Atom *)left)->value <= ((Num_Atom *)right)->value;
+            if (type == Data_Type::NUM) return left.num <= right.num;
             break;
         case Token::Type::LOGICAL_OR:
-            if (type == Data_Type::BOOL) return ((Bool_Atom *)left)->value || ((Bool_Atom *)right)->value;
+            if (type == Data_Type::BOOL) return left.boolean || right.boolean;
             break;
         case Token::Type::LOGICAL_AND:
-            if (type == Data_Type::BOOL) return ((Bool_Atom *)left)->value && ((Bool_Atom *)right)->value;
+            if (type == Data_Type::BOOL) return left.boolean && right.boolean;
             break;
     }
 
@@ -412,33 +820,80 @@ bool Interpreter::evaluate_binary_op_to_bool(Scope *scope, Ast_Binary_Op *compar
 }
 
 void Interpreter::walk_assignment_node(Scope *scope, Ast_Assignment *node) {
-    std::string name = node->left->name;
-    Data_Atom *expr = walk_expression(scope, node->right);
+    Ast_Variable *var = node->left;
+    Value expr = walk_expression(scope, node->right);
+    Value *slot = get_slot(scope, var->depth, var->slot);
 
     if (node->is_first_assign) {
-        auto left_data_type = node->left->data_type;
-        auto right_data_type = expr->data_type;
-
-        if (left_data_type != right_data_type) {
+        if (node->is_type_checked == false && node->left->data_type != expr.data_type) {
             std::stringstream ss;
-            ss << "Tried to assign expression of type '" <<  data_type_to_string(expr->data_type)
+            ss << "Tried to assign expression of type '" <<  data_type_to_string(expr.data_type)
                 << "' to variable of type '" << data_type_to_string(node->left->data_type) << "'";
             report_fatal_error(ss.str(), node->right->site);
         }
 
-        assign_var(scope, name, expr);
+        *slot = expr;
     } else {
-        reassign_var(scope, name, expr, node->right->site);
+        if (slot->data_type == Data_Type::VOID) {
+            std::stringstream ss;
+            ss << "Attempted to reassign variable with the name '" << var->name << "', but none by that name exists.";
+            report_fatal_error(ss.str(), var->site);
+        }
+
+        if (node->is_type_checked == false && slot->data_type != expr.data_type) {
+            std::stringstream ss;
+            ss << "Tried to reassign variable of type '" <<  data_type_to_string(slot->data_type)
+                << "' to expression of type '" << data_type_to_string(expr.data_type) << "'";
+            report_fatal_error(ss.str(), node->right->site);
+        }
+
+        if (par_stack != NULL) fail_if_outside_par_loop(scope, var);
+
+        *slot = expr;
     }
 }
 
-void Interpreter::add_function_def_to_scope(Scope *scope, Ast_Function_Definition *def) {
-    set_func(scope, def->name, def);
+// The resolver catches this inside par loop bodies, but not in bugs that are
+// defined outside one and called from it
+void Interpreter::fail_if_outside_par_loop(Scope *scope, Ast_Variable *var) {
+    Scope *owner = get_scope(scope, var->depth);
+
+    if (owner->stack == par_stack && owner->base >= par_floor) return;
+
+    std::stringstream ss;
+    ss << "Attempted to reassign '" << var->name << "' from inside a par loop, which can only change variables declared in its body";
+    report_fatal_error(ss.str(), var->site);
+}
+
+void Interpreter::collect_garbage(Scope *scope) {
+    heap.begin_collection();
+
+    // Every live scope has its slots somewhere on the stack
+    for (Value value : stack) heap.mark_value(value);
+
+    for (Value value : temporaries) heap.mark_value(value);
+
+    heap.finish_collection();
+}
+
+// Charges the ticks since the last sample to the statement at site, which
+// the innermost bug being run just finished
+void Interpreter::sample_profile(Code_Site site) {
+    unsigned int ticks = profile_ticks.load(std::memory_order_relaxed);
+    unsigned int weight = ticks - seen_profile_ticks;
+    seen_profile_ticks = ticks;
+
+    if (profile_frames.empty()) return;
+
+    profile_frames.back().site = site;
+    record_profile_sample(profile_frames, weight);
 }
 
 void Interpreter::interpret() {
-    auto *global_scope = new Scope(NULL);
+    Scope global_scope(NULL, &stack, unit->root->frame_size);
+
+    if (is_profiling) profile_frames.push_back(Profile_Frame(NULL, unit->root->site));
 
-    Ast_Block *root = parser->parse();
-    walk_from_root(global_scope, root);
+    Value ret;
+    walk_from_root(&global_scope, unit->root, &ret);
 }
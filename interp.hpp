@@ -1,37 +1,103 @@
 #ifndef INTERP_H
 #define INTERP_H
 
-#include <map>
 #include "parser.hpp"
+#include "profile.hpp"
+#include "unit.hpp"
 #include "scope.hpp"
+#include "shel_lib.hpp"
 #include "typer.hpp"
 
 struct Interpreter {
-    Parser *parser;
+    Compilation_Unit *unit;
 
-    Interpreter(Parser *parser) {
-        this->parser = parser;
+    // Values that are live in the middle of evaluating an expression,
+    // treated as roots by the garbage collector
+    std::vector<Value> temporaries;
+
+    // Slots of every live scope, see Scope
+    std::vector<Value> stack;
+
+    // Set by a return statement marked is_tail_call, whose args are left on
+    // top of temporaries for walk_function_call to rebind
+    Ast_Function_Call *tail_call;
+
+    // Args of the memoized calls in progress, see Memo_Table
+    std::vector<Value> memo_keys;
+
+    // Workers run the chunks of par loops on the pool's threads, each with a
+    // stack of its own, see par.hpp. They're made by the main interpreter
+    // the first time it needs them, one per pool thread.
+    bool is_worker;
+    std::vector<Interpreter *> workers;
+
+    // Body of the innermost par loop this interpreter is running. Nothing in
+    // a scope below it, or on another interpreter's stack, may be reassigned
+    // until the loop is done. NULL outside of par loops.
+    std::vector<Value> *par_stack;
+    size_t par_floor;
+
+    // Bugs being run, outermost first, only kept by the main interpreter
+    // when profiling, see profile.hpp
+    std::vector<Profile_Frame> profile_frames;
+    unsigned int seen_profile_ticks;
+
+    Interpreter(Compilation_Unit *unit) {
+        this->unit = unit;
+        this->tail_call = NULL;
+        this->is_worker = false;
+        this->par_stack = NULL;
+        this->par_floor = 0;
+        this->seen_profile_ticks = 0;
+        this->stack.reserve(1024);
     }
 
-    Array_Atom *walk_array_node(Scope *scope, Ast_Array *array);
-    Data_Atom *walk_block_node(Scope *scope, Ast_Block *root);
-    Data_Atom *walk_expression(Scope *scope, Ast_Node *node);
-    Data_Atom *walk_binary_op_node(Scope *scope, Ast_Binary_Op *node);
-    Data_Atom *walk_unary_op_node(Scope *scope, Ast_Unary_Op *node);
-    Data_Atom *walk_function_call(Scope *scope, Ast_Function_Call *call);
-    Data_Atom *walk_if(Scope *scope, Ast_If *if_node);
-    Data_Atom *walk_while(Scope *scope, Ast_While *while_node);
-    Data_Atom *walk_loop(Scope *scope, Ast_Loop *loop_node);
-    Data_Atom *walk_from_root(Scope *scope, Ast_Node *root);
-    Data_Atom *get_variable(Scope *scope, Ast_Variable *node);
-    Data_Atom *get_data_from_literal(Scope *scope, Ast_Literal *lit);
+    Value walk_array_node(Scope *scope, Ast_Array *array);
+    Value walk_expression(Scope *scope, Ast_Node *node);
+    Value walk_binary_op_node(Scope *scope, Ast_Binary_Op *node);
+    Value walk_unary_op_node(Scope *scope, Ast_Unary_Op *node);
+    Value walk_function_call(Scope *scope, Ast_Function_Call *call);
+    void bind_args(Scope *func_scope, Ast_Function_Call *call, size_t temporaries_start);
+    Value get_variable(Scope *scope, Ast_Variable *node);
+    Value get_data_from_literal(Scope *scope, Ast_Literal *lit);
+
+    // Statement walkers return true when a return statement was hit,
+    // with the returned value written to ret
+    bool walk_block_node(Scope *scope, Ast_Block *root, Value *ret);
+    bool walk_if(Scope *scope, Ast_If *if_node, Value *ret);
+    bool walk_while(Scope *scope, Ast_While *while_node, Value *ret);
+    bool walk_loop(Scope *scope, Ast_Loop *loop_node, Value *ret);
+    void walk_par_loop(Scope *scope, Ast_Loop *loop_node, float from, float to, float step);
+    void walk_par_chunk(Scope *scope, Ast_Loop *loop_node, float from, float step, size_t first, size_t last, Value *partial);
+    bool walk_from_root(Scope *scope, Ast_Node *root, Value *ret);
 
     bool evaluate_node_to_bool(Scope *scope, Ast_Node *node);
     bool evaluate_binary_op_to_bool(Scope *scope, Ast_Binary_Op *node);
+    void record_binary_op_types(Ast_Binary_Op *node, Value left, Value right);
+    void deoptimize_binary_op(Ast_Binary_Op *node);
 
     void walk_assignment_node(Scope *scope, Ast_Assignment *node);
-    void add_function_def_to_scope(Scope *scope, Ast_Function_Definition *def);
+    void fail_if_outside_par_loop(Scope *scope, Ast_Variable *var);
+    void collect_garbage(Scope *scope);
+    void sample_profile(Code_Site site);
     void interpret();
 };
 
+void fail_if_binary_op_invalid(Value left, Value right, Token op);
+Value apply_unary_op(Ast_Unary_Op *node, Value value);
+
+// Comparisons and logical ops on values that are already worked out
+bool compare_values(Ast_Binary_Op *comparison, Value left, Value right);
+void fail_if_native_args_invalid(Ast_Function_Call *call, Native_Args args);
+std::string get_unassigned_variable_error(std::string name);
+std::string get_missing_return_error(std::string name, Data_Type return_type);
+std::string get_return_type_error(Data_Type expected, Data_Type actual);
+void report_quicken_stats();
+
+// Lowest address the calling thread's stack should grow to, leaving room to
+// report an overflow. Engines that recurse on the native stack check against
+// it on every call to a bug.
+uintptr_t get_stack_limit();
+void fail_if_stack_overflow(Ast_Function_Call *call);
+
 #endif
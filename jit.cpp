@@ -0,0 +1,995 @@
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+
+#if defined(__x86_64__) && !defined(_WIN32)
+#define JIT_SUPPORTED
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include "interp.hpp"
+#include "jit.hpp"
+#include "logger.hpp"
+#include "memo.hpp"
+
+// Calls before a bug is worth compiling
+static const int JIT_HOT_CALLS = 100;
+
+static Jit_Mode jit_mode = JIT_ON;
+
+// Every bug the JIT has looked at, in order, for the stats
+static std::vector<Jit_Function *> jit_functions;
+
+void set_jit_mode(Jit_Mode mode) {
+    jit_mode = mode;
+}
+
+static bool is_jit_type(Data_Type type) {
+    return type == Data_Type::NUM || type == Data_Type::BOOL;
+}
+
+static uint32_t pack_value(Value value) {
+    if (value.data_type == Data_Type::BOOL) return value.boolean;
+
+    uint32_t bits;
+    memcpy(&bits, &value.num, sizeof(bits));
+    return bits;
+}
+
+static Value unpack_value(uint32_t bits, Data_Type type) {
+    if (type == Data_Type::BOOL) return bool_value(bits != 0);
+
+    float num;
+    memcpy(&num, &bits, sizeof(num));
+    return num_value(num);
+}
+
+// Helpers compiled code calls for anything that isn't worth inlining. They
+// do exactly what the engines do in the same place.
+
+static float jit_pow(float left, float right) {
+    return pow(left, right);
+}
+
+static void fail_if_jit_loop_invalid(Ast_Loop *loop_node, float from, float to, float step) {
+    if (step < 0 && from < to) report_fatal_error("from < to but step value is negative", loop_node->site);
+    if (step > 0 && from > to) report_fatal_error("to > from but step value is positive", loop_node->site);
+    if (step == 0) report_fatal_error("step value cannot be 0", loop_node->site);
+}
+
+static void fail_jit_missing_return(Ast_Function_Definition *def) {
+    report_fatal_error(get_missing_return_error(def->name, def->data_type), def->site);
+}
+
+static void fail_jit_stack_overflow(Ast_Function_Definition *def) {
+    report_fatal_error("Stack overflow", def->site);
+}
+
+// Calls between compiled bugs go through here when the callee is memoized
+static uint32_t call_memoized(Jit_Function *callee, const uint64_t *args, Jit_Context *context) {
+    Ast_Function_Definition *def = callee->def;
+    Memo_Table *memo = context->is_worker ? NULL : def->memo;
+
+    if (memo == NULL) return callee->entry(args, context);
+
+    size_t arity = def->args.size();
+    std::vector<Value> keys(arity);
+
+    for (size_t i = 0; i < arity; i++) keys[i] = unpack_value(args[arity - 1 - i], def->args[i]->data_type);
+
+    Value result;
+    if (memo->lookup(keys.data(), &result)) return pack_value(result);
+
+    uint32_t bits = callee->entry(args, context);
+    memo->insert(keys.data(), unpack_value(bits, def->data_type));
+
+    return bits;
+}
+
+// Decides whether a bug can be compiled, and collects the bugs it calls
+struct Jit_Checker {
+    Ast_Function_Definition *def;
+    std::vector<Ast_Function_Definition *> *callees;
+
+    // Why the bug can't be compiled, finishing "left to the engine as it ..."
+    std::string failure;
+
+    Jit_Checker(Ast_Function_Definition *def, std::vector<Ast_Function_Definition *> *callees) {
+        this->def = def;
+        this->callees = callees;
+    }
+
+    bool fail(const std::string &reason) {
+        if (failure.empty()) failure = reason;
+        return false;
+    }
+
+    bool check_function();
+    bool check_block(Ast_Block *block, int depth);
+    bool check_statement(Ast_Node *node, int depth);
+    bool check_expression(Ast_Node *node, int depth);
+    bool check_binary_op(Ast_Binary_Op *node, int depth);
+    bool check_call(Ast_Function_Call *call, int depth);
+};
+
+bool Jit_Checker::check_function() {
+    if (is_jit_type(def->data_type) == false) return fail("returns a value of type '" + data_type_to_string(def->data_type) + "'");
+    if (def->is_type_checked == false) return fail("has returns only checked at runtime");
+
+    for (Ast_Variable *arg : def->args) {
+        if (is_jit_type(arg->data_type) == false) return fail("takes an arg of type '" + data_type_to_string(arg->data_type) + "'");
+    }
+
+    return check_block(def->block, 0);
+}
+
+// depth counts the scopes opened between the bug's own scope and the node,
+// same as in the Memoizer
+bool Jit_Checker::check_block(Ast_Block *block, int depth) {
+    for (Ast_Node *child : block->children) {
+        if (check_statement(child, depth) == false) return false;
+    }
+
+    return true;
+}
+
+bool Jit_Checker::check_statement(Ast_Node *node, int depth) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BLOCK:
+            return check_block((Ast_Block *)node, depth);
+        case Ast_Node::Type::IF: {
+            for (auto *if_node = (Ast_If *)node; if_node != NULL; if_node = if_node->failure) {
+                if (if_node->comparison != NULL && check_expression(if_node->comparison, depth) == false) return false;
+                if (if_node->comparison != NULL && if_node->comparison->data_type != Data_Type::BOOL) return fail("has a condition that isn't a bool");
+                if (check_block(if_node->success, depth + 1) == false) return false;
+            }
+
+            return true;
+        }
+        case Ast_Node::Type::WHILE: {
+            auto *while_node = (Ast_While *)node;
+
+            if (check_expression(while_node->comparison, depth) == false) return false;
+            if (while_node->comparison->data_type != Data_Type::BOOL) return fail("has a condition that isn't a bool");
+
+            return check_block(while_node->body, depth + 1);
+        }
+        case Ast_Node::Type::LOOP: {
+            auto *loop_node = (Ast_Loop *)node;
+
+            if (loop_node->is_parallel) return fail("has a par loop");
+            if (loop_node->is_type_checked == false) return fail("has loop controls only checked at runtime");
+
+            for (Ast_Node *control : { loop_node->start, loop_node->to, loop_node->step }) {
+                if (check_expression(control, depth) == false) return false;
+                if (control->data_type != Data_Type::NUM) return fail("has a loop control that isn't a num");
+            }
+
+            return check_block(loop_node->body, depth + 1);
+        }
+        case Ast_Node::Type::ASSIGNMENT: {
+            auto *assignment = (Ast_Assignment *)node;
+
+            if (assignment->left->depth > depth) return fail("assigns to '" + assignment->left->name + "' from outside the bug");
+            if (assignment->is_type_checked == false) return fail("has assignments only checked at runtime");
+
+            return check_expression(assignment->right, depth);
+        }
+        case Ast_Node::Type::RETURN: {
+            auto *return_node = (Ast_Return *)node;
+
+            if (check_expression(return_node->value, depth) == false) return false;
+            if (return_node->value->data_type != def->data_type) return fail("has returns only checked at runtime");
+
+            return true;
+        }
+        case Ast_Node::Type::FUNCTION_CALL:
+            return check_expression(node, depth);
+        case Ast_Node::Type::FUNCTION_DEFINITION:
+        case Ast_Node::Type::EMPTY:
+            // Nested bug definitions are judged on their own when called
+            return true;
+        default:
+            return fail("has a statement the JIT doesn't support");
+    }
+}
+
+bool Jit_Checker::check_expression(Ast_Node *node, int depth) {
+    if (is_jit_type(node->data_type) == false) return fail("has an expression of type '" + data_type_to_string(node->data_type) + "'");
+
+    switch (node->node_type) {
+        case Ast_Node::Type::LITERAL:
+            return true;
+        case Ast_Node::Type::VARIABLE: {
+            auto *var = (Ast_Variable *)node;
+
+            if (var->depth > depth) return fail("reads '" + var->name + "' from outside the bug");
+            return true;
+        }
+        case Ast_Node::Type::UNARY_OP: {
+            auto *unary_op = (Ast_Unary_Op *)node;
+            Data_Type type = unary_op->node->data_type;
+            Token::Type op = unary_op->op.type;
+
+            bool is_valid = type == Data_Type::BOOL ? op == Token::Type::LOGICAL_NOT : op == Token::Type::OP_PLUS || op == Token::Type::OP_MINUS;
+            if (is_valid == false) return fail("has an invalid unary operation");
+
+            return check_expression(unary_op->node, depth);
+        }
+        case Ast_Node::Type::BINARY_OP:
+            return check_binary_op((Ast_Binary_Op *)node, depth);
+        case Ast_Node::Type::FUNCTION_CALL:
+            return check_call((Ast_Function_Call *)node, depth);
+        default:
+            return fail("has an expression the JIT doesn't support");
+    }
+}
+
+bool Jit_Checker::check_binary_op(Ast_Binary_Op *node, int depth) {
+    if (node->is_type_checked == false) return fail("has operations only checked at runtime");
+
+    Data_Type type = node->left->data_type;
+    bool is_valid = false;
+
+    switch (node->op.type) {
+        case Token::Type::COMPARE_EQUALS:
+        case Token::Type::COMPARE_NOT_EQUALS:
+            is_valid = true;
+            break;
+        case Token::Type::LOGICAL_AND:
+        case Token::Type::LOGICAL_OR:
+            is_valid = type == Data_Type::BOOL;
+            break;
+        case Token::Type::OP_PLUS:
+        case Token::Type::OP_MINUS:
+        case Token::Type::OP_MULTIPLY:
+        case Token::Type::OP_DIVIDE:
+        case Token::Type::OP_MODULO:
+        case Token::Type::OP_EXPONENT:
+        case Token::Type::OP_PLUS_EQUALS:
+        case Token::Type::OP_MINUS_EQUALS:
+        case Token::Type::OP_MULTIPLY_EQUALS:
+        case Token::Type::OP_DIVIDE_EQUALS:
+        case Token::Type::OP_MODULO_EQUALS:
+        case Token::Type::OP_EXPONENT_EQUALS:
+        case Token::Type::COMPARE_GREATER_THAN:
+        case Token::Type::COMPARE_LESS_THAN:
+        case Token::Type::COMPARE_GREATER_THAN_EQUALS:
+        case Token::Type::COMPARE_LESS_THAN_EQUALS:
+            is_valid = type == Data_Type::NUM;
+            break;
+        default:
+            break;
+    }
+
+    // Invalid operations are left for the engine to report
+    if (is_valid == false || node->right->data_type != type) return fail("has an invalid binary operation");
+
+    return check_expression(node->left, depth) && check_expression(node->right, depth);
+}
+
+bool Jit_Checker::check_call(Ast_Function_Call *call, int depth) {
+    if (call->native != NULL) return fail("calls the native '" + call->name + "'");
+    if (call->is_type_checked == false) return fail("passes args only checked at runtime");
+
+    for (Ast_Node *arg : call->args) {
+        if (check_expression(arg, depth) == false) return false;
+    }
+
+    callees->push_back(call->definition);
+    return true;
+}
+
+// Just enough of x86-64 to compile bugs with
+struct X64_Emitter {
+    std::vector<uint8_t> code;
+
+    void bytes(std::initializer_list<uint8_t> list) {
+        code.insert(code.end(), list);
+    }
+
+    void u32(uint32_t value) {
+        for (int i = 0; i < 4; i++) code.push_back(value >> (i * 8));
+    }
+
+    void u64(uint64_t value) {
+        for (int i = 0; i < 8; i++) code.push_back(value >> (i * 8));
+    }
+
+    size_t here() {
+        return code.size();
+    }
+
+    // Emits a jump or call with a rel32 still to be filled in by patch
+    size_t jump(std::initializer_list<uint8_t> opcode) {
+        bytes(opcode);
+        u32(0);
+
+        return code.size() - 4;
+    }
+
+    void patch(size_t at, size_t target) {
+        int32_t offset = (int32_t)(target - (at + 4));
+        memcpy(&code[at], &offset, sizeof(offset));
+    }
+
+    void jump_back(std::initializer_list<uint8_t> opcode, size_t target) {
+        patch(jump(opcode), target);
+    }
+};
+
+// Compiles a single bug. Every value lives in eax as 32 bits, the bits of a
+// float for nums and 0 or 1 for bools, and the left side of a binary op
+// waits on the machine stack while the right side is worked out. Every
+// variable of the bug gets a 4 byte slot in its frame, each scope opened in
+// the bug taking the slots after those of its parent.
+//
+// Frame, from rbp down: saved r15 (holding the Jit_Context), saved rbx (just
+// keeping rsp 16 byte aligned), then the slots.
+struct Jit_Compiler {
+    X64_Emitter *out;
+    Ast_Function_Definition *def;
+
+    std::vector<int> scope_bases;
+    int frame_top = 0;
+    int frame_max = 0;
+
+    // 8 byte values pushed by expressions still being worked out, which C
+    // calls need to know to keep the stack aligned
+    int pushed = 0;
+
+    size_t body_start = 0;
+    std::vector<size_t> return_jumps;
+
+    Jit_Compiler(X64_Emitter *out, Ast_Function_Definition *def) {
+        this->out = out;
+        this->def = def;
+    }
+
+    int reserve_slots(int count) {
+        int first = frame_top;
+        frame_top += count;
+        frame_max = std::max(frame_max, frame_top);
+
+        return first;
+    }
+
+    void open_scope(Ast_Block *block) {
+        scope_bases.push_back(reserve_slots(block->frame_size));
+    }
+
+    void close_scope(Ast_Block *block) {
+        scope_bases.pop_back();
+        frame_top -= block->frame_size;
+    }
+
+    int get_slot_index(Ast_Variable *var) {
+        return scope_bases[scope_bases.size() - 1 - var->depth] + var->slot;
+    }
+
+    static uint32_t get_slot_offset(int index) {
+        return (uint32_t)(-16 - 4 * (index + 1));
+    }
+
+    // mov eax, [rbp + slot]
+    void load(int index) {
+        out->bytes({ 0x8B, 0x85 });
+        out->u32(get_slot_offset(index));
+    }
+
+    // mov [rbp + slot], eax
+    void store(int index) {
+        out->bytes({ 0x89, 0x85 });
+        out->u32(get_slot_offset(index));
+    }
+
+    void push_eax() {
+        out->bytes({ 0x50 });
+        pushed++;
+    }
+
+    // Moves eax to ecx and pops the value pushed before it back into eax
+    void pop_left() {
+        out->bytes({ 0x89, 0xC1, 0x58 });
+        pushed--;
+    }
+
+    // movd xmm0, eax; movd xmm1, ecx
+    void move_to_xmm() {
+        out->bytes({ 0x66, 0x0F, 0x6E, 0xC0, 0x66, 0x0F, 0x6E, 0xC9 });
+    }
+
+    // movd eax, xmm0
+    void move_from_xmm() {
+        out->bytes({ 0x66, 0x0F, 0x7E, 0xC0 });
+    }
+
+    void call_helper(const void *helper) {
+        bool is_padded = pushed % 2 != 0;
+
+        if (is_padded) out->bytes({ 0x48, 0x83, 0xEC, 0x08 });
+
+        // mov rax, helper; call rax
+        out->bytes({ 0x48, 0xB8 });
+        out->u64((uint64_t)helper);
+        out->bytes({ 0xFF, 0xD0 });
+
+        if (is_padded) out->bytes({ 0x48, 0x83, 0xC4, 0x08 });
+    }
+
+    // mov rdi, pointer
+    void move_to_rdi(const void *pointer) {
+        out->bytes({ 0x48, 0xBF });
+        out->u64((uint64_t)pointer);
+    }
+
+    void compile_function();
+    void compile_block(Ast_Block *block);
+    void compile_statement(Ast_Node *node);
+    void compile_if(Ast_If *if_node);
+    void compile_while(Ast_While *while_node);
+    void compile_loop(Ast_Loop *loop_node);
+    void compile_return(Ast_Return *return_node);
+    void compile_expression(Ast_Node *node);
+    void compile_binary_op(Ast_Binary_Op *node);
+    void compile_compare(Token::Type op, Data_Type type);
+    void compile_call(Ast_Function_Call *call);
+};
+
+void Jit_Compiler::compile_function() {
+    // push rbp; mov rbp, rsp; push r15; push rbx; mov r15, rsi; sub rsp, frame
+    out->bytes({ 0x55, 0x48, 0x89, 0xE5, 0x41, 0x57, 0x53, 0x49, 0x89, 0xF7, 0x48, 0x81, 0xEC });
+    size_t frame_size_at = out->here();
+    out->u32(0);
+
+    // cmp rsp, [r15 + stack_limit]; jb overflow
+    out->bytes({ 0x49, 0x3B, 0x67, (uint8_t)offsetof(Jit_Context, stack_limit) });
+    size_t overflow_jump = out->jump({ 0x0F, 0x82 });
+
+    // Args take the first slots of the bug's scope, and were pushed in order
+    // so the last one is at rdi
+    open_scope(def->block);
+    int arity = def->args.size();
+
+    for (int i = 0; i < arity; i++) {
+        // mov eax, [rdi + 8 * (arity - 1 - i)]
+        out->bytes({ 0x8B, 0x87 });
+        out->u32(8 * (arity - 1 - i));
+        store(i);
+    }
+
+    body_start = out->here();
+    compile_block(def->block);
+    close_scope(def->block);
+
+    // Falling off the end of the body
+    move_to_rdi(def);
+    call_helper((const void *)&fail_jit_missing_return);
+
+    // mov rbx, [rbp - 16]; mov r15, [rbp - 8]; leave; ret
+    for (size_t at : return_jumps) out->patch(at, out->here());
+    out->bytes({ 0x48, 0x8B, 0x5D, 0xF0, 0x4C, 0x8B, 0x7D, 0xF8, 0xC9, 0xC3 });
+
+    out->patch(overflow_jump, out->here());
+    move_to_rdi(def);
+    call_helper((const void *)&fail_jit_stack_overflow);
+
+    uint32_t frame_size = (frame_max * 4 + 15) & ~15;
+    memcpy(&out->code[frame_size_at], &frame_size, sizeof(frame_size));
+}
+
+void Jit_Compiler::compile_block(Ast_Block *block) {
+    for (Ast_Node *child : block->children) compile_statement(child);
+}
+
+void Jit_Compiler::compile_statement(Ast_Node *node) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BLOCK:
+            // Bare blocks share the scope of their parent
+            compile_block((Ast_Block *)node);
+            break;
+        case Ast_Node::Type::IF:
+            compile_if((Ast_If *)node);
+            break;
+        case Ast_Node::Type::WHILE:
+            compile_while((Ast_While *)node);
+            break;
+        case Ast_Node::Type::LOOP:
+            compile_loop((Ast_Loop *)node);
+            break;
+        case Ast_Node::Type::ASSIGNMENT: {
+            auto *assignment = (Ast_Assignment *)node;
+            compile_expression(assignment->right);
+            store(get_slot_index(assignment->left));
+            break;
+        }
+        case Ast_Node::Type::RETURN:
+            compile_return((Ast_Return *)node);
+            break;
+        case Ast_Node::Type::FUNCTION_CALL:
+            // Value of a bug called as a statement is discarded
+            compile_call((Ast_Function_Call *)node);
+            break;
+        default:
+            break;
+    }
+}
+
+void Jit_Compiler::compile_if(Ast_If *if_node) {
+    std::vector<size_t> end_jumps;
+
+    for (; if_node != NULL; if_node = if_node->failure) {
+        size_t skip_jump = 0;
+
+        // Comparison is NULL in else node
+        if (if_node->comparison != NULL) {
+            compile_expression(if_node->comparison);
+
+            // test eax, eax; jz next
+            out->bytes({ 0x85, 0xC0 });
+            skip_jump = out->jump({ 0x0F, 0x84 });
+        }
+
+        open_scope(if_node->success);
+        compile_block(if_node->success);
+        close_scope(if_node->success);
+
+        if (if_node->comparison == NULL) break;
+
+        end_jumps.push_back(out->jump({ 0xE9 }));
+        out->patch(skip_jump, out->here());
+    }
+
+    for (size_t at : end_jumps) out->patch(at, out->here());
+}
+
+void Jit_Compiler::compile_while(Ast_While *while_node) {
+    size_t test = out->here();
+
+    compile_expression(while_node->comparison);
+    out->bytes({ 0x85, 0xC0 });
+    size_t exit_jump = out->jump({ 0x0F, 0x84 });
+
+    open_scope(while_node->body);
+    compile_block(while_node->body);
+    close_scope(while_node->body);
+
+    out->jump_back({ 0xE9 }, test);
+    out->patch(exit_jump, out->here());
+}
+
+// Same float arithmetic as walk_loop: i starts at from and has step added
+// after every iteration, which is copied into 'it' before the body runs
+void Jit_Compiler::compile_loop(Ast_Loop *loop_node) {
+    int from = reserve_slots(5);
+    int to = from + 1;
+    int step = from + 2;
+    int i = from + 3;
+    int is_going_up = from + 4;
+
+    compile_expression(loop_node->start);
+    store(from);
+    compile_expression(loop_node->to);
+    store(to);
+    compile_expression(loop_node->step);
+    store(step);
+
+    // movd xmm0, [from]; movd xmm1, [to]; movd xmm2, [step]
+    for (int slot : { from, to, step }) {
+        load(slot);
+        out->bytes({ 0x66, 0x0F, 0x6E, (uint8_t)(0xC0 + (slot - from) * 8) });
+    }
+
+    move_to_rdi(loop_node);
+    call_helper((const void *)&fail_if_jit_loop_invalid);
+
+    // mov eax, [to]; mov ecx, [from]
+    load(to);
+    out->bytes({ 0x8B, 0x8D });
+    out->u32(get_slot_offset(from));
+    compile_compare(Token::Type::COMPARE_GREATER_THAN, Data_Type::NUM);
+    store(is_going_up);
+
+    load(from);
+    store(i);
+
+    // Tests i < to going up and i > to going down
+    size_t test = out->here();
+    load(is_going_up);
+    out->bytes({ 0x85, 0xC0 });
+    size_t down_jump = out->jump({ 0x0F, 0x84 });
+
+    load(i);
+    out->bytes({ 0x8B, 0x8D });
+    out->u32(get_slot_offset(to));
+    compile_compare(Token::Type::COMPARE_LESS_THAN, Data_Type::NUM);
+    size_t checked_jump = out->jump({ 0xE9 });
+
+    out->patch(down_jump, out->here());
+    load(i);
+    out->bytes({ 0x8B, 0x8D });
+    out->u32(get_slot_offset(to));
+    compile_compare(Token::Type::COMPARE_GREATER_THAN, Data_Type::NUM);
+
+    out->patch(checked_jump, out->here());
+    out->bytes({ 0x85, 0xC0 });
+    size_t exit_jump = out->jump({ 0x0F, 0x84 });
+
+    // 'it' is always the first slot of the loop body
+    open_scope(loop_node->body);
+    load(i);
+    store(scope_bases.back());
+    compile_block(loop_node->body);
+    close_scope(loop_node->body);
+
+    // movd xmm0, [i]; movd xmm1, [step]; addss xmm0, xmm1; movd [i], xmm0
+    load(i);
+    out->bytes({ 0x8B, 0x8D });
+    out->u32(get_slot_offset(step));
+    move_to_xmm();
+    out->bytes({ 0xF3, 0x0F, 0x58, 0xC1 });
+    move_from_xmm();
+    store(i);
+
+    out->jump_back({ 0xE9 }, test);
+    out->patch(exit_jump, out->here());
+
+    frame_top -= 5;
+}
+
+void Jit_Compiler::compile_return(Ast_Return *return_node) {
+    if (return_node->is_tail_call) {
+        auto *call = (Ast_Function_Call *)return_node->value;
+
+        // Every arg is worked out before any is rebound, then the body
+        // starts over in the same frame
+        for (Ast_Node *arg : call->args) {
+            compile_expression(arg);
+            push_eax();
+        }
+
+        for (int i = call->args.size() - 1; i >= 0; i--) {
+            out->bytes({ 0x58 });
+            pushed--;
+            store(i);
+        }
+
+        out->jump_back({ 0xE9 }, body_start);
+        return;
+    }
+
+    compile_expression(return_node->value);
+    return_jumps.push_back(out->jump({ 0xE9 }));
+}
+
+void Jit_Compiler::compile_expression(Ast_Node *node) {
+    switch (node->node_type) {
+        case Ast_Node::Type::LITERAL:
+            // mov eax, imm32
+            out->bytes({ 0xB8 });
+            out->u32(pack_value(((Ast_Literal *)node)->value));
+            break;
+        case Ast_Node::Type::VARIABLE:
+            load(get_slot_index((Ast_Variable *)node));
+            break;
+        case Ast_Node::Type::UNARY_OP: {
+            auto *unary_op = (Ast_Unary_Op *)node;
+            compile_expression(unary_op->node);
+
+            // Flipping the sign bit is exactly what negating a float does
+            if (unary_op->op.type == Token::Type::OP_MINUS) {
+                out->bytes({ 0x35 });
+                out->u32(0x80000000);
+            } else if (unary_op->op.type == Token::Type::LOGICAL_NOT) {
+                out->bytes({ 0x83, 0xF0, 0x01 });
+            }
+            break;
+        }
+        case Ast_Node::Type::BINARY_OP:
+            compile_binary_op((Ast_Binary_Op *)node);
+            break;
+        case Ast_Node::Type::FUNCTION_CALL:
+            compile_call((Ast_Function_Call *)node);
+            break;
+        default:
+            break;
+    }
+}
+
+// Both sides are always worked out, 'and' and 'or' don't short circuit in
+// the engines either
+void Jit_Compiler::compile_binary_op(Ast_Binary_Op *node) {
+    compile_expression(node->left);
+    push_eax();
+    compile_expression(node->right);
+    pop_left();
+
+    Token::Type op = node->op.type;
+
+    switch (op) {
+        case Token::Type::OP_PLUS:
+        case Token::Type::OP_PLUS_EQUALS:
+            move_to_xmm();
+            out->bytes({ 0xF3, 0x0F, 0x58, 0xC1 });
+            move_from_xmm();
+            break;
+        case Token::Type::OP_MINUS:
+        case Token::Type::OP_MINUS_EQUALS:
+            move_to_xmm();
+            out->bytes({ 0xF3, 0x0F, 0x5C, 0xC1 });
+            move_from_xmm();
+            break;
+        case Token::Type::OP_MULTIPLY:
+        case Token::Type::OP_MULTIPLY_EQUALS:
+            move_to_xmm();
+            out->bytes({ 0xF3, 0x0F, 0x59, 0xC1 });
+            move_from_xmm();
+            break;
+        case Token::Type::OP_DIVIDE:
+        case Token::Type::OP_DIVIDE_EQUALS:
+            move_to_xmm();
+            out->bytes({ 0xF3, 0x0F, 0x5E, 0xC1 });
+            move_from_xmm();
+            break;
+        case Token::Type::OP_MODULO:
+        case Token::Type::OP_MODULO_EQUALS:
+            // Truncated to ints like the engines, which fault the same way
+            // on a 0 divisor. cvttss2si eax, xmm0; cvttss2si ecx, xmm1; cdq;
+            // idiv ecx; cvtsi2ss xmm0, edx
+            move_to_xmm();
+            out->bytes({ 0xF3, 0x0F, 0x2C, 0xC0, 0xF3, 0x0F, 0x2C, 0xC9, 0x99, 0xF7, 0xF9, 0xF3, 0x0F, 0x2A, 0xC2 });
+            move_from_xmm();
+            break;
+        case Token::Type::OP_EXPONENT:
+        case Token::Type::OP_EXPONENT_EQUALS:
+            move_to_xmm();
+            call_helper((const void *)&jit_pow);
+            move_from_xmm();
+            break;
+        case Token::Type::LOGICAL_AND:
+            out->bytes({ 0x21, 0xC8 });
+            break;
+        case Token::Type::LOGICAL_OR:
+            out->bytes({ 0x09, 0xC8 });
+            break;
+        default:
+            compile_compare(op, node->left->data_type);
+            break;
+    }
+}
+
+// Compares eax with ecx, leaving 0 or 1 in eax. Unordered compares of NaNs
+// are false for everything but !=, same as in C++.
+void Jit_Compiler::compile_compare(Token::Type op, Data_Type type) {
+    if (type == Data_Type::BOOL) {
+        // cmp eax, ecx; sete/setne al
+        out->bytes({ 0x39, 0xC8, 0x0F, (uint8_t)(op == Token::Type::COMPARE_EQUALS ? 0x94 : 0x95), 0xC0 });
+    } else {
+        move_to_xmm();
+
+        switch (op) {
+            case Token::Type::COMPARE_EQUALS:
+                // ucomiss xmm0, xmm1; sete al; setnp cl; and al, cl
+                out->bytes({ 0x0F, 0x2E, 0xC1, 0x0F, 0x94, 0xC0, 0x0F, 0x9B, 0xC1, 0x20, 0xC8 });
+                break;
+            case Token::Type::COMPARE_NOT_EQUALS:
+                // ucomiss xmm0, xmm1; setne al; setp cl; or al, cl
+                out->bytes({ 0x0F, 0x2E, 0xC1, 0x0F, 0x95, 0xC0, 0x0F, 0x9A, 0xC1, 0x08, 0xC8 });
+                break;
+            case Token::Type::COMPARE_GREATER_THAN:
+                // ucomiss xmm0, xmm1; seta al
+                out->bytes({ 0x0F, 0x2E, 0xC1, 0x0F, 0x97, 0xC0 });
+                break;
+            case Token::Type::COMPARE_GREATER_THAN_EQUALS:
+                // ucomiss xmm0, xmm1; setae al
+                out->bytes({ 0x0F, 0x2E, 0xC1, 0x0F, 0x93, 0xC0 });
+                break;
+            case Token::Type::COMPARE_LESS_THAN:
+                // ucomiss xmm1, xmm0; seta al
+                out->bytes({ 0x0F, 0x2E, 0xC8, 0x0F, 0x97, 0xC0 });
+                break;
+            default:
+                // ucomiss xmm1, xmm0; setae al
+                out->bytes({ 0x0F, 0x2E, 0xC8, 0x0F, 0x93, 0xC0 });
+                break;
+        }
+    }
+
+    // movzx eax, al
+    out->bytes({ 0x0F, 0xB6, 0xC0 });
+}
+
+// Args are pushed in order, then the callee gets a pointer to the last one.
+// A padding slot goes under them if that's needed to call with the stack
+// 16 byte aligned.
+void Jit_Compiler::compile_call(Ast_Function_Call *call) {
+    Jit_Function *callee = call->definition->jit;
+    int arg_count = call->args.size();
+    int padding = (pushed + arg_count) % 2;
+
+    if (padding != 0) {
+        out->bytes({ 0x48, 0x83, 0xEC, 0x08 });
+        pushed++;
+    }
+
+    for (Ast_Node *arg : call->args) {
+        compile_expression(arg);
+        push_eax();
+    }
+
+    if (callee->def->memo != NULL) {
+        // mov rdi, callee; mov rsi, rsp; mov rdx, r15; mov rax, call_memoized; call rax
+        move_to_rdi(callee);
+        out->bytes({ 0x48, 0x89, 0xE6, 0x4C, 0x89, 0xFA, 0x48, 0xB8 });
+        out->u64((uint64_t)&call_memoized);
+        out->bytes({ 0xFF, 0xD0 });
+    } else {
+        // The callee may not have its code yet when this is compiled, so it's
+        // called through its entry. mov rdi, rsp; mov rsi, r15;
+        // mov rax, &entry; call [rax]
+        out->bytes({ 0x48, 0x89, 0xE7, 0x4C, 0x89, 0xFE, 0x48, 0xB8 });
+        out->u64((uint64_t)&callee->entry);
+        out->bytes({ 0xFF, 0x10 });
+    }
+
+    // add rsp, 8 * (args + padding)
+    out->bytes({ 0x48, 0x81, 0xC4 });
+    out->u32(8 * (arg_count + padding));
+    pushed -= arg_count + padding;
+}
+
+#ifdef JIT_SUPPORTED
+
+// Everything in the group shares one mapping, which is made executable once
+// all the code is in and is never freed
+static bool install_code(X64_Emitter *out, const std::vector<std::pair<Jit_Function *, size_t>> &offsets) {
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t size = (out->code.size() + page_size - 1) / page_size * page_size;
+
+    void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return false;
+
+    memcpy(memory, out->code.data(), out->code.size());
+
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return false;
+    }
+
+    for (auto &offset : offsets) offset.first->entry = (Jit_Entry)((char *)memory + offset.second);
+
+    return true;
+}
+
+static bool is_left_to_engine(Ast_Function_Definition *def, std::unordered_map<Ast_Function_Definition *, std::string> &failures) {
+    if (def->jit != NULL) return def->jit->entry == NULL && def->jit->failure.empty() == false;
+
+    return failures[def].empty() == false;
+}
+
+// Compiles def along with every bug it can reach that hasn't been looked at
+// yet, as they're needed for it to run compiled anyway. Like the Memoizer,
+// every bug is assumed to compile until one of its callees turns out not to,
+// so recursion is fine.
+static void compile_group(Ast_Function_Definition *root) {
+    std::vector<Ast_Function_Definition *> group;
+    std::unordered_set<Ast_Function_Definition *> seen;
+    std::unordered_map<Ast_Function_Definition *, std::vector<Ast_Function_Definition *>> callees;
+    std::unordered_map<Ast_Function_Definition *, std::string> failures;
+    std::vector<Ast_Function_Definition *> pending = { root };
+
+    while (pending.empty() == false) {
+        Ast_Function_Definition *def = pending.back();
+        pending.pop_back();
+
+        if (def->jit != NULL || seen.insert(def).second == false) continue;
+
+        Jit_Checker checker(def, &callees[def]);
+        checker.check_function();
+
+        group.push_back(def);
+        failures[def] = checker.failure;
+        pending.insert(pending.end(), callees[def].begin(), callees[def].end());
+    }
+
+    bool is_changed = true;
+
+    while (is_changed) {
+        is_changed = false;
+
+        for (Ast_Function_Definition *def : group) {
+            if (failures[def].empty() == false) continue;
+
+            for (Ast_Function_Definition *callee : callees[def]) {
+                if (is_left_to_engine(callee, failures) == false) continue;
+
+                failures[def] = "calls '" + callee->name + "', which is left to the engine";
+                is_changed = true;
+                break;
+            }
+        }
+    }
+
+    // Made up front so calls within the group have an entry to go through
+    for (Ast_Function_Definition *def : group) {
+        def->jit = new Jit_Function(def);
+        def->jit->failure = failures[def];
+        jit_functions.push_back(def->jit);
+    }
+
+    X64_Emitter out;
+    std::vector<std::pair<Jit_Function *, size_t>> offsets;
+
+    for (Ast_Function_Definition *def : group) {
+        if (def->jit->failure.empty() == false) continue;
+
+        size_t start = out.here();
+        Jit_Compiler compiler(&out, def);
+        compiler.compile_function();
+
+        def->jit->code_size = out.here() - start;
+        offsets.push_back(std::make_pair(def->jit, start));
+    }
+
+    if (offsets.empty() || install_code(&out, offsets)) return;
+
+    for (auto &offset : offsets) offset.first->failure = "couldn't be given executable memory";
+}
+
+Jit_Function *get_jit_function(Ast_Function_Definition *def, bool is_worker) {
+    if (def->jit != NULL) return def->jit->entry != NULL ? def->jit : NULL;
+    if (is_worker || jit_mode == JIT_OFF) return NULL;
+
+    if (++def->call_count < (jit_mode == JIT_EAGER ? 1 : JIT_HOT_CALLS)) return NULL;
+
+    compile_group(def);
+    return def->jit->entry != NULL ? def->jit : NULL;
+}
+
+Value call_jit_function(Jit_Function *function, const Value *args, bool is_worker) {
+    Ast_Function_Definition *def = function->def;
+    size_t arity = def->args.size();
+    std::vector<uint64_t> packed(arity + 1);
+
+    for (size_t i = 0; i < arity; i++) packed[arity - 1 - i] = pack_value(args[i]);
+
+    Jit_Context context;
+    context.stack_limit = get_stack_limit();
+    context.is_worker = is_worker;
+
+    return unpack_value(function->entry(packed.data(), &context), def->data_type);
+}
+
+#else
+
+Jit_Function *get_jit_function(Ast_Function_Definition *def, bool is_worker) {
+    return NULL;
+}
+
+Value call_jit_function(Jit_Function *function, const Value *args, bool is_worker) {
+    report_fatal_error("The JIT isn't supported on this platform");
+    return Value();
+}
+
+#endif
+
+void report_jit_stats() {
+    if (jit_functions.empty()) {
+        std::cerr << "[JIT] no bugs were hot enough to compile" << std::endl;
+        return;
+    }
+
+    for (Jit_Function *function : jit_functions) {
+        if (function->entry != NULL) {
+            std::cerr << "[JIT] " << function->def->name << ": compiled to " << function->code_size << " bytes" << std::endl;
+        } else {
+            std::cerr << "[JIT] " << function->def->name << ": left to the engine as it " << function->failure << std::endl;
+        }
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include <cstdint>
+#include <string>
+#include "parser.hpp"
+#include "typer.hpp"
+
+// Bugs that only ever deal in nums and bools are compiled to x86-64 machine
+// code once they've been called often enough, and from then on both engines
+// call the machine code instead of running the bug themselves.
+//
+// A bug can be compiled when its args, return value and every variable and
+// expression in its body are nums or bools the checker could type, it only
+// uses variables declared inside itself, and it only calls bugs that can be
+// compiled too. Anything else, natives, arrs, strs, par loops, stays with the
+// engine. Results are bit for bit the same as the engines give: nums are
+// single floats throughout, and every runtime error is reported the same way.
+//
+// Only available on x86-64 with the System V calling convention, elsewhere
+// every bug is left to the engines.
+
+enum Jit_Mode {
+    JIT_OFF,
+    JIT_ON,
+
+    // Compiles on the first call, mostly useful for testing
+    JIT_EAGER
+};
+
+// Passed to every compiled bug, which hands it on to the bugs it calls
+struct Jit_Context {
+    // Compiled bugs report a stack overflow once the stack gets this low
+    uintptr_t stack_limit;
+
+    // Workers in par loops don't share memo tables, see walk_function_call
+    bool is_worker;
+};
+
+// Args are 8 bytes apart and in reverse order, so the last is at args[0].
+// Nums are passed and returned as the bits of their float, bools as 0 or 1.
+typedef uint32_t (*Jit_Entry)(const uint64_t *args, Jit_Context *context);
+
+struct Jit_Function {
+    Ast_Function_Definition *def;
+
+    // NULL when the bug couldn't be compiled, with the reason in failure
+    Jit_Entry entry;
+    std::string failure;
+    size_t code_size;
+
+    Jit_Function(Ast_Function_Definition *def) {
+        this->def = def;
+        this->entry = NULL;
+        this->code_size = 0;
+    }
+};
+
+void set_jit_mode(Jit_Mode mode);
+
+// Counts a call to def, and returns its compiled code once there is some.
+// Workers only ever use code the main thread has already compiled.
+Jit_Function *get_jit_function(Ast_Function_Definition *def, bool is_worker);
+
+// args are the bug's args in order, already checked against its arg types
+Value call_jit_function(Jit_Function *function, const Value *args, bool is_worker);
+
+void report_jit_stats();
+
+#endif
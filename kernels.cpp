@@ -0,0 +1,291 @@
+#include <limits>
+
+#include "kernels.hpp"
+
+// Building with SHEL_NO_SIMD forces the scalar kernels everywhere
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(SHEL_NO_SIMD)
+#define HAS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+static const int LANES = 8;
+
+// Each kernel only handles whole blocks of LANES nums, the public functions
+// finish off the remainder with scalar code that is the same for every kernel
+struct Kernels {
+    void (*sum_lanes)(const float *nums, size_t blocks, double *lanes);
+    void (*dot_lanes)(const float *a, const float *b, size_t blocks, double *lanes);
+    void (*min_max_lanes)(const float *nums, size_t blocks, float *min_lanes, float *max_lanes);
+    void (*scale)(const float *nums, float factor, float *out, size_t blocks);
+    void (*add)(const float *a, const float *b, float *out, size_t blocks);
+};
+
+#ifndef HAS_X86_KERNELS
+static void sum_lanes_scalar(const float *nums, size_t blocks, double *lanes) {
+    for (int lane = 0; lane < LANES; lane++) lanes[lane] = 0;
+
+    for (size_t i = 0; i < blocks * LANES; i += LANES) {
+        for (int lane = 0; lane < LANES; lane++) lanes[lane] += nums[i + lane];
+    }
+}
+
+static void dot_lanes_scalar(const float *a, const float *b, size_t blocks, double *lanes) {
+    for (int lane = 0; lane < LANES; lane++) lanes[lane] = 0;
+
+    for (size_t i = 0; i < blocks * LANES; i += LANES) {
+        for (int lane = 0; lane < LANES; lane++) lanes[lane] += (double)a[i + lane] * b[i + lane];
+    }
+}
+
+// Written as x < min ? x : min to match minps/maxps, which is what skips NaNs
+static void min_max_lanes_scalar(const float *nums, size_t blocks, float *min_lanes, float *max_lanes) {
+    for (size_t i = 0; i < blocks * LANES; i += LANES) {
+        for (int lane = 0; lane < LANES; lane++) {
+            float num = nums[i + lane];
+            min_lanes[lane] = num < min_lanes[lane] ? num : min_lanes[lane];
+            max_lanes[lane] = num > max_lanes[lane] ? num : max_lanes[lane];
+        }
+    }
+}
+
+static void scale_scalar(const float *nums, float factor, float *out, size_t blocks) {
+    for (size_t i = 0; i < blocks * LANES; i++) out[i] = nums[i] * factor;
+}
+
+static void add_scalar(const float *a, const float *b, float *out, size_t blocks) {
+    for (size_t i = 0; i < blocks * LANES; i++) out[i] = a[i] + b[i];
+}
+#else
+// SSE2 is part of x86-64, so these need no check before use. Lanes are split
+// over four registers of two doubles.
+static void sum_lanes_sse2(const float *nums, size_t blocks, double *lanes) {
+    __m128d acc[4] = { _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd() };
+
+    for (size_t i = 0; i < blocks * LANES; i += LANES) {
+        __m128 low = _mm_loadu_ps(nums + i);
+        __m128 high = _mm_loadu_ps(nums + i + 4);
+
+        acc[0] = _mm_add_pd(acc[0], _mm_cvtps_pd(low));
+        acc[1] = _mm_add_pd(acc[1], _mm_cvtps_pd(_mm_movehl_ps(low, low)));
+        acc[2] = _mm_add_pd(acc[2], _mm_cvtps_pd(high));
+        acc[3] = _mm_add_pd(acc[3], _mm_cvtps_pd(_mm_movehl_ps(high, high)));
+    }
+
+    for (int j = 0; j < 4; j++) _mm_storeu_pd(lanes + j * 2, acc[j]);
+}
+
+static void dot_lanes_sse2(const float *a, const float *b, size_t blocks, double *lanes) {
+    __m128d acc[4] = { _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd(), _mm_setzero_pd() };
+
+    for (size_t i = 0; i < blocks * LANES; i += LANES) {
+        for (int j = 0; j < 2; j++) {
+            __m128 x = _mm_loadu_ps(a + i + j * 4);
+            __m128 y = _mm_loadu_ps(b + i + j * 4);
+
+            acc[j * 2] = _mm_add_pd(acc[j * 2], _mm_mul_pd(_mm_cvtps_pd(x), _mm_cvtps_pd(y)));
+            acc[j * 2 + 1] = _mm_add_pd(acc[j * 2 + 1], _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(x, x)), _mm_cvtps_pd(_mm_movehl_ps(y, y))));
+        }
+    }
+
+    for (int j = 0; j < 4; j++) _mm_storeu_pd(lanes + j * 2, acc[j]);
+}
+
+static void min_max_lanes_sse2(const float *nums, size_t blocks, float *min_lanes, float *max_lanes) {
+    __m128 min_acc[2] = { _mm_loadu_ps(min_lanes), _mm_loadu_ps(min_lanes + 4) };
+    __m128 max_acc[2] = { _mm_loadu_ps(max_lanes), _mm_loadu_ps(max_lanes + 4) };
+
+    for (size_t i = 0; i < blocks * LANES; i += LANES) {
+        for (int j = 0; j < 2; j++) {
+            __m128 x = _mm_loadu_ps(nums + i + j * 4);
+            min_acc[j] = _mm_min_ps(x, min_acc[j]);
+            max_acc[j] = _mm_max_ps(x, max_acc[j]);
+        }
+    }
+
+    for (int j = 0; j < 2; j++) {
+        _mm_storeu_ps(min_lanes + j * 4, min_acc[j]);
+        _mm_storeu_ps(max_lanes + j * 4, max_acc[j]);
+    }
+}
+
+static void scale_sse2(const float *nums, float factor, float *out, size_t blocks) {
+    __m128 factors = _mm_set1_ps(factor);
+
+    for (size_t i = 0; i < blocks * LANES; i += 4) {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(nums + i), factors));
+    }
+}
+
+static void add_sse2(const float *a, const float *b, float *out, size_t blocks) {
+    for (size_t i = 0; i < blocks * LANES; i += 4) {
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+}
+
+// AVX kernels are compiled for AVX whatever the build flags, and are only
+// picked once the CPU has been checked for it. Lanes are split over two
+// registers of four doubles.
+__attribute__((target("avx")))
+static void sum_lanes_avx(const float *nums, size_t blocks, double *lanes) {
+    __m256d low = _mm256_setzero_pd();
+    __m256d high = _mm256_setzero_pd();
+
+    for (size_t i = 0; i < blocks * LANES; i += LANES) {
+        low = _mm256_add_pd(low, _mm256_cvtps_pd(_mm_loadu_ps(nums + i)));
+        high = _mm256_add_pd(high, _mm256_cvtps_pd(_mm_loadu_ps(nums + i + 4)));
+    }
+
+    _mm256_storeu_pd(lanes, low);
+    _mm256_storeu_pd(lanes + 4, high);
+}
+
+__attribute__((target("avx")))
+static void dot_lanes_avx(const float *a, const float *b, size_t blocks, double *lanes) {
+    __m256d low = _mm256_setzero_pd();
+    __m256d high = _mm256_setzero_pd();
+
+    for (size_t i = 0; i < blocks * LANES; i += LANES) {
+        low = _mm256_add_pd(low, _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i)), _mm256_cvtps_pd(_mm_loadu_ps(b + i))));
+        high = _mm256_add_pd(high, _mm256_mul_pd(_mm256_cvtps_pd(_mm_loadu_ps(a + i + 4)), _mm256_cvtps_pd(_mm_loadu_ps(b + i + 4))));
+    }
+
+    _mm256_storeu_pd(lanes, low);
+    _mm256_storeu_pd(lanes + 4, high);
+}
+
+__attribute__((target("avx")))
+static void min_max_lanes_avx(const float *nums, size_t blocks, float *min_lanes, float *max_lanes) {
+    __m256 min_acc = _mm256_loadu_ps(min_lanes);
+    __m256 max_acc = _mm256_loadu_ps(max_lanes);
+
+    for (size_t i = 0; i < blocks * LANES; i += LANES) {
+        __m256 x = _mm256_loadu_ps(nums + i);
+        min_acc = _mm256_min_ps(x, min_acc);
+        max_acc = _mm256_max_ps(x, max_acc);
+    }
+
+    _mm256_storeu_ps(min_lanes, min_acc);
+    _mm256_storeu_ps(max_lanes, max_acc);
+}
+
+__attribute__((target("avx")))
+static void scale_avx(const float *nums, float factor, float *out, size_t blocks) {
+    __m256 factors = _mm256_set1_ps(factor);
+
+    for (size_t i = 0; i < blocks * LANES; i += LANES) {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(nums + i), factors));
+    }
+}
+
+__attribute__((target("avx")))
+static void add_avx(const float *a, const float *b, float *out, size_t blocks) {
+    for (size_t i = 0; i < blocks * LANES; i += LANES) {
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+}
+#endif
+
+static const Kernels &get_kernels() {
+#ifdef HAS_X86_KERNELS
+    static const Kernels sse2 = { sum_lanes_sse2, dot_lanes_sse2, min_max_lanes_sse2, scale_sse2, add_sse2 };
+    static const Kernels avx = { sum_lanes_avx, dot_lanes_avx, min_max_lanes_avx, scale_avx, add_avx };
+    static const Kernels *selected = NULL;
+
+    if (selected == NULL) {
+        __builtin_cpu_init();
+        selected = __builtin_cpu_supports("avx") ? &avx : &sse2;
+    }
+
+    return *selected;
+#else
+    static const Kernels scalar = { sum_lanes_scalar, dot_lanes_scalar, min_max_lanes_scalar, scale_scalar, add_scalar };
+    return scalar;
+#endif
+}
+
+// Lanes are always added up in the same order, see kernels.hpp
+static double combine_lanes(const double *lanes) {
+    double total = 0;
+    for (int lane = 0; lane < LANES; lane++) total += lanes[lane];
+
+    return total;
+}
+
+double sum_nums(const float *nums, size_t count) {
+    double lanes[LANES];
+    size_t blocks = count / LANES;
+
+    get_kernels().sum_lanes(nums, blocks, lanes);
+
+    double total = combine_lanes(lanes);
+    for (size_t i = blocks * LANES; i < count; i++) total += nums[i];
+
+    return total;
+}
+
+double dot_nums(const float *a, const float *b, size_t count) {
+    double lanes[LANES];
+    size_t blocks = count / LANES;
+
+    get_kernels().dot_lanes(a, b, blocks, lanes);
+
+    double total = combine_lanes(lanes);
+    for (size_t i = blocks * LANES; i < count; i++) total += (double)a[i] * b[i];
+
+    return total;
+}
+
+static void min_max_nums(const float *nums, size_t count, float *min, float *max) {
+    float min_lanes[LANES];
+    float max_lanes[LANES];
+    size_t blocks = count / LANES;
+
+    // Starting from infinity rather than the first num means a leading NaN is skipped too
+    for (int lane = 0; lane < LANES; lane++) {
+        min_lanes[lane] = std::numeric_limits<float>::infinity();
+        max_lanes[lane] = -std::numeric_limits<float>::infinity();
+    }
+
+    get_kernels().min_max_lanes(nums, blocks, min_lanes, max_lanes);
+
+    *min = min_lanes[0];
+    *max = max_lanes[0];
+
+    for (int lane = 1; lane < LANES; lane++) {
+        if (min_lanes[lane] < *min) *min = min_lanes[lane];
+        if (max_lanes[lane] > *max) *max = max_lanes[lane];
+    }
+
+    for (size_t i = blocks * LANES; i < count; i++) {
+        if (nums[i] < *min) *min = nums[i];
+        if (nums[i] > *max) *max = nums[i];
+    }
+}
+
+float min_nums(const float *nums, size_t count) {
+    float min, max;
+    min_max_nums(nums, count, &min, &max);
+
+    return min;
+}
+
+float max_nums(const float *nums, size_t count) {
+    float min, max;
+    min_max_nums(nums, count, &min, &max);
+
+    return max;
+}
+
+void scale_nums(const float *nums, float factor, float *out, size_t count) {
+    size_t blocks = count / LANES;
+
+    get_kernels().scale(nums, factor, out, blocks);
+    for (size_t i = blocks * LANES; i < count; i++) out[i] = nums[i] * factor;
+}
+
+void add_nums(const float *a, const float *b, float *out, size_t count) {
+    size_t blocks = count / LANES;
+
+    get_kernels().add(a, b, out, blocks);
+    for (size_t i = blocks * LANES; i < count; i++) out[i] = a[i] + b[i];
+}
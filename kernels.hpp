@@ -0,0 +1,25 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstddef>
+
+// Bulk operations over the unboxed storage of num arrs. On x86-64 the AVX
+// kernels are used when the CPU supports them and SSE2 otherwise, picked the
+// first time one is called. Everything else gets plain scalar code.
+//
+// Sums and dot products accumulate in doubles across 8 lanes that are always
+// combined in the same order, so every implementation gives bit for bit the
+// same result whatever the machine. Elementwise operations are single float
+// operations and are exact anyway.
+double sum_nums(const float *nums, size_t count);
+double dot_nums(const float *a, const float *b, size_t count);
+
+// NaNs are skipped, count must be at least 1
+float min_nums(const float *nums, size_t count);
+float max_nums(const float *nums, size_t count);
+
+// out may alias the inputs
+void scale_nums(const float *nums, float factor, float *out, size_t count);
+void add_nums(const float *a, const float *b, float *out, size_t count);
+
+#endif
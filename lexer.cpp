@@ -1,167 +1,267 @@
+#include <cstring>
 #include <iostream>
-#include <map>
 #include <sstream>
 
 #include "lexer.hpp"
 #include "logger.hpp"
 
-static const std::regex string_regex("[\"]");
-static const std::regex ident_start_regex("[_a-zA-Z]");
-static const std::regex ident_end_regex("[^_a-zA-Z0-9]");
-static const std::regex num_start_regex("[.0-9]");
-static const std::regex num_end_regex("[^.0-9]");
+enum Char_Class {
+    CHAR_SPACE       = 1 << 0,
+    CHAR_IDENT_START = 1 << 1,
+    CHAR_IDENT       = 1 << 2,
+    CHAR_NUMBER      = 1 << 3
+};
 
-void Lexer::lex() {
-    std::vector<Token *> tokens;
-    size_t file_size = file_string.size();
+struct Char_Class_Table {
+    unsigned char classes[256];
 
-    while (index < file_size) {
-        std::string curr = std::string(1, file_string.at(index));
-        Token *next_token = NULL;
-        Code_Site *site = new Code_Site(file_name, line_number, column_position);
-
-        if (curr == " ")                                    { move_next_char(); continue; }
-        else if (curr == "\n")                              { move_next_line(); continue; }
-        else if (curr == "#")                               { consume_comment(); continue; }
-
-        else if (curr == "=" && peek_next_char() != "=")    { next_token = new Token(Token::Type::OP_ASSIGNMENT, "=", site, Token::Flags::OPERATOR); }
-        else if (curr == "+" && peek_next_char() == "=")    { next_token = new Token(Token::Type::OP_PLUS_EQUALS, "+=", site, Token::Flags::OPERATOR); }
-        else if (curr == "-" && peek_next_char() == "=")    { next_token = new Token(Token::Type::OP_MINUS_EQUALS, "+=", site, Token::Flags::OPERATOR); }
-        else if (curr == "*" && peek_next_char() == "=")    { next_token = new Token(Token::Type::OP_MULTIPLY_EQUALS, "+=", site, Token::Flags::OPERATOR); }
-        else if (curr == "/" && peek_next_char() == "=")    { next_token = new Token(Token::Type::OP_DIVIDE_EQUALS, "+=", site, Token::Flags::OPERATOR); }
-        else if (curr == "%" && peek_next_char() == "=")    { next_token = new Token(Token::Type::OP_MODULO_EQUALS, "+=", site, Token::Flags::OPERATOR); }
-        else if (curr == "^" && peek_next_char() == "=")    { next_token = new Token(Token::Type::OP_EXPONENT_EQUALS, "^=", site, Token::Flags::OPERATOR); }
-        else if (curr == "+")                               { next_token = new Token(Token::Type::OP_PLUS, "+", site, Token::Flags::OPERATOR); }
-        else if (curr == "-")                               { next_token = new Token(Token::Type::OP_MINUS, "-", site, Token::Flags::OPERATOR); }
-        else if (curr == "*")                               { next_token = new Token(Token::Type::OP_MULTIPLY, "*", site, Token::Flags::OPERATOR); }
-        else if (curr == "/")                               { next_token = new Token(Token::Type::OP_DIVIDE, "/", site, Token::Flags::OPERATOR); }
-        else if (curr == "%")                               { next_token = new Token(Token::Type::OP_MODULO, "%", site, Token::Flags::OPERATOR); }
-        else if (curr == "^")                               { next_token = new Token(Token::Type::OP_EXPONENT, "^", site, Token::Flags::OPERATOR); }
-
-        else if (curr == "(")                               { next_token = new Token(Token::Type::L_PAREN, "(", site); }
-        else if (curr == ")")                               { next_token = new Token(Token::Type::R_PAREN, ")", site); }
-        else if (curr == "{")                               { next_token = new Token(Token::Type::L_BRACE, "{", site); }
-        else if (curr == "}")                               { next_token = new Token(Token::Type::R_BRACE, "}", site); }
-        else if (curr == "[")                               { next_token = new Token(Token::Type::L_ARRAY, "[", site); }
-        else if (curr == "]")                               { next_token = new Token(Token::Type::R_ARRAY, "]", site); }
-        else if (curr == ";")                               { next_token = new Token(Token::Type::TERMINATOR, ";", site); }
-        else if (curr == ",")                               { next_token = new Token(Token::Type::ARGUMENT_SEPARATOR, ",", site); }
-
-        else if (curr == "=" && peek_next_char() == "=")   { next_token = new Token(Token::Type::COMPARE_EQUALS, "==", site, Token::Flags::COMPARISON); }
-        else if (curr == "!" && peek_next_char() == "=")   { next_token = new Token(Token::Type::COMPARE_NOT_EQUALS, "!=", site, Token::Flags::COMPARISON); }
-        else if (curr == "<" && peek_next_char() == "=")   { next_token = new Token(Token::Type::COMPARE_LESS_THAN_EQUALS, "<=", site, Token::Flags::COMPARISON); }
-        else if (curr == ">" && peek_next_char() == "=")   { next_token = new Token(Token::Type::COMPARE_GREATER_THAN_EQUALS, ">=", site, Token::Flags::COMPARISON); }
-        else if (curr == "<")                               { next_token = new Token(Token::Type::COMPARE_LESS_THAN, "<", site, Token::Flags::COMPARISON); }
-        else if (curr == ">")                               { next_token = new Token(Token::Type::COMPARE_GREATER_THAN, ">", site, Token::Flags::COMPARISON); }
-
-        else if (std::regex_match(curr, string_regex))      { move_next_char(); next_token = new Token(Token::Type::STRING, scan_string(site, file_string.substr(index), string_regex), site, Token::Flags::LITERAL); }
-        else if (std::regex_match(curr, num_start_regex))   { next_token = new Token(Token::Type::NUMBER, scan_other(site, file_string.substr(index), num_end_regex), site, Token::Flags::LITERAL); }
-        else if (std::regex_match(curr, ident_start_regex)) { next_token = scan_ident(site, file_string.substr(index), ident_end_regex); }
-        else {
-            std::stringstream ss;
-            ss << "Cannot lex character: " << curr;
-            report_fatal_error(ss.str(), site);
-        }
+    Char_Class_Table() {
+        memset(classes, 0, sizeof(classes));
 
-        tokens.push_back(next_token);
-        move_next_chars(next_token->value.size());
+        classes[(unsigned char)' ']  = CHAR_SPACE;
+        classes[(unsigned char)'\t'] = CHAR_SPACE;
+        classes[(unsigned char)'\r'] = CHAR_SPACE;
+        classes[(unsigned char)'\n'] = CHAR_SPACE;
 
-        // @HACK(LOW) Consuming end string marker
-        if (next_token->type == Token::Type::STRING) { move_next_char(); }
+        for (int c = 'a'; c <= 'z'; c++) classes[c] = CHAR_IDENT_START | CHAR_IDENT;
+        for (int c = 'A'; c <= 'Z'; c++) classes[c] = CHAR_IDENT_START | CHAR_IDENT;
+        for (int c = '0'; c <= '9'; c++) classes[c] = CHAR_IDENT | CHAR_NUMBER;
+
+        classes[(unsigned char)'_'] = CHAR_IDENT_START | CHAR_IDENT;
+        classes[(unsigned char)'.'] = CHAR_NUMBER;
     }
+};
+
+static const Char_Class_Table char_class_table;
 
-    tokens.push_back(new Token(Token::Type::END_OF_FILE, "EOF", new Code_Site(file_name, line_number, column_position)));
-    this->tokens = tokens;
+static inline bool is_char_class(char c, int char_class) {
+    return (char_class_table.classes[(unsigned char)c] & char_class) != 0;
 }
 
-void Lexer::consume_comment() {
-    // @SPEED(LOW) Creating new string every character after comment found
-    while (std::string(1, file_string.at(index)) != "\n") {
-        move_next_char();
+struct Keyword {
+    const char *text;
+    unsigned int length;
+    Token::Type type;
+    int flags;
+};
+
+static const Keyword keywords[] = {
+    { "if",     2, Token::Type::KEYWORD_IF,                Token::Flags::KEYWORD },
+    { "elif",   4, Token::Type::KEYWORD_ELIF,              Token::Flags::KEYWORD },
+    { "else",   4, Token::Type::KEYWORD_ELSE,              Token::Flags::KEYWORD },
+    { "while",  5, Token::Type::KEYWORD_WHILE,             Token::Flags::KEYWORD },
+    { "return", 6, Token::Type::KEYWORD_RETURN,            Token::Flags::KEYWORD },
+    { "num",    3, Token::Type::KEYWORD_NUM,               Token::Flags::KEYWORD | Token::Flags::DATA_TYPE },
+    { "str",    3, Token::Type::KEYWORD_STR,               Token::Flags::KEYWORD | Token::Flags::DATA_TYPE },
+    { "bool",   4, Token::Type::KEYWORD_BOOL,              Token::Flags::KEYWORD | Token::Flags::DATA_TYPE },
+    { "arr",    3, Token::Type::KEYWORD_ARRAY,             Token::Flags::KEYWORD | Token::Flags::DATA_TYPE },
+    { "void",   4, Token::Type::KEYWORD_VOID,              Token::Flags::KEYWORD | Token::Flags::DATA_TYPE },
+    { "shel",   4, Token::Type::KEYWORD_STRUCT,            Token::Flags::KEYWORD },
+    { "bug",    3, Token::Type::KEYWORD_FUNCTION,          Token::Flags::KEYWORD },
+    { "now",    3, Token::Type::KEYWORD_REASSIGN_VARIABLE, Token::Flags::KEYWORD },
+    { "from",   4, Token::Type::KEYWORD_LOOP_START,        Token::Flags::KEYWORD },
+    { "to",     2, Token::Type::KEYWORD_LOOP_TO,           Token::Flags::KEYWORD },
+    { "step",   4, Token::Type::KEYWORD_LOOP_STEP,         Token::Flags::KEYWORD },
+    { "par",    3, Token::Type::KEYWORD_PARALLEL,          Token::Flags::KEYWORD },
+    { "reduce", 6, Token::Type::KEYWORD_REDUCE,            Token::Flags::KEYWORD },
+    { "true",   4, Token::Type::KEYWORD_TRUE,              Token::Flags::KEYWORD },
+    { "false",  5, Token::Type::KEYWORD_FALSE,             Token::Flags::KEYWORD },
+    { "and",    3, Token::Type::LOGICAL_AND,               Token::Flags::LOGICAL },
+    { "or",     2, Token::Type::LOGICAL_OR,                Token::Flags::LOGICAL },
+    { "not",    3, Token::Type::LOGICAL_NOT,               Token::Flags::LOGICAL | Token::Flags::RIGHT_TO_LEFT },
+};
+
+static const unsigned int KEYWORD_SLOTS = 64;
+static const unsigned int KEYWORD_MIN_LENGTH = 2;
+static const unsigned int KEYWORD_MAX_LENGTH = 6;
+
+// Perfect hash for the keyword set above, so recognising a keyword costs one
+// table lookup and a single compare. Any new keyword has to keep it collision
+// free, which is checked when the table is built.
+static inline unsigned int keyword_hash(const char *text, unsigned int length) {
+    return ((unsigned char)text[0] + (unsigned char)text[length - 1] * 6 + length * 7) & (KEYWORD_SLOTS - 1);
+}
+
+struct Keyword_Table {
+    const Keyword *slots[KEYWORD_SLOTS];
+
+    Keyword_Table() {
+        memset(slots, 0, sizeof(slots));
+
+        for (const Keyword &keyword : keywords) {
+            unsigned int hash = keyword_hash(keyword.text, keyword.length);
+
+            if (slots[hash] != NULL) report_fatal_error("Keyword hash collision between '" + std::string(keyword.text) + "' and '" + slots[hash]->text + "'");
+            slots[hash] = &keyword;
+        }
+    }
+
+    const Keyword *find(const char *text, unsigned int length) const {
+        if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH) return NULL;
+
+        const Keyword *keyword = slots[keyword_hash(text, length)];
+
+        if (keyword == NULL || keyword->length != length || memcmp(keyword->text, text, length) != 0) return NULL;
+        return keyword;
     }
+};
+
+static const Keyword_Table keyword_table;
 
-    move_next_line();
+static std::vector<Source_File> source_files;
+
+unsigned int register_source_file(const std::string &name, const std::string *text) {
+    Source_File file;
+    file.name = name;
+    file.text = text;
+    source_files.push_back(file);
+
+    return source_files.size() - 1;
+}
+
+void release_source_file(unsigned int file_id) {
+    source_files[file_id].text = NULL;
 }
 
-void Lexer::move_next_chars(unsigned int jump) {
-    index += jump;
-    column_position += jump;
+Source_File *get_source_file(unsigned int file_id) {
+    return file_id < source_files.size() ? &source_files[file_id] : NULL;
+}
+
+void Lexer::lex() {
+    const char *source = file_string.data();
+    size_t file_size = file_string.size();
+
+    // Offsets are stored as 32 bits
+    if (file_size > UINT32_MAX) report_fatal_error("Cannot lex " + file_name + ", source files must be smaller than 4GB");
+
+    tokens.file_id = file_id;
+    tokens.source = source;
+
+    // The arena never hands memory back, so avoid regrowing the token stream too often
+    tokens.reserve(file_size / 4 + 1);
+
+    while (index < file_size) {
+        char curr = source[index];
+
+        if (is_char_class(curr, CHAR_SPACE)) { index++; continue; }
+        else if (curr == '#')                { consume_comment(); continue; }
+
+        bool is_next_equals = peek_next_char() == '=';
+        bool is_lexed = true;
+
+        switch (curr) {
+            case '=': is_next_equals ? lex_chars(Token::Type::COMPARE_EQUALS, 2, Token::Flags::COMPARISON)
+                                     : lex_chars(Token::Type::OP_ASSIGNMENT, 1, Token::Flags::OPERATOR); break;
+            case '+': is_next_equals ? lex_chars(Token::Type::OP_PLUS_EQUALS, 2, Token::Flags::OPERATOR)
+                                     : lex_chars(Token::Type::OP_PLUS, 1, Token::Flags::OPERATOR); break;
+            case '-': is_next_equals ? lex_chars(Token::Type::OP_MINUS_EQUALS, 2, Token::Flags::OPERATOR)
+                                     : lex_chars(Token::Type::OP_MINUS, 1, Token::Flags::OPERATOR); break;
+            case '*': is_next_equals ? lex_chars(Token::Type::OP_MULTIPLY_EQUALS, 2, Token::Flags::OPERATOR)
+                                     : lex_chars(Token::Type::OP_MULTIPLY, 1, Token::Flags::OPERATOR); break;
+            case '/': is_next_equals ? lex_chars(Token::Type::OP_DIVIDE_EQUALS, 2, Token::Flags::OPERATOR)
+                                     : lex_chars(Token::Type::OP_DIVIDE, 1, Token::Flags::OPERATOR); break;
+            case '%': is_next_equals ? lex_chars(Token::Type::OP_MODULO_EQUALS, 2, Token::Flags::OPERATOR)
+                                     : lex_chars(Token::Type::OP_MODULO, 1, Token::Flags::OPERATOR); break;
+            case '^': is_next_equals ? lex_chars(Token::Type::OP_EXPONENT_EQUALS, 2, Token::Flags::OPERATOR)
+                                     : lex_chars(Token::Type::OP_EXPONENT, 1, Token::Flags::OPERATOR); break;
+            case '<': is_next_equals ? lex_chars(Token::Type::COMPARE_LESS_THAN_EQUALS, 2, Token::Flags::COMPARISON)
+                                     : lex_chars(Token::Type::COMPARE_LESS_THAN, 1, Token::Flags::COMPARISON); break;
+            case '>': is_next_equals ? lex_chars(Token::Type::COMPARE_GREATER_THAN_EQUALS, 2, Token::Flags::COMPARISON)
+                                     : lex_chars(Token::Type::COMPARE_GREATER_THAN, 1, Token::Flags::COMPARISON); break;
+            case '!': if (is_next_equals) lex_chars(Token::Type::COMPARE_NOT_EQUALS, 2, Token::Flags::COMPARISON); else is_lexed = false; break;
+
+            case '(': lex_chars(Token::Type::L_PAREN, 1); break;
+            case ')': lex_chars(Token::Type::R_PAREN, 1); break;
+            case '{': lex_chars(Token::Type::L_BRACE, 1); break;
+            case '}': lex_chars(Token::Type::R_BRACE, 1); break;
+            case '[': lex_chars(Token::Type::L_ARRAY, 1); break;
+            case ']': lex_chars(Token::Type::R_ARRAY, 1); break;
+            case ';': lex_chars(Token::Type::TERMINATOR, 1); break;
+            case ',': lex_chars(Token::Type::ARGUMENT_SEPARATOR, 1); break;
+
+            case '"': push_token(Token::Type::STRING, scan_string(), Token::Flags::LITERAL); break;
+
+            default:
+                if (is_char_class(curr, CHAR_NUMBER))           push_token(Token::Type::NUMBER, scan_number(), Token::Flags::LITERAL);
+                else if (is_char_class(curr, CHAR_IDENT_START)) push_ident_token(scan_ident());
+                else                                            is_lexed = false;
+                break;
+        }
+
+        if (is_lexed == false) {
+            std::stringstream ss;
+            ss << "Cannot lex character: " << curr;
+            report_fatal_error(ss.str(), Code_Site { file_id, index });
+        }
+    }
+
+    Source_Slice end = { index, 0 };
+    push_token(Token::Type::END_OF_FILE, end, Token::Flags::NONE);
 }
 
-void Lexer::move_next_char() {
-    move_next_chars(1);
+void Lexer::push_token(Token::Type type, Source_Slice slice, int flags) {
+    tokens.push(type, flags, slice.offset, slice.length);
 }
 
-void Lexer::move_next_line() {
-    index++;
-    line_number++;
-    column_position = 1;
+void Lexer::lex_chars(Token::Type type, unsigned int length, int flags) {
+    Source_Slice slice = { index, length };
+    index += length;
+    push_token(type, slice, flags);
 }
 
-std::string Lexer::peek_next_chars(unsigned int jump) {
-    unsigned int next = index + jump;
+void Lexer::push_ident_token(Source_Slice slice) {
+    const Keyword *keyword = keyword_table.find(file_string.data() + slice.offset, slice.length);
 
-    if (index >= file_string.size()) return NULL;
-    return std::string(1, file_string.at(next));
+    if (keyword != NULL) push_token(keyword->type, slice, keyword->flags);
+    else push_token(Token::Type::IDENT, slice, Token::Flags::NONE);
 }
 
-std::string Lexer::peek_next_char() {
-    return peek_next_chars(1);
+void Lexer::consume_comment() {
+    const char *end = (const char *)memchr(file_string.data() + index, '\n', file_string.size() - index);
+
+    index = end != NULL ? end - file_string.data() + 1 : file_string.size();
 }
 
-std::string Lexer::scan_string(Code_Site *site, const std::string input, const std::regex end_match) {
-    std::string ret = "";
-    int i = 0;
-    const size_t input_size = input.size();
+char Lexer::peek_next_char() {
+    return index + 1 < file_string.size() ? file_string[index + 1] : '\0';
+}
 
-    while (i < input_size && std::regex_match(std::string(1, input.at(i)), end_match) == false) {
-        ret.append(std::string(1, input.at(i)));
+// Expects to be sitting on the opening quote, leaves the lexer after the closing one
+Source_Slice Lexer::scan_string() {
+    Code_Site site = { file_id, index };
+    unsigned int start = index + 1;
+    const char *end = (const char *)memchr(file_string.data() + start, '"', file_string.size() - start);
 
-        if (i >= input_size)
-            report_fatal_error("String didn't terminate before end of file!");
+    if (end == NULL) report_fatal_error("String didn't terminate before end of file!", site);
 
-        i++;
-    }
+    Source_Slice slice = { start, (unsigned int)(end - file_string.data()) - start };
+    index = start + slice.length + 1;
 
-    return ret;
+    return slice;
 }
 
-std::string Lexer::scan_other(Code_Site *site, const std::string input, const std::regex end_match) {
-    std::string ret = "";
-    int i = 0;
-    const size_t input_size = input.size();
+Source_Slice Lexer::scan_number() {
+    const char *source = file_string.data();
+    size_t file_size = file_string.size();
+    unsigned int end = index;
 
-    while (i < input_size && std::regex_match(std::string(1, input.at(i)), end_match) == false) {
-        ret.append(std::string(1, input.at(i)));
-        i++;
-    }
+    while (end < file_size && is_char_class(source[end], CHAR_NUMBER)) end++;
 
-    return ret;
+    Source_Slice slice = { index, end - index };
+    index = end;
+
+    return slice;
 }
 
-Token *Lexer::scan_ident(Code_Site *site, const std::string input, const std::regex end_match) {
-    std::string raw = scan_other(site, input, end_match);
-
-    if (raw == "if")          return new Token(Token::Type::KEYWORD_IF, "if", site, Token::Flags::KEYWORD);
-    else if (raw == "elif")   return new Token(Token::Type::KEYWORD_ELIF, "elif", site, Token::Flags::KEYWORD);
-    else if (raw == "else")   return new Token(Token::Type::KEYWORD_ELSE, "else", site, Token::Flags::KEYWORD);
-    else if (raw == "while")  return new Token(Token::Type::KEYWORD_WHILE, "while", site, Token::Flags::KEYWORD);
-    else if (raw == "return") return new Token(Token::Type::KEYWORD_RETURN, "return", site, Token::Flags::KEYWORD);
-    else if (raw == "num")    return new Token(Token::Type::KEYWORD_NUM, "num", site, Token::Flags::KEYWORD | Token::Flags::DATA_TYPE);
-    else if (raw == "str")    return new Token(Token::Type::KEYWORD_STR, "str", site, Token::Flags::KEYWORD | Token::Flags::DATA_TYPE);
-    else if (raw == "bool")   return new Token(Token::Type::KEYWORD_BOOL, "bool", site, Token::Flags::KEYWORD | Token::Flags::DATA_TYPE);
-    else if (raw == "arr")    return new Token(Token::Type::KEYWORD_ARRAY, "arr", site, Token::Flags::KEYWORD | Token::Flags::DATA_TYPE);
-    else if (raw == "void")   return new Token(Token::Type::KEYWORD_VOID, "void", site, Token::Flags::KEYWORD | Token::Flags::DATA_TYPE);
-    else if (raw == "shel")   return new Token(Token::Type::KEYWORD_STRUCT, "shel", site, Token::Flags::KEYWORD);
-    else if (raw == "bug")    return new Token(Token::Type::KEYWORD_FUNCTION, "bug", site, Token::Flags::KEYWORD);
-    else if (raw == "now")    return new Token(Token::Type::KEYWORD_REASSIGN_VARIABLE, "now", site, Token::Flags::KEYWORD);
-    else if (raw == "from")   return new Token(Token::Type::KEYWORD_LOOP_START, "from", site, Token::Flags::KEYWORD);
-    else if (raw == "to")     return new Token(Token::Type::KEYWORD_LOOP_TO, "to", site, Token::Flags::KEYWORD);
-    else if (raw == "step")   return new Token(Token::Type::KEYWORD_LOOP_STEP, "step", site, Token::Flags::KEYWORD);
-    else if (raw == "true")   return new Token(Token::Type::KEYWORD_TRUE, "true", site, Token::Flags::KEYWORD);
-    else if (raw == "false")  return new Token(Token::Type::KEYWORD_FALSE, "false", site, Token::Flags::KEYWORD);
-    else if (raw == "and")    return new Token(Token::Type::LOGICAL_AND, "and", site, Token::Flags::LOGICAL);
-    else if (raw == "or")     return new Token(Token::Type::LOGICAL_OR, "or", site, Token::Flags::LOGICAL);
-    else if (raw == "not")    return new Token(Token::Type::LOGICAL_NOT, "not", site, Token::Flags::LOGICAL | Token::Flags::RIGHT_TO_LEFT);
-    else                      return new Token(Token::Type::IDENT, raw, site);
+Source_Slice Lexer::scan_ident() {
+    const char *source = file_string.data();
+    size_t file_size = file_string.size();
+    unsigned int end = index;
+
+    while (end < file_size && is_char_class(source[end], CHAR_IDENT)) end++;
+
+    Source_Slice slice = { index, end - index };
+    index = end;
+
+    return slice;
 }
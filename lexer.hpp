@@ -1,54 +1,32 @@
 #ifndef LEXER_H
 #define LEXER_H
 
-#include <regex>
+#include <cstdint>
 #include <string>
 #include <vector>
+#include "arena.hpp"
 
-struct Code_Site;
-struct Token;
-
-struct Lexer {
-    std::vector<Token *> tokens;
-    std::string file_name;
-    std::string file_string;
-
-    unsigned int index = 0;
-    unsigned int line_number = 1;
-    unsigned int column_position = 1;
-
-    Lexer(const std::string file_name, const std::string file_string) {
-        this->file_name = file_name;
-        this->file_string = file_string;
-    }
-
-    std::string scan_string(Code_Site *site, const std::string input, const std::regex end_match);
-    std::string scan_other(Code_Site *site, const std::string input, const std::regex end_match);
-    Token *scan_ident(Code_Site *site, const std::string input, const std::regex end_match);
-    void lex();
-    void consume_comment();
-    void move_next_char();
-    void move_next_chars(unsigned int jump);
-    void move_next_line();
-    std::string peek_next_chars(unsigned int jump);
-    std::string peek_next_char();
+// A position in a registered source file. Line and column are only worked
+// out from the offset when an error actually needs to be reported.
+struct Code_Site {
+    unsigned int file_id;
+    unsigned int offset;
 };
 
-struct Code_Site {
-    std::string file_name;
-    unsigned int line_number;
-    unsigned int column_position;
+struct Source_File {
+    std::string name;
 
-    Code_Site(std::string file_name, unsigned int line_number, unsigned int column_position) {
-        this->file_name = file_name;
-        this->line_number = line_number;
-        this->column_position = column_position;
-    }
+    // Owned by the lexer of the compilation unit, NULL once the unit is gone
+    const std::string *text;
 };
 
+unsigned int register_source_file(const std::string &name, const std::string *text);
+void release_source_file(unsigned int file_id);
+Source_File *get_source_file(unsigned int file_id);
+
 struct Token {
     enum Type {
-        KEYWORD_IF, KEYWORD_ELIF, KEYWORD_ELSE, KEYWORD_WHILE, KEYWORD_LOOP_START, KEYWORD_LOOP_TO, KEYWORD_LOOP_STEP, KEYWORD_RETURN,
+        KEYWORD_IF, KEYWORD_ELIF, KEYWORD_ELSE, KEYWORD_WHILE, KEYWORD_LOOP_START, KEYWORD_LOOP_TO, KEYWORD_LOOP_STEP, KEYWORD_PARALLEL, KEYWORD_REDUCE, KEYWORD_RETURN,
         KEYWORD_STRUCT, KEYWORD_FUNCTION, KEYWORD_REASSIGN_VARIABLE, KEYWORD_TRUE, KEYWORD_FALSE,
         KEYWORD_NUM, KEYWORD_STR, KEYWORD_BOOL, KEYWORD_ARRAY, KEYWORD_VOID,
         L_PAREN, R_PAREN, L_BRACE, R_BRACE, L_ARRAY, R_ARRAY, ARGUMENT_SEPARATOR,
@@ -73,16 +51,98 @@ struct Token {
     };
 
     Token::Type type;
-    std::string value;
-    Code_Site *site;
-    unsigned int flags = 0;
-
-    Token(Token::Type type, std::string value, Code_Site *site, int flags = Token::Flags::NONE) {
-        this->type = type;
-        this->value = value;
-        this->site = site;
-        this->flags |= flags;
+    unsigned int flags;
+    Code_Site site;
+
+    // Points straight into the lexer's source buffer, the text is only copied
+    // out when the parser actually needs it
+    const char *text;
+    unsigned int length;
+
+    std::string value() const {
+        return std::string(text, length);
+    }
+};
+
+// Tokens are stored column-wise at 11 bytes each, and only expanded into a
+// Token when the parser asks for one
+struct Token_Stream {
+    unsigned int file_id;
+    const char *source;
+
+    Arena_Vector<uint8_t> types;
+    Arena_Vector<uint16_t> flags;
+    Arena_Vector<uint32_t> offsets;
+    Arena_Vector<uint32_t> lengths;
+
+    Token_Stream(Arena *arena) : types(Arena_Allocator<uint8_t>(arena)), flags(Arena_Allocator<uint16_t>(arena)),
+            offsets(Arena_Allocator<uint32_t>(arena)), lengths(Arena_Allocator<uint32_t>(arena)) {
+        this->file_id = 0;
+        this->source = NULL;
     }
+
+    size_t size() const {
+        return types.size();
+    }
+
+    void reserve(size_t count) {
+        types.reserve(count);
+        flags.reserve(count);
+        offsets.reserve(count);
+        lengths.reserve(count);
+    }
+
+    void push(Token::Type type, unsigned int token_flags, unsigned int offset, unsigned int length) {
+        types.push_back((uint8_t)type);
+        flags.push_back((uint16_t)token_flags);
+        offsets.push_back(offset);
+        lengths.push_back(length);
+    }
+
+    Token at(size_t index) const {
+        Token token;
+        token.type = (Token::Type)types[index];
+        token.flags = flags[index];
+        token.site.file_id = file_id;
+        token.site.offset = offsets[index];
+        token.text = source + offsets[index];
+        token.length = lengths[index];
+
+        return token;
+    }
+};
+
+// Region of the lexer's source buffer, as returned by the scan_* functions
+struct Source_Slice {
+    unsigned int offset;
+    unsigned int length;
+};
+
+struct Lexer {
+    Arena *arena;
+    Token_Stream tokens;
+    std::string file_name;
+    std::string file_string;
+    unsigned int file_id;
+
+    unsigned int index = 0;
+
+    Lexer(const std::string &file_name, const std::string &file_string, Arena *arena) : tokens(arena) {
+        this->arena = arena;
+        this->file_name = file_name;
+        this->file_string = file_string;
+        this->file_id = register_source_file(this->file_name, &this->file_string);
+    }
+
+    Source_Slice scan_string();
+    Source_Slice scan_number();
+    Source_Slice scan_ident();
+    void push_token(Token::Type type, Source_Slice slice, int flags);
+    void lex_chars(Token::Type type, unsigned int length, int flags = Token::Flags::NONE);
+    void push_ident_token(Source_Slice slice);
+    void lex();
+    void consume_comment();
+    char peek_next_char();
 };
 
 // @ROBUSTNESS(MEDIUM) @HACK Token::Type name maintenance nightmare
@@ -97,6 +157,8 @@ inline const std::string type_to_string(Token::Type type) {
         case Token::Type::KEYWORD_LOOP_START: return "KEYWORD_LOOP_START";
         case Token::Type::KEYWORD_LOOP_TO: return "KEYWORD_LOOP_TO";
         case Token::Type::KEYWORD_LOOP_STEP: return "KEYWORD_LOOP_STEP";
+        case Token::Type::KEYWORD_PARALLEL: return "KEYWORD_PARALLEL";
+        case Token::Type::KEYWORD_REDUCE: return "KEYWORD_REDUCE";
         case Token::Type::KEYWORD_RETURN: return "KEYWORD_RETURN";
         case Token::Type::KEYWORD_STRUCT: return "KEYWORD_STRUCT";
         case Token::Type::KEYWORD_FUNCTION: return "KEYWORD_FUNCTION";
@@ -1,29 +1,44 @@
 #include <cstdlib>
 #include <iostream>
-#include <fstream>
+#include <mutex>
 #include <sstream>
 
 #include "lexer.hpp"
+#include "output.hpp"
 
 void report_fatal_error(std::string error);
 
-std::string get_line_by_number(Code_Site *site) {
-    std::ifstream in_file(site->file_name);
+// Held until exit, so threads in a par loop that fail at once don't interleave
+// their reports and only the first one is shown
+static std::recursive_mutex fatal_error_lock;
 
-    if (!in_file) {
-        std::stringstream error;
-        error << "Cannot open: " << site->file_name;
-        report_fatal_error(error.str());
-        return "";
-    }
+struct Source_Location {
+    unsigned int line_number;
+    unsigned int column_position;
+    std::string line_string;
+};
+
+// Sites only store a byte offset, so the line and column are recovered by
+// counting newlines up to it. Only ever done once, right before exiting.
+Source_Location locate_site(const std::string &text, unsigned int offset) {
+    Source_Location location;
+    size_t line_start = 0;
 
-    std::string ret;
+    location.line_number = 1;
 
-    for (int i = 0; i < site->line_number; i++) {
-        std::getline(in_file, ret);
+    for (size_t i = 0; i < offset && i < text.size(); i++) {
+        if (text[i] == '\n') {
+            location.line_number++;
+            line_start = i + 1;
+        }
     }
 
-    return ret;
+    size_t line_end = text.find('\n', line_start);
+
+    location.column_position = offset - line_start + 1;
+    location.line_string = text.substr(line_start, line_end == std::string::npos ? std::string::npos : line_end - line_start);
+
+    return location;
 }
 
 std::string get_column_marker(std::string line, int column) {
@@ -34,6 +49,11 @@ std::string get_column_marker(std::string line, int column) {
 }
 
 void report_fatal_error(std::string error) {
+    fatal_error_lock.lock();
+
+    // Anything the script printed before failing comes out ahead of the error
+    flush_output();
+
     // @TODO(MEDIUM) Type of fatal error - LEXING, PARSING, INTERPRETING
     std::cerr << "[FATAL ERROR] " << error << std::endl;
     std::cerr << "Exiting..." << std::endl;
@@ -41,14 +61,24 @@ void report_fatal_error(std::string error) {
     exit(0);
 }
 
-void report_fatal_error(std::string error, Code_Site *site) {
-    std::string line_of_error;
-    std::string line_string = get_line_by_number(site);
+void report_fatal_error(std::string error, Code_Site site) {
+    fatal_error_lock.lock();
+    flush_output();
+
+    Source_File *file = get_source_file(site.file_id);
+
+    if (file == NULL || file->text == NULL) {
+        std::stringstream ss;
+        ss << "in " << (file != NULL ? file->name : "unknown file") << " at byte " << site.offset << ": " << error;
+        report_fatal_error(ss.str());
+    }
+
+    Source_Location location = locate_site(*file->text, site.offset);
 
-    std::cerr << "[FATAL ERROR] in " << site->file_name << " at line " << site->line_number << ", column " << site->column_position << ": " << error << std::endl;
+    std::cerr << "[FATAL ERROR] in " << file->name << " at line " << location.line_number << ", column " << location.column_position << ": " << error << std::endl;
     std::cerr << std::endl;
-    std::cerr << line_string << std::endl;
-    std::cerr << get_column_marker(line_string, site->column_position) << std::endl;
+    std::cerr << location.line_string << std::endl;
+    std::cerr << get_column_marker(location.line_string, location.column_position) << std::endl;
     std::cerr << std::endl;
     std::cerr << "Exiting..." << std::endl;
 
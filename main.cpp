@@ -2,10 +2,20 @@
 #include <fstream>
 #include <sstream>
 
+#include "cache.hpp"
+#include "closure.hpp"
+#include "gc.hpp"
+#include "jit.hpp"
 #include "lexer.hpp"
 #include "logger.hpp"
+#include "memo.hpp"
+#include "output.hpp"
+#include "par.hpp"
 #include "parser.hpp"
+#include "profile.hpp"
 #include "interp.hpp"
+#include "unit.hpp"
+#include "vm.hpp"
 
 std::string file_to_string(std::string file_name) {
     std::ifstream in_file(file_name);
@@ -22,35 +32,101 @@ std::string file_to_string(std::string file_name) {
     return sstr.str();
 }
 
-void print_tokens(std::vector<Token *> tokens) {
+void print_tokens(const Token_Stream &tokens) {
     const int padding = 4;
     int longest_token_type = 0;
 
     // @CLEANUP(LOW) More functional style max string length from vector
-    for (Token *token : tokens) {
-        int type_len = type_to_string(token->type).size();
+    for (size_t i = 0; i < tokens.size(); i++) {
+        int type_len = type_to_string(tokens.at(i).type).size();
         if (type_len > longest_token_type) longest_token_type = type_len;
     }
 
-    for (Token *token : tokens) {
-        std::string type_string = type_to_string(token->type);
+    for (size_t i = 0; i < tokens.size(); i++) {
+        Token token = tokens.at(i);
+        std::string type_string = type_to_string(token.type);
         int type_padding = longest_token_type - type_string.size() + padding;
         std::string padding_spaces(type_padding, ' ');
-        std::cout << "TYPE: " << type_to_string(token->type) << padding_spaces << " VALUE: " << token->value << std::endl;
+        std::cout << "TYPE: " << type_to_string(token.type) << padding_spaces << " VALUE: " << token.value() << std::endl;
     }
 }
 
 int main(int argc, char *argv[]) {
     // @ROBUSTNESS(LOW) Improve argv control/robustness
-    std::string in_file_name = argc > 1 ? argv[1] : "examples/project_euler_2.shel";
+    std::string in_file_name = "examples/project_euler_2.shel";
+    std::string engine = "walk";
+    std::string jit = "on";
+    bool is_reporting_gc_stats = false;
+    bool is_reporting_jit_stats = false;
+    bool is_reporting_lex_stats = false;
+    bool is_reporting_memo_stats = false;
+    bool is_reporting_quicken_stats = false;
+    bool is_dumping_ast = false;
+    std::string profile_path;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg.compare(0, 9, "--engine=") == 0) engine = arg.substr(9);
+        else if (arg.compare(0, 6, "--jit=") == 0) jit = arg.substr(6);
+        else if (arg == "--gc-stats") is_reporting_gc_stats = true;
+        else if (arg == "--jit-stats") is_reporting_jit_stats = true;
+        else if (arg == "--lex-stats") is_reporting_lex_stats = true;
+        else if (arg == "--memo-stats") is_reporting_memo_stats = true;
+        else if (arg == "--quicken-stats") is_reporting_quicken_stats = true;
+        else if (arg.compare(0, 10, "--threads=") == 0) set_par_thread_count(atoi(arg.c_str() + 10));
+        else if (arg.compare(0, 12, "--cache-dir=") == 0) set_cache_dir(arg.substr(12));
+        else if (arg == "--no-cache") set_cache_dir("");
+        else if (arg == "--profile") profile_path = "shel.folded";
+        else if (arg.compare(0, 10, "--profile=") == 0) profile_path = arg.substr(10);
+        else if (arg == "--dump-ast") is_dumping_ast = true;
+        else in_file_name = arg;
+    }
+
+    if (jit == "off") set_jit_mode(JIT_OFF);
+    else if (jit == "on") set_jit_mode(JIT_ON);
+    else if (jit == "eager") set_jit_mode(JIT_EAGER);
+    else report_fatal_error("Unknown JIT mode '" + jit + "', expected 'off', 'on' or 'eager'");
+
     std::string file_string = file_to_string(in_file_name);
 
-    auto *lexer = new Lexer(in_file_name, file_string);
-    lexer->lex();
-    auto *parser = new Parser(lexer->tokens, Token::Type::END_OF_FILE);
+    auto *unit = new Compilation_Unit(in_file_name);
+    unit->compile(file_string);
+
+    if (is_reporting_lex_stats) report_lex_stats(unit);
+
+    if (is_dumping_ast) {
+        print_ast(unit->root, 0);
+        std::cout << "(" << unit->folded_count << " nodes folded)" << std::endl;
+        return 0;
+    }
+
+    if (profile_path.empty() == false) start_profiler();
+
+    // The tree walker is kept as the reference engine. The VM and the closure
+    // engine give the same results, except that a comparison used as a value
+    // has its operands evaluated once where the walker evaluates them twice,
+    // and a few runtime errors are worded differently in the VM.
+    if (engine == "walk") {
+        auto *interp = new Interpreter(unit);
+        interp->interpret();
+    } else if (engine == "vm") {
+        auto *vm = new VM(unit);
+        vm->interpret();
+    } else if (engine == "closure") {
+        auto *closures = new Closure_Engine(unit);
+        closures->interpret();
+    } else {
+        report_fatal_error("Unknown engine '" + engine + "', expected 'walk', 'vm' or 'closure'");
+    }
+
+    flush_output();
 
-    auto *interp = new Interpreter(parser);
-    interp->interpret();
+    if (is_reporting_gc_stats) report_gc_stats();
+    if (is_reporting_memo_stats) report_memo_stats(unit->memoized);
+    if (is_reporting_jit_stats) report_jit_stats();
+    if (is_reporting_quicken_stats) report_quicken_stats();
+    if (profile_path.empty() == false) report_profile(profile_path);
 
     do {
         std::cout << "Press a key to continue...";
@@ -0,0 +1,256 @@
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+
+#include "memo.hpp"
+
+static uint64_t hash_value(Value value) {
+    uint32_t bits = 0;
+
+    if (value.data_type == Data_Type::NUM) {
+        memcpy(&bits, &value.num, sizeof(bits));
+    } else {
+        bits = value.boolean;
+    }
+
+    return ((uint64_t)value.data_type << 32) | bits;
+}
+
+// Nums are compared bitwise, so 0 and -0 are separate keys and NaN never hits
+static bool is_same_key(Value a, Value b) {
+    return hash_value(a) == hash_value(b);
+}
+
+static int get_bucket(const Value *args, int arity) {
+    uint64_t hash = 0;
+
+    // Small whole nums only differ in the high bits of the float, so every
+    // arg goes through the splitmix64 finalizer to spread them over the buckets
+    for (int i = 0; i < arity; i++) {
+        hash += hash_value(args[i]) + 0x9e3779b97f4a7c15ULL;
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+        hash ^= hash >> 31;
+    }
+
+    return hash & (Memo_Table::BUCKET_COUNT - 1);
+}
+
+bool Memo_Table::lookup(const Value *args, Value *result) {
+    if (results.empty()) {
+        misses++;
+        return false;
+    }
+
+    int bucket = get_bucket(args, arity);
+
+    if (results[bucket].data_type == Data_Type::VOID) {
+        misses++;
+        return false;
+    }
+
+    for (int i = 0; i < arity; i++) {
+        if (is_same_key(keys[bucket * arity + i], args[i]) == false) {
+            misses++;
+            return false;
+        }
+    }
+
+    hits++;
+    *result = results[bucket];
+    return true;
+}
+
+void Memo_Table::insert(const Value *args, Value result) {
+    if (results.empty()) {
+        keys.resize(BUCKET_COUNT * arity);
+        results.resize(BUCKET_COUNT);
+    }
+
+    int bucket = get_bucket(args, arity);
+
+    if (results[bucket].data_type == Data_Type::VOID) {
+        entries++;
+    } else {
+        evictions++;
+    }
+
+    for (int i = 0; i < arity; i++) keys[bucket * arity + i] = args[i];
+    results[bucket] = result;
+}
+
+void Memoizer::memoize(Ast_Block *root) {
+    std::vector<Ast_Function_Definition *> functions;
+    collect_functions(root, &functions);
+
+    std::unordered_map<Ast_Function_Definition *, std::vector<Ast_Function_Definition *>> callees;
+    std::unordered_map<Ast_Function_Definition *, bool> is_pure;
+
+    for (Ast_Function_Definition *def : functions) {
+        is_pure[def] = is_candidate(def) && is_block_pure(def->block, 0, &callees[def]);
+    }
+
+    // A bug stops being pure as soon as anything it calls isn't
+    bool is_changed = true;
+
+    while (is_changed) {
+        is_changed = false;
+
+        for (Ast_Function_Definition *def : functions) {
+            if (is_pure[def] == false) continue;
+
+            for (Ast_Function_Definition *callee : callees[def]) {
+                if (is_pure[callee]) continue;
+
+                is_pure[def] = false;
+                is_changed = true;
+                break;
+            }
+        }
+    }
+
+    for (Ast_Function_Definition *def : functions) {
+        if (is_pure[def] == false) continue;
+
+        def->memo = arena->make<Memo_Table>(def->args.size());
+        memoized.push_back(def);
+    }
+}
+
+void Memoizer::collect_functions(Ast_Block *block, std::vector<Ast_Function_Definition *> *functions) {
+    for (Ast_Node *child : block->children) {
+        switch (child->node_type) {
+            case Ast_Node::Type::BLOCK:
+                collect_functions((Ast_Block *)child, functions);
+                break;
+            case Ast_Node::Type::IF:
+                for (auto *if_node = (Ast_If *)child; if_node != NULL; if_node = if_node->failure) {
+                    collect_functions(if_node->success, functions);
+                }
+                break;
+            case Ast_Node::Type::WHILE:
+                collect_functions(((Ast_While *)child)->body, functions);
+                break;
+            case Ast_Node::Type::LOOP:
+                collect_functions(((Ast_Loop *)child)->body, functions);
+                break;
+            case Ast_Node::Type::FUNCTION_DEFINITION: {
+                auto *def = (Ast_Function_Definition *)child;
+                functions->push_back(def);
+                collect_functions(def->block, functions);
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+bool Memoizer::is_candidate(Ast_Function_Definition *def) {
+    if (def->data_type != Data_Type::NUM && def->data_type != Data_Type::BOOL) return false;
+
+    for (Ast_Variable *arg : def->args) {
+        if (arg->data_type != Data_Type::NUM && arg->data_type != Data_Type::BOOL) return false;
+    }
+
+    return true;
+}
+
+// depth counts the scopes opened between the bug's own scope and the node,
+// so a variable bound more than depth hops up lives outside the bug
+bool Memoizer::is_block_pure(Ast_Block *block, int depth, std::vector<Ast_Function_Definition *> *callees) {
+    for (Ast_Node *child : block->children) {
+        if (is_statement_pure(child, depth, callees) == false) return false;
+    }
+
+    return true;
+}
+
+bool Memoizer::is_statement_pure(Ast_Node *node, int depth, std::vector<Ast_Function_Definition *> *callees) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BLOCK:
+            return is_block_pure((Ast_Block *)node, depth, callees);
+        case Ast_Node::Type::RETURN:
+            return is_expression_pure(((Ast_Return *)node)->value, depth, callees);
+        case Ast_Node::Type::IF: {
+            for (auto *if_node = (Ast_If *)node; if_node != NULL; if_node = if_node->failure) {
+                if (if_node->comparison != NULL && is_expression_pure(if_node->comparison, depth, callees) == false) return false;
+                if (is_block_pure(if_node->success, depth + 1, callees) == false) return false;
+            }
+
+            return true;
+        }
+        case Ast_Node::Type::WHILE: {
+            auto *while_node = (Ast_While *)node;
+            return is_expression_pure(while_node->comparison, depth, callees) && is_block_pure(while_node->body, depth + 1, callees);
+        }
+        case Ast_Node::Type::LOOP: {
+            auto *loop_node = (Ast_Loop *)node;
+
+            // Folding into the reduce variable writes it like an assignment
+            if (loop_node->reduction != NULL && loop_node->reduction->depth > depth) return false;
+
+            return is_expression_pure(loop_node->start, depth, callees) && is_expression_pure(loop_node->to, depth, callees)
+                && is_expression_pure(loop_node->step, depth, callees) && is_block_pure(loop_node->body, depth + 1, callees);
+        }
+        case Ast_Node::Type::ASSIGNMENT: {
+            auto *assignment = (Ast_Assignment *)node;
+            return assignment->left->depth <= depth && is_expression_pure(assignment->right, depth, callees);
+        }
+        case Ast_Node::Type::FUNCTION_CALL:
+            return is_expression_pure(node, depth, callees);
+        default:
+            // Nested bug definitions are judged on their own when called
+            return true;
+    }
+}
+
+bool Memoizer::is_expression_pure(Ast_Node *node, int depth, std::vector<Ast_Function_Definition *> *callees) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BINARY_OP: {
+            auto *binary_op = (Ast_Binary_Op *)node;
+            return is_expression_pure(binary_op->left, depth, callees) && is_expression_pure(binary_op->right, depth, callees);
+        }
+        case Ast_Node::Type::UNARY_OP:
+            return is_expression_pure(((Ast_Unary_Op *)node)->node, depth, callees);
+        case Ast_Node::Type::ARRAY: {
+            for (Ast_Node *item : ((Ast_Array *)node)->items) {
+                if (is_expression_pure(item, depth, callees) == false) return false;
+            }
+
+            return true;
+        }
+        case Ast_Node::Type::VARIABLE:
+            return ((Ast_Variable *)node)->depth <= depth;
+        case Ast_Node::Type::FUNCTION_CALL: {
+            auto *call = (Ast_Function_Call *)node;
+
+            if (call->native != NULL) return false;
+
+            for (Ast_Node *arg : call->args) {
+                if (is_expression_pure(arg, depth, callees) == false) return false;
+            }
+
+            callees->push_back(call->definition);
+            return true;
+        }
+        default:
+            return true;
+    }
+}
+
+void report_memo_stats(std::vector<Ast_Function_Definition *> &memoized) {
+    if (memoized.empty()) {
+        std::cerr << "[MEMO] no pure bugs found" << std::endl;
+        return;
+    }
+
+    for (Ast_Function_Definition *def : memoized) {
+        Memo_Table *memo = def->memo;
+        uint64_t calls = memo->hits + memo->misses;
+        double hit_rate = calls > 0 ? 100.0 * memo->hits / calls : 0;
+
+        std::cerr << "[MEMO] " << def->name << ": " << memo->hits << " hits, " << memo->misses << " misses (" << hit_rate << "% hit rate), "
+            << memo->entries << " entries, " << memo->evictions << " evictions" << std::endl;
+    }
+}
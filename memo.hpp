@@ -0,0 +1,67 @@
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <cstdint>
+#include <vector>
+#include "arena.hpp"
+#include "parser.hpp"
+#include "typer.hpp"
+
+// Cache of results for one pure bug, keyed by the values of its args. It is
+// direct mapped with a fixed number of buckets, so a new result simply
+// replaces whatever was in its bucket and the table never grows past
+// BUCKET_COUNT entries no matter how many distinct calls are made.
+//
+// Only bugs whose args and result are all nums or bools are memoized, which
+// keeps every cached value off the garbage collected heap.
+struct Memo_Table {
+    static const int BUCKET_COUNT = 4096;
+
+    int arity;
+
+    // arity keys per bucket, allocated on the first insert so bugs that are
+    // never called cost nothing. A VOID result marks an empty bucket.
+    std::vector<Value> keys;
+    std::vector<Value> results;
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    int entries = 0;
+
+    Memo_Table(int arity) {
+        this->arity = arity;
+    }
+
+    bool lookup(const Value *args, Value *result);
+    void insert(const Value *args, Value result);
+};
+
+// Runs after the checker and gives every pure bug a Memo_Table. A bug is pure
+// when its args and return type are nums or bools, it only reads and writes
+// variables declared inside its own body, and it only calls bugs that are
+// themselves pure. Natives are all treated as impure.
+//
+// Purity is assumed for every candidate up front and then withdrawn until
+// nothing changes, so recursive and mutually recursive bugs can still be
+// memoized.
+struct Memoizer {
+    Arena *arena;
+    std::vector<Ast_Function_Definition *> memoized;
+
+    Memoizer(Arena *arena) {
+        this->arena = arena;
+    }
+
+    void memoize(Ast_Block *root);
+
+    void collect_functions(Ast_Block *block, std::vector<Ast_Function_Definition *> *functions);
+    bool is_candidate(Ast_Function_Definition *def);
+    bool is_block_pure(Ast_Block *block, int depth, std::vector<Ast_Function_Definition *> *callees);
+    bool is_statement_pure(Ast_Node *node, int depth, std::vector<Ast_Function_Definition *> *callees);
+    bool is_expression_pure(Ast_Node *node, int depth, std::vector<Ast_Function_Definition *> *callees);
+};
+
+void report_memo_stats(std::vector<Ast_Function_Definition *> &memoized);
+
+#endif
@@ -0,0 +1,97 @@
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+
+#ifdef _WIN32
+#include <io.h>
+#define isatty _isatty
+#define fileno _fileno
+#else
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include "output.hpp"
+
+static const size_t OUTPUT_BUFFER_SIZE = 1 << 16;
+
+static std::mutex output_lock;
+static std::string output_buffer;
+
+static bool is_stdout_terminal() {
+    static const bool is_terminal = isatty(fileno(stdout)) != 0;
+    return is_terminal;
+}
+
+static void flush_output_locked() {
+    if (output_buffer.empty() == false) {
+        std::cout.write(output_buffer.data(), output_buffer.size());
+        output_buffer.clear();
+    }
+
+    std::cout.flush();
+}
+
+#ifndef _WIN32
+// Runs on a stack of its own, as the usual crash is the script recursing
+// until the thread's stack runs out
+static char crash_stack[1 << 16];
+
+// Only async signal safe calls in here. The buffer is read without its lock,
+// whatever half written state it's in beats losing it.
+static void flush_output_on_crash(int signal_number) {
+    const char *data = output_buffer.data();
+    size_t remaining = output_buffer.size();
+
+    while (remaining > 0) {
+        ssize_t written = write(STDOUT_FILENO, data, remaining);
+        if (written <= 0) break;
+
+        data += written;
+        remaining -= written;
+    }
+
+    // The handler was reset on entry, so this dies the way it would have
+    raise(signal_number);
+}
+
+static void install_crash_flush() {
+    stack_t stack;
+    stack.ss_sp = crash_stack;
+    stack.ss_size = sizeof(crash_stack);
+    stack.ss_flags = 0;
+    sigaltstack(&stack, NULL);
+
+    struct sigaction action;
+    action.sa_handler = flush_output_on_crash;
+    action.sa_flags = SA_ONSTACK | SA_RESETHAND;
+    sigemptyset(&action.sa_mask);
+
+    sigaction(SIGSEGV, &action, NULL);
+    sigaction(SIGBUS, &action, NULL);
+    sigaction(SIGABRT, &action, NULL);
+}
+#else
+static void install_crash_flush() {}
+#endif
+
+void write_output(const std::string &text) {
+    std::lock_guard<std::mutex> guard(output_lock);
+
+    // Buffered output would otherwise be lost if the process crashes
+    static bool is_crash_flush_installed = false;
+
+    if (is_crash_flush_installed == false && is_stdout_terminal() == false) {
+        is_crash_flush_installed = true;
+        install_crash_flush();
+    }
+
+    output_buffer += text;
+
+    if (is_stdout_terminal() || output_buffer.size() >= OUTPUT_BUFFER_SIZE) flush_output_locked();
+}
+
+void flush_output() {
+    std::lock_guard<std::mutex> guard(output_lock);
+    flush_output_locked();
+}
@@ -0,0 +1,17 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <string>
+
+// Everything scripts print goes through one buffer, which is only written to
+// stdout when it fills up, when the script calls flush(), before a fatal error
+// is reported and when the engine finishes. When stdout is a terminal every
+// write goes straight out, so interactive output still shows up line by line.
+// If the process crashes, whatever is left in the buffer is written out before
+// it dies.
+//
+// Safe to call from any thread, each write comes out whole.
+void write_output(const std::string &text);
+void flush_output();
+
+#endif
@@ -0,0 +1,187 @@
+#include <atomic>
+#include <cmath>
+#include <sstream>
+#include <thread>
+
+#include "checker.hpp"
+#include "logger.hpp"
+#include "par.hpp"
+
+// Far more than any loop could get through, but small enough that the index
+// of every iteration is exact as a double
+static const double MAX_PAR_ITERATIONS = double(1ULL << 40);
+
+// Enough chunks to keep a big machine busy, without so few iterations in
+// each that handing them out costs more than running them
+static const size_t MAX_PAR_CHUNKS = 4096;
+static const size_t MIN_PAR_CHUNK_SIZE = 16;
+
+static int par_thread_count = 0;
+static std::atomic<unsigned int> par_epoch_count(0);
+
+thread_local unsigned int par_epoch = 0;
+
+Thread_Pool::Thread_Pool(int worker_count) {
+    this->worker_count = worker_count;
+    this->generation = 0;
+    this->finished_count = 0;
+    this->task = NULL;
+
+    for (int i = 0; i < worker_count; i++) queues.push_back(new Work_Queue());
+
+    // Workers live as long as the process, and the pool is never freed
+    for (int i = 1; i < worker_count; i++) {
+        std::thread(&Thread_Pool::worker_main, this, i).detach();
+    }
+}
+
+void Thread_Pool::run(size_t task_count, const Par_Task &task) {
+    // Neighbouring tasks start out on the same worker, and only move if
+    // another runs out of work first
+    for (int i = 0; i < worker_count; i++) {
+        std::lock_guard<std::mutex> guard(queues[i]->lock);
+
+        for (size_t t = task_count * i / worker_count; t < task_count * (i + 1) / worker_count; t++) {
+            queues[i]->tasks.push_back(t);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        this->task = &task;
+        finished_count = 0;
+        generation++;
+    }
+
+    wake.notify_all();
+    work(0);
+
+    // Every worker has to check in, so none can still be running a task, or
+    // be about to look for one, by the time the next run fills the queues
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [this] { return finished_count == worker_count - 1; });
+    this->task = NULL;
+}
+
+void Thread_Pool::work(int worker) {
+    size_t index;
+
+    while (take_task(worker, &index)) (*task)(worker, index);
+}
+
+// Nothing is queued once a run has started, so finding every queue empty
+// means the only tasks left are the ones already being run
+bool Thread_Pool::take_task(int worker, size_t *index) {
+    for (int i = 0; i < worker_count; i++) {
+        Work_Queue *queue = queues[(worker + i) % worker_count];
+        std::lock_guard<std::mutex> guard(queue->lock);
+
+        if (queue->tasks.empty()) continue;
+
+        if (i == 0) {
+            *index = queue->tasks.front();
+            queue->tasks.pop_front();
+        } else {
+            *index = queue->tasks.back();
+            queue->tasks.pop_back();
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void Thread_Pool::worker_main(int worker) {
+    unsigned int seen = 0;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            wake.wait(guard, [this, seen] { return generation != seen; });
+            seen = generation;
+        }
+
+        work(worker);
+
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            finished_count++;
+        }
+
+        done.notify_one();
+    }
+}
+
+void set_par_thread_count(int count) {
+    par_thread_count = count;
+}
+
+Thread_Pool *get_thread_pool() {
+    static Thread_Pool *pool = NULL;
+
+    if (pool == NULL) {
+        int count = par_thread_count > 0 ? par_thread_count : std::thread::hardware_concurrency();
+        pool = new Thread_Pool(count > 0 ? count : 1);
+    }
+
+    return pool;
+}
+
+unsigned int next_par_epoch() {
+    return ++par_epoch_count;
+}
+
+static bool is_par_iteration_in_range(float it, float to, float step) {
+    return step > 0 ? it < to : it > to;
+}
+
+// Same iterations as the sequential loop would run for whole steps. Rounding
+// 'it' back to a float can land the last one either side of to, so the
+// estimate is nudged until it agrees with the test the loop itself makes.
+size_t count_par_iterations(float from, float to, float step, Code_Site site) {
+    double estimate = ceil((double(to) - double(from)) / double(step));
+
+    if (estimate >= MAX_PAR_ITERATIONS) report_fatal_error("par loop has too many iterations to run", site);
+
+    // NaN controls run no iterations, same as the sequential loop
+    size_t count = estimate > 0 ? size_t(estimate) : 0;
+
+    while (count > 0 && is_par_iteration_in_range(get_par_iteration(from, step, count - 1), to, step) == false) count--;
+    while (is_par_iteration_in_range(get_par_iteration(from, step, count), to, step)) count++;
+
+    return count;
+}
+
+size_t get_par_chunk_size(size_t count) {
+    size_t size = (count + MAX_PAR_CHUNKS - 1) / MAX_PAR_CHUNKS;
+
+    return size > MIN_PAR_CHUNK_SIZE ? size : MIN_PAR_CHUNK_SIZE;
+}
+
+Value get_reduce_identity(Token::Type op) {
+    switch (op) {
+        case Token::Type::OP_PLUS:      return num_value(0);
+        case Token::Type::OP_MULTIPLY:  return num_value(1);
+        case Token::Type::LOGICAL_AND:  return bool_value(true);
+        default:                        return bool_value(false);
+    }
+}
+
+Value reduce_values(Token::Type op, Value left, Value right) {
+    switch (op) {
+        case Token::Type::OP_PLUS:      return num_value(left.num + right.num);
+        case Token::Type::OP_MULTIPLY:  return num_value(left.num * right.num);
+        case Token::Type::LOGICAL_AND:  return bool_value(left.boolean && right.boolean);
+        default:                        return bool_value(left.boolean || right.boolean);
+    }
+}
+
+// Only needed when the checker couldn't type the reduce variable
+void fail_if_reduction_invalid(Ast_Loop *loop_node, Value value) {
+    if (value.data_type == get_reduce_type(loop_node->reduce_op.type)) return;
+
+    std::stringstream ss;
+    ss << "Cannot reduce variable of type '" << data_type_to_string(value.data_type) << "' with '" << loop_node->reduce_op.value() << "'";
+    report_fatal_error(ss.str(), loop_node->reduction->site);
+}
@@ -0,0 +1,88 @@
+#ifndef PAR_H
+#define PAR_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "typer.hpp"
+
+// 'par from a to b step c { ... }' runs its iterations on a pool of threads.
+//
+// The iterations are cut into chunks whose size only depends on how many
+// iterations there are, never on how many threads run them, and each chunk is
+// run in order by a single thread. 'it' is worked out from the iteration's
+// index as from + k * step rather than by repeatedly adding step, so every
+// chunk can start anywhere.
+//
+// Variables declared in the body are private to each chunk, and nothing
+// declared outside the body can be reassigned while the loop runs. The one
+// exception is the reduce variable in 'reduce total +': the body sees a private
+// copy of it that starts out as the identity of the operator, and the copies of
+// every chunk are folded back into the variable in chunk order once the loop
+// is done. Results are the same whatever the thread count.
+//
+// Arrs allocated before the loop are shared between its iterations. They can
+// be read freely and their items replaced with nums or bools, but not grown
+// or given strs or arrs, which would move or box the items under the other
+// threads' feet. Iterations that write the same item race.
+
+struct Work_Queue {
+    std::mutex lock;
+    std::deque<size_t> tasks;
+};
+
+typedef std::function<void(int worker, size_t task)> Par_Task;
+
+// Fixed set of threads that are woken for each run and share out its tasks.
+// Every worker starts with a contiguous run of them and takes from the front
+// of its own queue, and once it is out of work steals from the back of the
+// others. The calling thread works as worker 0 while it waits.
+struct Thread_Pool {
+    int worker_count;
+    std::vector<Work_Queue *> queues;
+
+    std::mutex lock;
+    std::condition_variable wake;
+    std::condition_variable done;
+    unsigned int generation;
+    int finished_count;
+    const Par_Task *task;
+
+    Thread_Pool(int worker_count);
+
+    void run(size_t task_count, const Par_Task &task);
+    void work(int worker);
+    bool take_task(int worker, size_t *task);
+    void worker_main(int worker);
+};
+
+// Defaults to the number of cores, has to be set before the first par loop runs
+void set_par_thread_count(int count);
+Thread_Pool *get_thread_pool();
+
+// Every run of a par loop gets a new epoch, which arrs are stamped with when
+// they're allocated. 0 outside of par loops.
+extern thread_local unsigned int par_epoch;
+unsigned int next_par_epoch();
+
+inline bool is_shared_array(Array_Object *array) {
+    return par_epoch != 0 && array->epoch != par_epoch;
+}
+
+size_t count_par_iterations(float from, float to, float step, Code_Site site);
+size_t get_par_chunk_size(size_t count);
+
+inline float get_par_iteration(float from, float step, size_t index) {
+    return float(double(from) + double(index) * double(step));
+}
+
+Value get_reduce_identity(Token::Type op);
+Value reduce_values(Token::Type op, Value left, Value right);
+void fail_if_reduction_invalid(Ast_Loop *loop_node, Value value);
+
+#endif
@@ -1,6 +1,7 @@
 #include <iostream>
 #include <sstream>
 
+#include "gc.hpp"
 #include "lexer.hpp"
 #include "logger.hpp"
 #include "parser.hpp"
@@ -11,9 +12,9 @@ std::string unspecified_parse_error(int line_number) {
     return ss.str();
 }
 
-int get_operator_precedence(Token *token) {
-    Token::Type type = token->type;
-    unsigned int flags = token->flags;
+int get_operator_precedence(Token token) {
+    Token::Type type = token.type;
+    unsigned int flags = token.flags;
 
     if (flags & Token::Flags::OPERATOR) {
         if (type == Token::Type::OP_EXPONENT) {
@@ -43,29 +44,29 @@ int get_operator_precedence(Token *token) {
 }
 
 Ast_Node *Parser::parse_expression_factor() {
-    Token *token = current_token;
-    Token *next = peek_next_token();
+    Token token = current_token;
+    Token next = peek_next_token();
 
-    switch (token->type) {
+    switch (token.type) {
         case Token::Type::LOGICAL_NOT:
         case Token::Type::OP_PLUS:
         case Token::Type::OP_MINUS: {
-            eat(token->type);
-            return new Ast_Unary_Op(token, parse_expression_factor());
+            eat(token.type);
+            return arena->make<Ast_Unary_Op>(token, parse_expression_factor());
         }
         case Token::Type::NUMBER:
-            eat(token->type);
-            return new Ast_Literal(token->value, Data_Type::NUM, token->site);
+            eat(token.type);
+            return arena->make<Ast_Literal>(num_value(std::stof(token.value())), token.site);
         case Token::Type::STRING:
-            eat(token->type);
-            return new Ast_Literal(token->value, Data_Type::STR, token->site);
+            eat(token.type);
+            return arena->make<Ast_Literal>(str_value(allocate_literal_str(arena, token.value())), token.site);
         case Token::Type::KEYWORD_TRUE:
         case Token::Type::KEYWORD_FALSE: {
-            eat(token->type);
-            return new Ast_Literal(token->value, Data_Type::BOOL, token->site);
+            eat(token.type);
+            return arena->make<Ast_Literal>(bool_value(token.type == Token::Type::KEYWORD_TRUE), token.site);
         }
         case Token::Type::IDENT: {
-            if (next->type == Token::Type::L_PAREN) {
+            if (next.type == Token::Type::L_PAREN) {
                 return parse_function_call();
             }
             return parse_variable(false);
@@ -80,24 +81,24 @@ Ast_Node *Parser::parse_expression_factor() {
             eat(Token::Type::L_ARRAY);
             std::vector<Ast_Node *> items;
 
-            if (current_token->type == Token::Type::R_ARRAY) {
+            if (current_token.type == Token::Type::R_ARRAY) {
                 eat(Token::Type::R_ARRAY);
-                return new Ast_Array(items, token->site);
+                return arena->make<Ast_Array>(items, token.site);
             }
 
             items.push_back(parse_expression());
 
-            while (current_token->type == Token::Type::ARGUMENT_SEPARATOR) {
+            while (current_token.type == Token::Type::ARGUMENT_SEPARATOR) {
                 eat(Token::Type::ARGUMENT_SEPARATOR);
                 items.push_back(parse_expression());
             }
 
             eat(Token::Type::R_ARRAY);
 
-            return new Ast_Array(items, token->site);
+            return arena->make<Ast_Array>(items, token.site);
         }
         default:
-            return new Ast_Empty(token->site);
+            return arena->make<Ast_Empty>(token.site);
     }
 }
 
@@ -108,33 +109,33 @@ Ast_Node *Parser::parse_expression() {
 
 Ast_Node *Parser::parse_expression(Ast_Node *left, int min_precedence) {
     while (get_operator_precedence(current_token) >= min_precedence) {
-        Token *op = current_token;
+        Token op = current_token;
         eat(Token::Flags::OPERATOR | Token::Flags::COMPARISON | Token::Flags::LOGICAL);
         Ast_Node *right = parse_expression_factor();
 
         if (right->node_type == Ast_Node::Type::EMPTY) report_fatal_error("Invalid operation in expression");
 
         while ((get_operator_precedence(current_token) > get_operator_precedence(op))
-                || (current_token->flags & Token::Flags::RIGHT_TO_LEFT && get_operator_precedence(current_token) == get_operator_precedence(op))) {
+                || (current_token.flags & Token::Flags::RIGHT_TO_LEFT && get_operator_precedence(current_token) == get_operator_precedence(op))) {
             right = parse_expression(right, get_operator_precedence(current_token));
         }
 
-        left = new Ast_Binary_Op(left, right, op);
+        left = arena->make<Ast_Binary_Op>(left, right, op);
     }
 
     return left;
 }
 
 Ast_Node *Parser::parse_statement() {
-    Token *curr = current_token;
-    Token *next = peek_next_token();
+    Token curr = current_token;
+    Token next = peek_next_token();
     Ast_Node *ret;
 
     // @CLEANUP(LOW) Mixing between checking Token types/flags when parsing statement
     // Maybe there could be some more unified data type stored on the Token to do this.
-    if (curr->flags & Token::Flags::DATA_TYPE) {
-        if (next->type == Token::Type::KEYWORD_FUNCTION 
-                || (next->type == Token::Type::KEYWORD_ARRAY && peek_next_token(2)->type == Token::Type::KEYWORD_FUNCTION)) {
+    if (curr.flags & Token::Flags::DATA_TYPE) {
+        if (next.type == Token::Type::KEYWORD_FUNCTION 
+                || (next.type == Token::Type::KEYWORD_ARRAY && peek_next_token(2).type == Token::Type::KEYWORD_FUNCTION)) {
             return parse_function_definition();
         } else {
             ret = parse_assignment(true);
@@ -143,36 +144,36 @@ Ast_Node *Parser::parse_statement() {
         }
     }
 
-    if (curr->type == Token::Type::L_BRACE) {
+    if (curr.type == Token::Type::L_BRACE) {
         return parse_block(false);
-    } else if (curr->type == Token::Type::KEYWORD_RETURN) {
+    } else if (curr.type == Token::Type::KEYWORD_RETURN) {
         ret = parse_return();
         eat(Token::Type::TERMINATOR);
         return ret;
-    } else if (curr->type == Token::Type::KEYWORD_FUNCTION) {
-        report_fatal_error("Must specify return type of bug at point of declaration", current_token->site);
+    } else if (curr.type == Token::Type::KEYWORD_FUNCTION) {
+        report_fatal_error("Must specify return type of bug at point of declaration", current_token.site);
         return NULL;
-    } else if (curr->type == Token::Type::KEYWORD_IF) {
+    } else if (curr.type == Token::Type::KEYWORD_IF) {
         return parse_if();
-    } else if (curr->type == Token::Type::KEYWORD_WHILE) {
+    } else if (curr.type == Token::Type::KEYWORD_WHILE) {
         return parse_while();
-    } else if (curr->type == Token::Type::KEYWORD_LOOP_START) {
+    } else if (curr.type == Token::Type::KEYWORD_LOOP_START || curr.type == Token::Type::KEYWORD_PARALLEL) {
         return parse_loop();
-    } else if (curr->type == Token::Type::KEYWORD_REASSIGN_VARIABLE) {
+    } else if (curr.type == Token::Type::KEYWORD_REASSIGN_VARIABLE) {
         ret = parse_assignment(false);
         eat(Token::Type::TERMINATOR);
         return ret;
-    } else if (curr->type == Token::Type::IDENT && next != NULL) {
-        if (next->type == Token::Type::L_PAREN) {
+    } else if (curr.type == Token::Type::IDENT) {
+        if (next.type == Token::Type::L_PAREN) {
             ret = parse_function_call();
             eat(Token::Type::TERMINATOR);
             return ret;
         } else {
-            report_fatal_error("Unexpected identifier", current_token->site);
+            report_fatal_error("Unexpected identifier", current_token.site);
             return NULL;
         }
     } else {
-        report_fatal_error("Cannot parse this line", current_token->site);
+        report_fatal_error("Cannot parse this line", current_token.site);
         return NULL;
     }
 }
@@ -181,7 +182,7 @@ Ast_Variable *Parser::parse_variable(bool is_first_assign) {
     Data_Type data_type = Data_Type::VOID;
 
     if (is_first_assign) {
-        auto type = current_token->type;
+        auto type = current_token.type;
 
         if (type == Token::Type::KEYWORD_NUM) {
             eat(Token::Type::KEYWORD_NUM);
@@ -196,14 +197,14 @@ Ast_Variable *Parser::parse_variable(bool is_first_assign) {
             eat(Token::Type::KEYWORD_ARRAY);
             data_type = Data_Type::ARRAY;
         } else {
-            report_fatal_error("Variables must be assigned a data type at the point of declaration", current_token->site);
+            report_fatal_error("Variables must be assigned a data type at the point of declaration", current_token.site);
         }
     }
 
-    auto *var = new Ast_Variable(current_token);
+    auto *var = arena->make<Ast_Variable>(current_token);
 
     if (is_first_assign) var->data_type = data_type;
-    if (current_token->flags & Token::Flags::KEYWORD) report_fatal_error("SHEL keyword used as variable name", current_token->site);
+    if (current_token.flags & Token::Flags::KEYWORD) report_fatal_error("SHEL keyword used as variable name", current_token.site);
 
     eat(Token::Type::IDENT);
 
@@ -211,10 +212,10 @@ Ast_Variable *Parser::parse_variable(bool is_first_assign) {
 }
 
 Ast_Function_Definition *Parser::parse_function_definition() {
-    Token *start_token = current_token;
+    Token start_token = current_token;
     Data_Type return_type = token_to_data_type(current_token);
 
-    eat(current_token->type);
+    eat(current_token.type);
     eat(Token::Type::KEYWORD_FUNCTION);
 
     std::string func_name = parse_ident_name();
@@ -222,48 +223,48 @@ Ast_Function_Definition *Parser::parse_function_definition() {
     eat(Token::Type::L_PAREN);
     std::vector<Ast_Variable *> args;
 
-    while (current_token->flags & Token::Flags::DATA_TYPE) {
+    while (current_token.flags & Token::Flags::DATA_TYPE) {
         Ast_Variable *arg = parse_variable(true);
 
         for (Ast_Variable *other : args) {
             if (other->name == arg->name) {
                 std::stringstream ss;
                 ss << "Argument with the name '" << arg->name << "' already exists in definition of bug '" << func_name << "'";
-                report_fatal_error(ss.str(), other->token->site);
+                report_fatal_error(ss.str(), other->token.site);
             }
         }
 
         args.push_back(arg);
 
-        if (current_token->type == Token::Type::ARGUMENT_SEPARATOR) eat(Token::Type::ARGUMENT_SEPARATOR);
+        if (current_token.type == Token::Type::ARGUMENT_SEPARATOR) eat(Token::Type::ARGUMENT_SEPARATOR);
     }
 
-    if (current_token->type == Token::Type::IDENT) report_fatal_error("Must specify data type of function argument before identifier", current_token->site);
+    if (current_token.type == Token::Type::IDENT) report_fatal_error("Must specify data type of function argument before identifier", current_token.site);
 
     eat(Token::Type::R_PAREN);
 
     Ast_Block *body = parse_block(false);
 
-    return new Ast_Function_Definition(body, return_type, args, func_name, start_token->site);
+    return arena->make<Ast_Function_Definition>(body, return_type, args, func_name, start_token.site);
 }
 
 Ast_Function_Call *Parser::parse_function_call() {
-    Token *call_token = current_token;
+    Token call_token = current_token;
     std::string func_name = parse_ident_name();
 
-    Token *open_paren = current_token;
+    Token open_paren = current_token;
     eat(Token::Type::L_PAREN);
     std::vector<Ast_Node *> args;
 
-    while (current_token->type != Token::Type::ARGUMENT_SEPARATOR && current_token->type != Token::Type::R_PAREN) {
+    while (current_token.type != Token::Type::ARGUMENT_SEPARATOR && current_token.type != Token::Type::R_PAREN) {
         args.push_back(parse_expression());
 
-        if (current_token->type == Token::Type::ARGUMENT_SEPARATOR) eat(Token::Type::ARGUMENT_SEPARATOR);
+        if (current_token.type == Token::Type::ARGUMENT_SEPARATOR) eat(Token::Type::ARGUMENT_SEPARATOR);
     }
 
     eat(Token::Type::R_PAREN);
 
-    return new Ast_Function_Call(func_name, args, call_token->site, open_paren->site);
+    return arena->make<Ast_Function_Call>(func_name, args, call_token.site, open_paren.site);
 }
 
 Ast_Assignment *Parser::parse_assignment(bool is_first_assign) {
@@ -273,11 +274,11 @@ Ast_Assignment *Parser::parse_assignment(bool is_first_assign) {
 
     Ast_Variable *var = parse_variable(is_first_assign);
 
-    Token *ass_op_token = current_token;
+    Token ass_op_token = current_token;
     eat(Token::Flags::OPERATOR);
     Ast_Node *right = NULL;
 
-    switch (ass_op_token->type) {
+    switch (ass_op_token.type) {
         case Token::Type::OP_ASSIGNMENT: 
             right = parse_expression();
             break;
@@ -287,25 +288,25 @@ Ast_Assignment *Parser::parse_assignment(bool is_first_assign) {
         case Token::Type::OP_DIVIDE_EQUALS:
         case Token::Type::OP_MODULO_EQUALS:
         case Token::Type::OP_EXPONENT_EQUALS:
-            right = new Ast_Binary_Op(var, parse_expression(), ass_op_token);
+            right = arena->make<Ast_Binary_Op>(var, parse_expression(), ass_op_token);
             break;
         default:
-            report_fatal_error("Unrecognised assignment operator", ass_op_token->site);
+            report_fatal_error("Unrecognised assignment operator", ass_op_token.site);
             return NULL;
     }
 
-    return new Ast_Assignment(var, right, is_first_assign, ass_op_token->site);
+    return arena->make<Ast_Assignment>(var, right, is_first_assign, ass_op_token.site);
 }
 
 Ast_Return *Parser::parse_return() {
-    Token *ret_token = current_token;
+    Token ret_token = current_token;
     eat(Token::Type::KEYWORD_RETURN);
 
-    return new Ast_Return(parse_expression(), ret_token->site);
+    return arena->make<Ast_Return>(parse_expression(), ret_token.site);
 }
 
 Ast_If *Parser::parse_if() {
-    Token *if_token = current_token;
+    Token if_token = current_token;
 
     eat(Token::Type::KEYWORD_IF);
     eat(Token::Type::L_PAREN);
@@ -314,23 +315,23 @@ Ast_If *Parser::parse_if() {
 
     eat(Token::Type::R_PAREN);
 
-    auto *root = new Ast_If(comparison, parse_block(false), if_token->site);
+    auto *root = arena->make<Ast_If>(comparison, parse_block(false), if_token.site);
     auto *ret = root;
 
-    while (current_token->type == Token::Type::KEYWORD_ELSE || current_token->type == Token::Type::KEYWORD_ELIF) {
-        Code_Site *site = current_token->site;
+    while (current_token.type == Token::Type::KEYWORD_ELSE || current_token.type == Token::Type::KEYWORD_ELIF) {
+        Code_Site site = current_token.site;
         Ast_If *curr = NULL;
 
-        if (current_token->type == Token::Type::KEYWORD_ELIF) {
+        if (current_token.type == Token::Type::KEYWORD_ELIF) {
             eat(Token::Type::KEYWORD_ELIF);
             eat(Token::Type::L_PAREN);
             Ast_Node *elif_comparison = parse_expression();
             eat(Token::Type::R_PAREN);
 
-            curr = new Ast_If(elif_comparison, parse_block(false), site);
-        } else if (current_token->type == Token::Type::KEYWORD_ELSE) {
+            curr = arena->make<Ast_If>(elif_comparison, parse_block(false), site);
+        } else if (current_token.type == Token::Type::KEYWORD_ELSE) {
             eat(Token::Type::KEYWORD_ELSE);
-            curr = new Ast_If(NULL, parse_block(false), site);
+            curr = arena->make<Ast_If>((Ast_Node *)NULL, parse_block(false), site);
         }
 
         root->failure = curr;
@@ -341,7 +342,7 @@ Ast_If *Parser::parse_if() {
 }
 
 Ast_While *Parser::parse_while() {
-    Token *while_token = current_token;
+    Token while_token = current_token;
     eat(Token::Type::KEYWORD_WHILE);
     eat(Token::Type::L_PAREN);
 
@@ -351,11 +352,14 @@ Ast_While *Parser::parse_while() {
 
     Ast_Block *body = parse_block(false);
 
-    return new Ast_While(comparison, body, while_token->site);
+    return arena->make<Ast_While>(comparison, body, while_token.site);
 }
 
 Ast_Loop *Parser::parse_loop() {
-    Token *loop_token = current_token;
+    Token loop_token = current_token;
+    bool is_parallel = current_token.type == Token::Type::KEYWORD_PARALLEL;
+
+    if (is_parallel) eat(Token::Type::KEYWORD_PARALLEL);
     eat(Token::Type::KEYWORD_LOOP_START);
 
     Ast_Node *start = parse_expression();
@@ -368,17 +372,49 @@ Ast_Loop *Parser::parse_loop() {
 
     Ast_Node *step = parse_expression();
 
+    Ast_Variable *reduction = NULL;
+    Token reduce_op = current_token;
+
+    // 'reduce sum +' names the one outer variable the body may change
+    if (is_parallel && current_token.type == Token::Type::KEYWORD_REDUCE) {
+        eat(Token::Type::KEYWORD_REDUCE);
+
+        if (current_token.flags & Token::Flags::KEYWORD) report_fatal_error("SHEL keyword used as variable name", current_token.site);
+
+        reduction = arena->make<Ast_Variable>(current_token);
+        eat(Token::Type::IDENT);
+
+        reduce_op = current_token;
+
+        switch (reduce_op.type) {
+            case Token::Type::OP_PLUS:
+            case Token::Type::OP_MULTIPLY:
+            case Token::Type::LOGICAL_AND:
+            case Token::Type::LOGICAL_OR:
+                eat(reduce_op.type);
+                break;
+            default:
+                report_fatal_error("Expected '+', '*', 'and' or 'or' as the reduce operator", reduce_op.site);
+                break;
+        }
+    }
+
     Ast_Block *body = parse_block(false);
+    auto *loop_node = arena->make<Ast_Loop>(start, to, step, body, loop_token.site);
 
-    return new Ast_Loop(start, to, step, body, loop_token->site);
+    loop_node->is_parallel = is_parallel;
+    loop_node->reduction = reduction;
+    loop_node->reduce_op = reduce_op;
+
+    return loop_node;
 }
 
 
 Ast_Block *Parser::parse_block(bool is_global_scope) {
-    Token *start = current_token;
+    Token start = current_token;
     if (is_global_scope == false) eat(Token::Type::L_BRACE);
     std::vector<Ast_Node *> nodes = parse_statements();
-    auto *block = new Ast_Block(nodes, start->site);
+    auto *block = arena->make<Ast_Block>(nodes, start.site);
 
     for (Ast_Node *node : nodes) {
         // First return node in a block wins
@@ -393,12 +429,12 @@ Ast_Block *Parser::parse_block(bool is_global_scope) {
 }
 
 Ast_Block *Parser::parse() {
-    if (tokens.size() == 0) return NULL;
+    if (tokens->size() == 0) return NULL;
     return parse_block(true);
 }
 
 std::string Parser::parse_ident_name() {
-    std::string name = current_token->value;
+    std::string name = current_token.value();
     eat(Token::Type::IDENT);
 
     return name;
@@ -406,45 +442,139 @@ std::string Parser::parse_ident_name() {
 
 std::vector<Ast_Node *> Parser::parse_statements() {
     std::vector<Ast_Node *> nodes;
-    Token::Type current_type = current_token->type;
+    Token::Type current_type = current_token.type;
 
     while (current_type != Token::Type::END_OF_FILE && current_type != Token::Type::R_BRACE) {
         nodes.push_back(parse_statement());
-        current_type = current_token->type;
+        current_type = current_token.type;
     }
 
     return nodes;
 }
 
-Token *Parser::peek_next_token() {
+Token Parser::peek_next_token() {
     return peek_next_token(1);
 }
 
-Token *Parser::peek_next_token(int step) {
-    int pos = find(tokens.begin(), tokens.end(), current_token) - tokens.begin();
-    int next_pos = pos + step;
-    int tokens_len = tokens.size();
+// Lookahead past the end of the stream keeps returning the END_OF_FILE token
+Token Parser::peek_next_token(int step) {
+    int next_pos = position + step;
 
-    return next_pos < tokens_len ? tokens[next_pos] : NULL;
+    return tokens->at(next_pos < last_position ? next_pos : last_position);
 }
 
 void Parser::accept_or_reject_token(bool is_accepted) {
-    if (is_accepted) {
-        position++;
-        current_token = tokens[position];
-    } else {
-        report_fatal_error("Unexpected token", current_token->site);
-    }
+    if (position == last_position) report_fatal_error("Reached last token and attempted further eat");
+    if (is_accepted == false) report_fatal_error("Unexpected token", current_token.site);
+
+    position++;
+    current_token = tokens->at(position);
 }
 
 void Parser::eat(int flags) {
-    // @DUPLICATION(LOW) Parser::eat(int flags)
-    if (position == tokens.size() - 1) report_fatal_error("Reached last token and attempted further eat");
-    accept_or_reject_token(current_token->flags & flags);
+    accept_or_reject_token(current_token.flags & flags);
 }
 
 void Parser::eat(Token::Type expected_type) {
-    if (position == tokens.size() - 1) report_fatal_error("Reached last token and attempted further eat");
-    accept_or_reject_token(current_token->type == expected_type);
+    accept_or_reject_token(current_token.type == expected_type);
+}
+
+static void print_ast_line(int depth, std::string text) {
+    std::cout << std::string(depth * 4, ' ') << text << std::endl;
 }
 
+void print_ast(Ast_Node *node, int depth) {
+    if (node == NULL) return;
+
+    switch (node->node_type) {
+        case Ast_Node::Type::BINARY_OP: {
+            auto *op = (Ast_Binary_Op *)node;
+            print_ast_line(depth, "BINARY_OP " + op->op.value());
+            print_ast(op->left, depth + 1);
+            print_ast(op->right, depth + 1);
+            break;
+        }
+        case Ast_Node::Type::UNARY_OP: {
+            auto *op = (Ast_Unary_Op *)node;
+            print_ast_line(depth, "UNARY_OP " + op->op.value());
+            print_ast(op->node, depth + 1);
+            break;
+        }
+        case Ast_Node::Type::LITERAL: {
+            auto *lit = (Ast_Literal *)node;
+            std::string text = value_to_string(lit->value);
+
+            if (lit->data_type == Data_Type::STR) text = "\"" + text + "\"";
+            print_ast_line(depth, "LITERAL " + data_type_to_string(lit->data_type) + " " + text);
+            break;
+        }
+        case Ast_Node::Type::ARRAY:
+            print_ast_line(depth, "ARRAY");
+            for (Ast_Node *item : ((Ast_Array *)node)->items) print_ast(item, depth + 1);
+            break;
+        case Ast_Node::Type::BLOCK:
+            print_ast_line(depth, "BLOCK");
+            for (Ast_Node *child : ((Ast_Block *)node)->children) print_ast(child, depth + 1);
+            break;
+        case Ast_Node::Type::IF: {
+            auto *if_node = (Ast_If *)node;
+            print_ast_line(depth, if_node->comparison == NULL ? "ELSE" : "IF");
+            print_ast(if_node->comparison, depth + 1);
+            print_ast(if_node->success, depth + 1);
+            print_ast(if_node->failure, depth);
+            break;
+        }
+        case Ast_Node::Type::WHILE: {
+            auto *while_node = (Ast_While *)node;
+            print_ast_line(depth, "WHILE");
+            print_ast(while_node->comparison, depth + 1);
+            print_ast(while_node->body, depth + 1);
+            break;
+        }
+        case Ast_Node::Type::LOOP: {
+            auto *loop_node = (Ast_Loop *)node;
+            print_ast_line(depth, loop_node->is_parallel ? "PAR FROM" : "FROM");
+            print_ast(loop_node->start, depth + 1);
+            print_ast(loop_node->to, depth + 1);
+            print_ast(loop_node->step, depth + 1);
+            if (loop_node->reduction != NULL) print_ast_line(depth + 1, "REDUCE " + loop_node->reduction->name + " " + loop_node->reduce_op.value());
+            print_ast(loop_node->body, depth + 1);
+            break;
+        }
+        case Ast_Node::Type::ASSIGNMENT: {
+            auto *assignment = (Ast_Assignment *)node;
+            print_ast_line(depth, std::string(assignment->is_first_assign ? "DECLARE " : "ASSIGN ") + assignment->left->name);
+            print_ast(assignment->right, depth + 1);
+            break;
+        }
+        case Ast_Node::Type::VARIABLE:
+            print_ast_line(depth, "VARIABLE " + ((Ast_Variable *)node)->name);
+            break;
+        case Ast_Node::Type::FUNCTION_DEFINITION: {
+            auto *def = (Ast_Function_Definition *)node;
+            std::string text = "BUG " + data_type_to_string(def->data_type) + " " + def->name + "(";
+
+            for (size_t i = 0; i < def->args.size(); i++) {
+                if (i > 0) text += ", ";
+                text += def->args[i]->name;
+            }
+
+            print_ast_line(depth, text + ")");
+            print_ast(def->block, depth + 1);
+            break;
+        }
+        case Ast_Node::Type::FUNCTION_CALL: {
+            auto *call = (Ast_Function_Call *)node;
+            print_ast_line(depth, "CALL " + call->name);
+            for (Ast_Node *arg : call->args) print_ast(arg, depth + 1);
+            break;
+        }
+        case Ast_Node::Type::RETURN:
+            print_ast_line(depth, "RETURN");
+            print_ast(((Ast_Return *)node)->value, depth + 1);
+            break;
+        default:
+            print_ast_line(depth, "EMPTY");
+            break;
+    }
+}
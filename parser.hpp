@@ -5,6 +5,11 @@
 #include "lexer.hpp"
 #include "typer.hpp"
 
+struct Native_Function;
+struct Memo_Table;
+struct Jit_Function;
+struct Ast_Variable;
+
 struct Ast_Node {
     // @ROBUSTNESS(MEDIUM) @CLEANUP Storing type enum value in Ast_Node
     // This is a bit of a workaround for determining the type of a node
@@ -30,31 +35,73 @@ struct Ast_Node {
     // Attaching some metadata to these at some point might be useful
     Type node_type;
     Data_Type data_type = Data_Type::VOID;
-    Code_Site *site;
+    Code_Site site;
+
+    // Set by the checker when every type flowing through this node is known
+    // before running, so the engines can skip their runtime type checks
+    bool is_type_checked = false;
+};
+
+// Specialized forms the walker rewrites binary ops into once it has seen
+// what types they get, see Interpreter::record_binary_op_types
+enum Quick_Op {
+    QUICK_NONE,
+    QUICK_NUM_ADD,
+    QUICK_NUM_SUBTRACT,
+    QUICK_NUM_MULTIPLY,
+    QUICK_NUM_DIVIDE,
+    QUICK_NUM_MODULO,
+    QUICK_NUM_EXPONENT,
+    QUICK_NUM_EQUALS,
+    QUICK_NUM_NOT_EQUALS,
+    QUICK_NUM_GREATER_THAN,
+    QUICK_NUM_GREATER_THAN_EQUALS,
+    QUICK_NUM_LESS_THAN,
+    QUICK_NUM_LESS_THAN_EQUALS,
+    QUICK_STR_CONCAT,
+    QUICK_STR_EQUALS,
+    QUICK_STR_NOT_EQUALS,
+    QUICK_BOOL_EQUALS,
+    QUICK_BOOL_NOT_EQUALS,
+    QUICK_BOOL_AND,
+    QUICK_BOOL_OR
 };
 
 struct Ast_Binary_Op : Ast_Node {
     Ast_Node *left;
     Ast_Node *right;
-    Token *op;
-
-    Ast_Binary_Op(Ast_Node *left, Ast_Node *right, Token *op) {
+    Token op;
+
+    // Type feedback, only ever written by the main thread. Both operands
+    // having had seen_type enough times in a row sets quick_op, which holds
+    // until an operand of another type shows up. is_generic is set then, or
+    // straight away when there's no quick form for the types seen.
+    Quick_Op quick_op;
+    Data_Type seen_type;
+    int seen_count;
+    bool is_generic;
+
+    Ast_Binary_Op(Ast_Node *left, Ast_Node *right, Token op) {
         this->left = left;
         this->right = right;
         this->op = op;
-        this->site = op->site;
+        this->quick_op = QUICK_NONE;
+        this->seen_type = Data_Type::VOID;
+        this->seen_count = 0;
+        this->is_generic = false;
+        this->site = op.site;
         this->node_type = Ast_Node::Type::BINARY_OP;
     }
 };
 
 struct Ast_Unary_Op : Ast_Node {
-    Token *op;
+    Token op;
     Ast_Node *node;
 
-    Ast_Unary_Op(Token *op, Ast_Node *node) {
+    Ast_Unary_Op(Token op, Ast_Node *node) {
         this->op = op;
         this->node = node;
-        this->site = op->site;
+        this->site = op.site;
         this->node_type = Ast_Node::Type::UNARY_OP;
     }
 };
@@ -62,8 +109,13 @@ struct Ast_Unary_Op : Ast_Node {
 struct Ast_Return : Ast_Node {
     Ast_Node *value;
 
-    Ast_Return(Ast_Node *value, Code_Site *site) {
+    // Set by the resolver when value is a call back into the bug being
+    // returned from, which the engines run by reusing the current frame
+    bool is_tail_call;
+
+    Ast_Return(Ast_Node *value, Code_Site site) {
         this->value = value;
+        this->is_tail_call = false;
         this->site = site;
         this->node_type = Ast_Node::Type::RETURN;
     }
@@ -73,9 +125,14 @@ struct Ast_Block : Ast_Node {
     std::vector<Ast_Node *> children;
     Ast_Return *return_node;
 
-    Ast_Block(std::vector<Ast_Node *> children, Code_Site *site) {
+    // Slots needed by the scope this block opens, filled in by the resolver.
+    // Unused for bare blocks as they share the scope of their parent.
+    int frame_size;
+
+    Ast_Block(std::vector<Ast_Node *> children, Code_Site site) {
         this->children = children;
         this->return_node = NULL;
+        this->frame_size = 0;
         this->site = site;
         this->node_type = Ast_Node::Type::BLOCK;
     }
@@ -86,7 +143,7 @@ struct Ast_If : Ast_Node {
     Ast_Block *success;
     Ast_If *failure;
 
-    Ast_If(Ast_Node *comparison, Ast_Block *success, Code_Site *site) {
+    Ast_If(Ast_Node *comparison, Ast_Block *success, Code_Site site) {
         this->comparison = comparison;
         this->success = success;
         this->failure = NULL; // Not known at the point of construction
@@ -99,7 +156,7 @@ struct Ast_While : Ast_Node {
     Ast_Node *comparison;
     Ast_Block *body;
 
-    Ast_While(Ast_Node *comparison, Ast_Block *body, Code_Site *site) {
+    Ast_While(Ast_Node *comparison, Ast_Block *body, Code_Site site) {
         this->comparison = comparison;
         this->body = body;
         this->site = site;
@@ -113,29 +170,39 @@ struct Ast_Loop : Ast_Node {
     Ast_Node *step;
     Ast_Block *body;
 
-    Ast_Loop(Ast_Node *start, Ast_Node *to, Ast_Node *step, Ast_Block *body, Code_Site *site) {
+    // 'par from' loops split their iterations between threads, see par.hpp.
+    // The reduce variable is bound outside the loop, and the body gets a
+    // private copy of it in slot 1 that is folded back in with reduce_op.
+    bool is_parallel;
+    Ast_Variable *reduction;
+    Token reduce_op;
+
+    Ast_Loop(Ast_Node *start, Ast_Node *to, Ast_Node *step, Ast_Block *body, Code_Site site) {
         this->start = start;
         this->to = to;
         this->step = step;
         this->body = body;
+        this->is_parallel = false;
+        this->reduction = NULL;
         this->site = site;
         this->node_type = Ast_Node::Type::LOOP;
     }
 };
 
 struct Ast_Literal : Ast_Node {
-    std::string value;
+    // Decoded once by the parser or produced by the folder, engines use it as is
+    Value value;
 
-    Ast_Literal(std::string value, Data_Type type, Code_Site *site) {
+    Ast_Literal(Value value, Code_Site site) {
         this->value = value;
-        this->data_type = type;
+        this->data_type = value.data_type;
         this->site = site;
         this->node_type = Ast_Node::Type::LITERAL;
     }
 };
 
 struct Ast_Variable : Ast_Node {
-    Token *token;
+    Token token;
     std::string name;
 
     // This Data_Type will be set at parse time if the variable is on the LHS of
@@ -144,11 +211,17 @@ struct Ast_Variable : Ast_Node {
     // at interp time.
     Data_Type type;
 
-    Ast_Variable(Token *token) {
+    // Bound by the resolver, the variable lives in slot of the scope depth hops up
+    int depth;
+    int slot;
+
+    Ast_Variable(Token token) {
         this->token = token;
         this->type = Data_Type::VOID;
-        this->name = token->value;
-        this->site = token->site;
+        this->depth = -1;
+        this->slot = -1;
+        this->name = token.value();
+        this->site = token.site;
         this->node_type = Ast_Node::Type::VARIABLE;
     }
 };
@@ -158,8 +231,19 @@ struct Ast_Function_Definition : Ast_Node {
     std::vector<Ast_Variable *> args;
     std::string name;
 
-    Ast_Function_Definition(Ast_Block *block, Data_Type return_type, std::vector<Ast_Variable *> args, std::string name, Code_Site *site) {
+    // Results cache, set by the Memoizer only when the bug is pure
+    Memo_Table *memo;
+
+    // Machine code for the bug, made once call_count says it's hot, see
+    // jit.hpp. Only the main thread counts calls and compiles.
+    Jit_Function *jit;
+    int call_count;
+
+    Ast_Function_Definition(Ast_Block *block, Data_Type return_type, std::vector<Ast_Variable *> args, std::string name, Code_Site site) {
         this->block = block;
+        this->memo = NULL;
+        this->jit = NULL;
+        this->call_count = 0;
         this->data_type = return_type;
         this->args = args;
         this->name = name;
@@ -171,11 +255,25 @@ struct Ast_Function_Definition : Ast_Node {
 struct Ast_Function_Call : Ast_Node {
     std::string name;
     std::vector<Ast_Node *> args;
-    Code_Site *args_start_site;
+    Code_Site args_start_site;
+
+    // Bound by the resolver, exactly one of definition and native is set. The
+    // bug was defined in the scope depth hops up from the call, which becomes
+    // the parent of its scope.
+    Ast_Function_Definition *definition;
+    Native_Function *native;
+    int depth;
 
-    Ast_Function_Call(std::string name, std::vector<Ast_Node *> args, Code_Site *site, Code_Site *args_start_site) {
+    // Set by the resolver for print calls with a literal format, split at the
+    // '%'s the args are substituted into so it is never scanned at runtime
+    std::vector<std::string> format_pieces;
+
+    Ast_Function_Call(std::string name, std::vector<Ast_Node *> args, Code_Site site, Code_Site args_start_site) {
         this->name = name;
         this->args = args;
+        this->definition = NULL;
+        this->native = NULL;
+        this->depth = 0;
         this->site = site;
         this->args_start_site = args_start_site;
         this->node_type = Ast_Node::Type::FUNCTION_CALL;
@@ -187,7 +285,7 @@ struct Ast_Assignment : Ast_Node {
     Ast_Node *right;
     bool is_first_assign;
 
-    Ast_Assignment(Ast_Variable *left, Ast_Node *right, bool is_first_assign, Code_Site *site) {
+    Ast_Assignment(Ast_Variable *left, Ast_Node *right, bool is_first_assign, Code_Site site) {
         this->left = left;
         this->right = right;
         this->is_first_assign = is_first_assign;
@@ -199,7 +297,7 @@ struct Ast_Assignment : Ast_Node {
 struct Ast_Array : Ast_Node {
     std::vector<Ast_Node *> items;
 
-    Ast_Array(std::vector<Ast_Node *> items, Code_Site *site) {
+    Ast_Array(std::vector<Ast_Node *> items, Code_Site site) {
         this->items = items;
         this->site = site;
         this->node_type = Ast_Node::Type::ARRAY;
@@ -207,7 +305,7 @@ struct Ast_Array : Ast_Node {
 };
 
 struct Ast_Empty : Ast_Node {
-    Ast_Empty(Code_Site *site) {
+    Ast_Empty(Code_Site site) {
         this->site = site;
         this->data_type = Data_Type::VOID;
         this->node_type = Ast_Node::Type::EMPTY;
@@ -215,16 +313,22 @@ struct Ast_Empty : Ast_Node {
 };
 
 struct Parser {
-    std::vector<Token *> tokens;
+    Arena *arena;
+    Token_Stream *tokens;
     Token::Type stop_type;
-    Token *current_token;
+    Token current_token;
     int position;
 
-    Parser(std::vector<Token *> tokens, Token::Type stop_type) {
+    // Index of the END_OF_FILE token that the lexer always finishes with
+    int last_position;
+
+    Parser(Token_Stream *tokens, Token::Type stop_type, Arena *arena) {
+        this->arena = arena;
         this->tokens = tokens;
         this->stop_type = stop_type;
-        this->current_token = tokens[0];
+        this->current_token = tokens->at(0);
         this->position = 0;
+        this->last_position = tokens->size() - 1;
     }
 
     Ast_Node *parse_expression_factor();
@@ -243,12 +347,15 @@ struct Parser {
     Ast_Block *parse();
     std::string parse_ident_name();
     std::vector<Ast_Node *> parse_statements();
-    Token *peek_next_token();
-    Token *peek_next_token(int jump);
+    Token peek_next_token();
+    Token peek_next_token(int jump);
 
     void accept_or_reject_token(bool is_accepted);
     void eat(int flags);
     void eat(Token::Type expected_type);
 };
 
+// Prints the tree as it will be run, after folding, one node per line
+void print_ast(Ast_Node *node, int depth);
+
 #endif
@@ -0,0 +1,214 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#include "logger.hpp"
+#include "profile.hpp"
+
+bool is_profiling = false;
+std::atomic<unsigned int> profile_ticks(0);
+
+static std::chrono::steady_clock::time_point profile_start;
+
+struct Profile_Frame_Less {
+    bool operator()(const std::vector<Profile_Frame> &left, const std::vector<Profile_Frame> &right) const {
+        if (left.size() != right.size()) return left.size() < right.size();
+
+        for (size_t i = 0; i < left.size(); i++) {
+            if (left[i].def != right[i].def) return left[i].def < right[i].def;
+            if (left[i].site.file_id != right[i].site.file_id) return left[i].site.file_id < right[i].site.file_id;
+            if (left[i].site.offset != right[i].site.offset) return left[i].site.offset < right[i].site.offset;
+        }
+
+        return false;
+    }
+};
+
+// Ticks for every distinct stack, lines are only worked out when reporting
+static std::map<std::vector<Profile_Frame>, unsigned int, Profile_Frame_Less> profile_samples;
+
+struct Profile_Row {
+    std::string name;
+    unsigned int self;
+    unsigned int total;
+
+    Profile_Row() {
+        this->self = 0;
+        this->total = 0;
+    }
+};
+
+#ifndef _WIN32
+// Only ever touches profile_ticks, which is lock free and so safe to use here
+static void count_profile_tick(int signal_number) {
+    profile_ticks.fetch_add(1, std::memory_order_relaxed);
+}
+
+void start_profiler() {
+    is_profiling = true;
+    profile_start = std::chrono::steady_clock::now();
+
+    // The kernel sends SIGPROF every interval of CPU time the process uses,
+    // which is far cheaper than waking a thread of our own to count them.
+    // SA_RESTART keeps it from breaking into reads and writes.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = count_profile_tick;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    if (sigaction(SIGPROF, &action, NULL) != 0) report_fatal_error("Cannot start the profiler");
+
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = PROFILE_INTERVAL_MS * 1000;
+    timer.it_value = timer.it_interval;
+
+    if (setitimer(ITIMER_PROF, &timer, NULL) != 0) report_fatal_error("Cannot start the profiler");
+}
+#else
+void start_profiler() {
+    report_fatal_error("--profile is not supported on Windows");
+}
+#endif
+
+void record_profile_sample(const std::vector<Profile_Frame> &frames, unsigned int weight) {
+    profile_samples[frames] += weight;
+}
+
+static std::string get_frame_name(const Profile_Frame &frame) {
+    return frame.def != NULL ? frame.def->name : "<script>";
+}
+
+// Offsets of every newline in each source file, to find lines by binary search
+static std::map<unsigned int, std::vector<unsigned int>> newline_offsets;
+
+static unsigned int get_line_number(Code_Site site) {
+    auto found = newline_offsets.find(site.file_id);
+
+    if (found == newline_offsets.end()) {
+        std::vector<unsigned int> offsets;
+        Source_File *file = get_source_file(site.file_id);
+
+        if (file != NULL && file->text != NULL) {
+            const std::string &text = *file->text;
+
+            for (size_t i = 0; i < text.size(); i++) {
+                if (text[i] == '\n') offsets.push_back(i);
+            }
+        }
+
+        found = newline_offsets.insert(std::make_pair(site.file_id, offsets)).first;
+    }
+
+    return std::lower_bound(found->second.begin(), found->second.end(), site.offset) - found->second.begin() + 1;
+}
+
+static std::string get_line_name(const Profile_Frame &frame) {
+    Source_File *file = get_source_file(frame.site.file_id);
+    std::string file_name = file != NULL ? file->name : "?";
+
+    return file_name + ":" + std::to_string(get_line_number(frame.site)) + " (" + get_frame_name(frame) + ")";
+}
+
+static void print_profile_rows(std::map<std::string, Profile_Row> &rows, const std::string &heading, size_t limit, unsigned int ticks, double ms_per_tick) {
+    std::vector<Profile_Row> sorted;
+
+    for (auto &row : rows) {
+        row.second.name = row.first;
+        sorted.push_back(row.second);
+    }
+
+    std::stable_sort(sorted.begin(), sorted.end(), [](const Profile_Row &left, const Profile_Row &right) {
+        return left.self != right.self ? left.self > right.self : left.total > right.total;
+    });
+
+    if (sorted.size() > limit) sorted.resize(limit);
+
+    std::cerr << "[PROFILE] " << std::setw(10) << "self ms" << std::setw(8) << "self" << std::setw(10) << "total ms" << std::setw(8) << "total" << "  " << heading << std::endl;
+
+    for (Profile_Row &row : sorted) {
+        std::cerr << "[PROFILE] "
+            << std::setw(10) << std::fixed << std::setprecision(1) << row.self * ms_per_tick
+            << std::setw(7) << 100.0 * row.self / ticks << "%"
+            << std::setw(10) << row.total * ms_per_tick
+            << std::setw(7) << 100.0 * row.total / ticks << "%"
+            << "  " << row.name << std::endl;
+    }
+
+    std::cerr.unsetf(std::ios::floatfield);
+    std::cerr << std::setprecision(6);
+}
+
+void report_profile(const std::string &collapsed_path) {
+    double elapsed_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - profile_start).count();
+    unsigned int ticks = 0;
+    unsigned int sample_count = 0;
+
+    std::map<std::string, Profile_Row> bugs;
+    std::map<std::string, Profile_Row> lines;
+    std::map<std::string, unsigned int> collapsed;
+
+    for (auto &sample : profile_samples) {
+        const std::vector<Profile_Frame> &frames = sample.first;
+        unsigned int weight = sample.second;
+        std::string stack;
+
+        // A bug or line that is on the stack more than once, through
+        // recursion, only counts once towards its total
+        std::set<std::string> seen_bugs;
+        std::set<std::string> seen_lines;
+
+        for (size_t i = 0; i < frames.size(); i++) {
+            std::string bug = get_frame_name(frames[i]);
+            std::string line = get_line_name(frames[i]);
+
+            if (seen_bugs.insert(bug).second) bugs[bug].total += weight;
+            if (seen_lines.insert(line).second) lines[line].total += weight;
+
+            stack += (i > 0 ? ";" : "") + bug;
+        }
+
+        bugs[get_frame_name(frames.back())].self += weight;
+        lines[get_line_name(frames.back())].self += weight;
+        collapsed[stack] += weight;
+
+        ticks += weight;
+        sample_count++;
+    }
+
+    if (ticks == 0) {
+        std::cerr << "[PROFILE] no samples, the script used less than " << PROFILE_INTERVAL_MS << " ms of CPU time" << std::endl;
+        return;
+    }
+
+    // Ticks are CPU time, which the kernel may count in coarser steps than
+    // asked for, and par loops use more than one CPU at once, so they're
+    // scaled to the time the script actually took
+    double ms_per_tick = elapsed_ms / profile_ticks.load(std::memory_order_relaxed);
+
+    std::cerr << "[PROFILE] " << ticks << " ticks over " << (int)elapsed_ms << " ms, in " << sample_count << " distinct stacks" << std::endl;
+    print_profile_rows(bugs, "bug", bugs.size(), ticks, ms_per_tick);
+    print_profile_rows(lines, "line", 20, ticks, ms_per_tick);
+
+    std::ofstream out_file(collapsed_path);
+
+    if (!out_file) {
+        report_warning("Cannot write the profile to " + collapsed_path);
+        return;
+    }
+
+    for (auto &stack : collapsed) out_file << stack.first << " " << stack.second << "\n";
+
+    std::cerr << "[PROFILE] collapsed stacks written to " << collapsed_path << std::endl;
+}
@@ -0,0 +1,49 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "lexer.hpp"
+#include "parser.hpp"
+
+// --profile samples where the script is spending its time. The kernel counts
+// off ticks of PROFILE_INTERVAL_MS of CPU time, and the engine running the
+// script notices a new tick at its next sampling point, the end of a
+// statement, and records its call stack there. A sample is weighted by the
+// ticks that went by since the last one, so time spent where the engine can't
+// stop, in natives, compiled bugs and par loops, is still all charged to the
+// statement that ran it.
+//
+// Workers in par loops never sample, their time shows up under the par loop.
+// Needs SIGPROF, so --profile is reported as unsupported on Windows.
+
+const unsigned int PROFILE_INTERVAL_MS = 1;
+
+struct Profile_Frame {
+    // NULL for the top level of the script
+    Ast_Function_Definition *def;
+
+    // Where the frame is up to: the call it's waiting on, or for the
+    // innermost frame the statement it just ran
+    Code_Site site;
+
+    Profile_Frame(Ast_Function_Definition *def, Code_Site site) {
+        this->def = def;
+        this->site = site;
+    }
+};
+
+extern bool is_profiling;
+extern std::atomic<unsigned int> profile_ticks;
+
+void start_profiler();
+
+// frames are outermost first, weight is the number of ticks the sample stands for
+void record_profile_sample(const std::vector<Profile_Frame> &frames, unsigned int weight);
+
+// Prints the per bug and per line tables and writes the collapsed stacks to
+// collapsed_path, one line per distinct stack, for flame graph tools
+void report_profile(const std::string &collapsed_path);
+
+#endif
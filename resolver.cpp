@@ -0,0 +1,297 @@
+#include <sstream>
+
+#include "logger.hpp"
+#include "resolver.hpp"
+#include "shel_lib.hpp"
+
+void Resolver::resolve(Ast_Block *root) {
+    push_scope(root);
+    resolve_block(root);
+    pop_scope();
+}
+
+void Resolver::resolve_block(Ast_Block *block) {
+    std::vector<Ast_Function_Definition *> pending;
+
+    for (Ast_Node *child : block->children) {
+        if (child->node_type != Ast_Node::Type::FUNCTION_DEFINITION) continue;
+
+        auto *def = (Ast_Function_Definition *)child;
+        scopes.back().functions[def->name] = def;
+        pending.push_back(def);
+    }
+
+    for (Ast_Node *child : block->children) {
+        resolve_statement(child);
+    }
+
+    for (Ast_Function_Definition *def : pending) {
+        resolve_function(def);
+    }
+}
+
+void Resolver::resolve_scoped_block(Ast_Block *block) {
+    push_scope(block);
+    resolve_block(block);
+    pop_scope();
+}
+
+void Resolver::resolve_function(Ast_Function_Definition *def) {
+    push_scope(def->block);
+
+    // Args take the first slots of the bug's scope, in order
+    for (Ast_Variable *arg : def->args) {
+        arg->depth = 0;
+        arg->slot = declare_variable(arg->name);
+    }
+
+    functions.push_back(def);
+    resolve_block(def->block);
+    functions.pop_back();
+
+    pop_scope();
+}
+
+void Resolver::resolve_statement(Ast_Node *node) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BLOCK:
+            resolve_block((Ast_Block *)node);
+            break;
+        case Ast_Node::Type::RETURN:
+            resolve_return((Ast_Return *)node);
+            break;
+        case Ast_Node::Type::IF: {
+            for (auto *if_node = (Ast_If *)node; if_node != NULL; if_node = if_node->failure) {
+                if (if_node->comparison != NULL) resolve_expression(if_node->comparison);
+                resolve_scoped_block(if_node->success);
+            }
+            break;
+        }
+        case Ast_Node::Type::WHILE: {
+            auto *while_node = (Ast_While *)node;
+            resolve_expression(while_node->comparison);
+            resolve_scoped_block(while_node->body);
+            break;
+        }
+        case Ast_Node::Type::LOOP:
+            resolve_loop((Ast_Loop *)node);
+            break;
+        case Ast_Node::Type::FUNCTION_CALL:
+            resolve_function_call((Ast_Function_Call *)node);
+            break;
+        case Ast_Node::Type::ASSIGNMENT:
+            resolve_assignment((Ast_Assignment *)node);
+            break;
+        default:
+            // Bug definitions are hoisted by resolve_block
+            break;
+    }
+}
+
+void Resolver::resolve_return(Ast_Return *node) {
+    resolve_expression(node->value);
+
+    // There's no single iteration that could return for the whole loop
+    if (par_loops.empty() == false && par_loops.back().function_count == functions.size()) {
+        report_fatal_error("Attempted to return from inside a par loop", node->site);
+    }
+
+    if (functions.empty() || node->value->node_type != Ast_Node::Type::FUNCTION_CALL) return;
+
+    // Only calls back into the same bug are tail calls, those are the ones
+    // that can reuse the frame as is
+    node->is_tail_call = ((Ast_Function_Call *)node->value)->definition == functions.back();
+}
+
+void Resolver::resolve_loop(Ast_Loop *loop_node) {
+    Ast_Variable *reduction = loop_node->reduction;
+
+    resolve_expression(loop_node->start);
+    resolve_expression(loop_node->to);
+    resolve_expression(loop_node->step);
+
+    if (reduction != NULL) {
+        if (find_variable(reduction->name, &reduction->depth, &reduction->slot) == false) {
+            std::stringstream ss;
+            ss << "Attempted to reduce into variable with the name '" << reduction->name << "', but none by that name exists.";
+            report_fatal_error(ss.str(), reduction->site);
+        }
+
+        fail_if_outside_par_loop(reduction, "reduce into");
+    }
+
+    // 'it' is always the first slot of the loop body, and a reduce variable
+    // is shadowed by the body's own copy in the second
+    push_scope(loop_node->body);
+    declare_variable("it");
+    if (reduction != NULL) declare_variable(reduction->name);
+
+    if (loop_node->is_parallel) par_loops.push_back(Resolver_Par_Loop(scopes.size() - 1, functions.size()));
+    resolve_block(loop_node->body);
+    if (loop_node->is_parallel) par_loops.pop_back();
+
+    pop_scope();
+}
+
+void Resolver::resolve_expression(Ast_Node *node) {
+    switch (node->node_type) {
+        case Ast_Node::Type::BINARY_OP: {
+            auto *op = (Ast_Binary_Op *)node;
+            resolve_expression(op->left);
+            resolve_expression(op->right);
+            break;
+        }
+        case Ast_Node::Type::UNARY_OP:
+            resolve_expression(((Ast_Unary_Op *)node)->node);
+            break;
+        case Ast_Node::Type::ARRAY:
+            for (Ast_Node *item : ((Ast_Array *)node)->items) resolve_expression(item);
+            break;
+        case Ast_Node::Type::FUNCTION_CALL:
+            resolve_function_call((Ast_Function_Call *)node);
+            break;
+        case Ast_Node::Type::VARIABLE:
+            resolve_variable((Ast_Variable *)node);
+            break;
+        default:
+            break;
+    }
+}
+
+void Resolver::resolve_assignment(Ast_Assignment *node) {
+    Ast_Variable *var = node->left;
+
+    // Right hand side is resolved before the declaration so that
+    // 'num x = x + 1;' still sees any outer x
+    resolve_expression(node->right);
+
+    if (node->is_first_assign) {
+        var->depth = 0;
+        var->slot = declare_variable(var->name);
+        return;
+    }
+
+    if (find_variable(var->name, &var->depth, &var->slot) == false) {
+        std::stringstream ss;
+        ss << "Attempted to reassign variable with the name '" << var->name << "', but none by that name exists.";
+        report_fatal_error(ss.str(), var->site);
+    }
+
+    fail_if_outside_par_loop(var, "reassign");
+}
+
+void Resolver::resolve_function_call(Ast_Function_Call *call) {
+    for (Ast_Node *arg : call->args) {
+        resolve_expression(arg);
+    }
+
+    // Bugs defined in the script shadow natives of the same name
+    call->definition = find_function(call->name, &call->depth);
+
+    if (call->definition != NULL) {
+        if (call->args.size() != call->definition->args.size()) {
+            std::stringstream ss;
+            ss << "Attempted to call '" << call->name << "' with an incorrect number of args. Expected " << call->definition->args.size()
+                << ", got " << call->args.size() << ".";
+            report_fatal_error(ss.str(), call->args_start_site);
+        }
+
+        return;
+    }
+
+    call->native = find_native_function(call->name);
+
+    if (call->native == NULL) {
+        std::stringstream ss;
+        ss << "Attempted to call bug '" << call->name << "', which is either not in scope or does not exist";
+        report_fatal_error(ss.str(), call->site);
+    }
+
+    if (call->native->arity != -1 && (int)call->args.size() != call->native->arity) {
+        report_fatal_error("Incorrect number of args passed", call->site);
+    }
+
+    // Folding has already turned constant formats into a single literal
+    if (call->native->handler == print && call->args.size() > 1 && call->args[0]->node_type == Ast_Node::Type::LITERAL) {
+        Value format = ((Ast_Literal *)call->args[0])->value;
+
+        if (format.data_type == Data_Type::STR && compile_print_format(format.str->text(), call->args.size() - 1, &call->format_pieces) == false) {
+            report_fatal_error("Wrong number of args passed to print", call->site);
+        }
+    }
+}
+
+void Resolver::resolve_variable(Ast_Variable *node) {
+    if (find_variable(node->name, &node->depth, &node->slot) == false) {
+        std::stringstream ss;
+        ss << "Use of unassigned variable '" << node->name << "'";
+        report_fatal_error(ss.str(), node->token.site);
+    }
+}
+
+void Resolver::push_scope(Ast_Block *block) {
+    scopes.push_back(Resolver_Scope(block));
+}
+
+void Resolver::pop_scope() {
+    Resolver_Scope &scope = scopes.back();
+
+    scope.block->frame_size = scope.frame_size;
+    scopes.pop_back();
+}
+
+int Resolver::declare_variable(std::string name) {
+    Resolver_Scope &scope = scopes.back();
+    auto existing = scope.variables.find(name);
+
+    // Redeclaring in the same scope reuses the slot
+    if (existing != scope.variables.end()) return existing->second;
+
+    int slot = scope.frame_size++;
+    scope.variables[name] = slot;
+
+    return slot;
+}
+
+// Scoping is lexical: scopes holds the blocks around the variable in the
+// source, so a bug never sees the locals of whoever calls it
+bool Resolver::find_variable(std::string name, int *depth, int *slot) {
+    int hops = 0;
+
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); scope++, hops++) {
+        auto found = scope->variables.find(name);
+
+        if (found != scope->variables.end()) {
+            *depth = hops;
+            *slot = found->second;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Bugs defined outside the loop can still be called from it, the engines
+// catch any reassignment they make while it runs
+void Resolver::fail_if_outside_par_loop(Ast_Variable *var, std::string action) {
+    if (par_loops.empty() || scopes.size() - 1 - var->depth >= par_loops.back().scope_index) return;
+
+    std::stringstream ss;
+    ss << "Attempted to " << action << " '" << var->name << "' from inside a par loop, which can only change variables declared in its body";
+    report_fatal_error(ss.str(), var->site);
+}
+
+Ast_Function_Definition *Resolver::find_function(std::string name, int *depth) {
+    int hops = 0;
+
+    for (auto scope = scopes.rbegin(); scope != scopes.rend(); scope++, hops++) {
+        auto found = scope->functions.find(name);
+
+        if (found != scope->functions.end()) {
+            *depth = hops;
+            return found->second;
+        }
+    }
+
+    return NULL;
+}
@@ -0,0 +1,72 @@
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "parser.hpp"
+
+struct Resolver_Scope {
+    Ast_Block *block;
+    int frame_size;
+    std::map<std::string, int> variables;
+    std::map<std::string, Ast_Function_Definition *> functions;
+
+    Resolver_Scope(Ast_Block *block) {
+        this->block = block;
+        this->frame_size = 0;
+    }
+};
+
+// Bodies of the par loops being resolved. Iterations of a par loop can run on
+// any thread, so they may only reassign variables declared in their own body,
+// plus the loop's reduce variable through the private copy in slot 1.
+struct Resolver_Par_Loop {
+    size_t scope_index;
+    size_t function_count;
+
+    Resolver_Par_Loop(size_t scope_index, size_t function_count) {
+        this->scope_index = scope_index;
+        this->function_count = function_count;
+    }
+};
+
+// Runs between parsing and execution, binding every variable to a (depth, slot)
+// pair and every bug call to its definition so the tree walker never has to
+// look anything up by name. Scoping follows the VM: bugs see the scope they
+// were defined in rather than the one they were called from, are visible to
+// their whole block, and have their bodies resolved once the block is done.
+//
+// if/while/from bodies and bug bodies each open a scope of their own, bare
+// blocks share the scope of their parent.
+struct Resolver {
+    std::vector<Resolver_Scope> scopes;
+
+    // Bugs whose bodies are being resolved, innermost last
+    std::vector<Ast_Function_Definition *> functions;
+
+    // Innermost last, see Resolver_Par_Loop
+    std::vector<Resolver_Par_Loop> par_loops;
+
+    void resolve(Ast_Block *root);
+
+    void resolve_block(Ast_Block *block);
+    void resolve_scoped_block(Ast_Block *block);
+    void resolve_function(Ast_Function_Definition *def);
+    void resolve_statement(Ast_Node *node);
+    void resolve_return(Ast_Return *node);
+    void resolve_loop(Ast_Loop *loop_node);
+    void resolve_expression(Ast_Node *node);
+    void resolve_assignment(Ast_Assignment *node);
+    void resolve_function_call(Ast_Function_Call *call);
+    void resolve_variable(Ast_Variable *node);
+
+    void push_scope(Ast_Block *block);
+    void pop_scope();
+    int declare_variable(std::string name);
+    bool find_variable(std::string name, int *depth, int *slot);
+    void fail_if_outside_par_loop(Ast_Variable *var, std::string action);
+    Ast_Function_Definition *find_function(std::string name, int *depth);
+};
+
+#endif
@@ -1,51 +1,62 @@
 #ifndef SCOPE_H
 #define SCOPE_H
 
-#include <map>
+#include <vector>
 #include "parser.hpp"
 #include "typer.hpp"
 
+// Runtime frame for one scope of the tree walker. Variables are read by the
+// (depth, slot) pairs bound by the resolver, a VOID slot is one that hasn't
+// been assigned yet.
+//
+// Slots live in a window of the interpreter's value stack rather than being
+// owned by the scope, so entering a scope only bumps the top of the stack and
+// leaving it drops it back. Scopes must be entered and left in strict LIFO
+// order, which falls out of them only ever living on the C++ stack.
 struct Scope {
-    int depth; // @CLEANUP Does scope need depth?
-    bool is_global_scope;
+    // Lexically enclosing scope, which depth hops are counted along
     Scope *parent;
-    std::map<std::string, Data_Atom *> variables;
-    std::map<std::string, Ast_Function_Definition *> functions;
 
-    Scope(Scope *parent) {
+    std::vector<Value> *stack;
+    size_t base;
+    int frame_size;
+
+    Scope(Scope *parent, std::vector<Value> *stack, int frame_size) {
         this->parent = parent;
-        this->depth = parent == NULL ? 0 : parent->depth + 1;
-        this->is_global_scope = depth == 0;
+        this->stack = stack;
+        this->base = stack->size();
+        this->frame_size = frame_size;
+
+        // Storage is kept when scopes are left, so this only allocates when
+        // the stack grows deeper than it has been before
+        stack->resize(base + frame_size);
     }
-};
 
-struct Func_With_Success {
-    Ast_Function_Definition *func_def;
-    bool was_success;
+    ~Scope() {
+        stack->resize(base);
+    }
 
-    Func_With_Success(Ast_Function_Definition *func_def, bool was_success) {
-        this->func_def = func_def;
-        this->was_success = was_success;
+    // Marks every slot from first onwards as unassigned, letting loops reuse
+    // one scope for all their iterations
+    void clear(int first) {
+        for (int i = first; i < frame_size; i++) (*stack)[base + i] = Value();
     }
 };
 
-struct Var_With_Success {
-    Data_Atom *data;
-    bool was_success;
-
-    Var_With_Success(Data_Atom *data, bool was_success) {
-        this->data = data;
-        this->was_success = was_success;
+inline Scope *get_scope(Scope *scope, int depth) {
+    while (depth > 0) {
+        scope = scope->parent;
+        depth--;
     }
-};
 
-Var_With_Success *get_var(Scope *scope, std::string name);
-Func_With_Success *get_func(Scope *scope, std::string name);
-void assign_var(Scope *scope, std::string name, Data_Atom *value);
-void reassign_var(Scope *scope, std::string name, Data_Atom *value, Code_Site *site);
-void set_func(Scope *scope, std::string name, Ast_Function_Definition *func);
-bool is_var_in_scope(Scope *scope, std::string name);
-bool is_func_in_scope(Scope *scope, std::string name);
+    return scope;
+}
+
+inline Value *get_slot(Scope *scope, int depth, int slot) {
+    Scope *owner = get_scope(scope, depth);
+    return &(*owner->stack)[owner->base + slot];
+}
+
 void print_contents(Scope *scope);
 
 #endif
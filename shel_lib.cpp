@@ -1,90 +1,306 @@
+#include <cmath>
 #include <iostream>
+#include <unordered_map>
 
+#include "gc.hpp"
+#include "kernels.hpp"
 #include "logger.hpp"
+#include "output.hpp"
+#include "par.hpp"
 #include "shel_lib.hpp"
 
-Native_Return_Data *call_native_function(std::string name, std::vector<Data_Atom *> args, Code_Site *site) {
-    if (name == "print") {
-        return print(args, site);
-    } else if (name == "array_get") {
-        return array_get(args, site);
-    } else if (name == "array_set") {
-        return array_set(args, site);
-    } else if (name == "array_len") {
-        return array_len(args, site);
-    } else if (name == "array_add") {
-        return array_add(args, site);
+// Nodes never move once inserted, so bound calls can hold on to their Native_Function
+static std::unordered_map<std::string, Native_Function> &get_native_registry() {
+    static std::unordered_map<std::string, Native_Function> registry;
+    static bool is_initialised = false;
+
+    // Built in before anything else can register, whatever order statics are set up in
+    if (is_initialised == false) {
+        is_initialised = true;
+
+        register_native_function("print",     -1, {},                                                   Data_Type::VOID,  print);
+        register_native_function("flush",      0, {},                                                   Data_Type::VOID,  flush);
+        register_native_function("array_get",  2, { Data_Type::ARRAY, Data_Type::NUM },                 Data_Type::ANY,   array_get);
+        register_native_function("array_set",  3, { Data_Type::ARRAY, Data_Type::NUM, Data_Type::ANY }, Data_Type::VOID,  array_set);
+        register_native_function("array_len",  1, { Data_Type::ARRAY },                                 Data_Type::NUM,   array_len);
+        register_native_function("array_add",  2, { Data_Type::ARRAY, Data_Type::ANY },                 Data_Type::VOID,  array_add);
+
+        register_native_function("array_sum",             1, { Data_Type::ARRAY },                                  Data_Type::NUM,   array_sum);
+        register_native_function("array_min",             1, { Data_Type::ARRAY },                                  Data_Type::NUM,   array_min);
+        register_native_function("array_max",             1, { Data_Type::ARRAY },                                  Data_Type::NUM,   array_max);
+        register_native_function("array_dot",             2, { Data_Type::ARRAY, Data_Type::ARRAY },                Data_Type::NUM,   array_dot);
+        register_native_function("array_scale",           2, { Data_Type::ARRAY, Data_Type::NUM },                  Data_Type::ARRAY, array_scale);
+        register_native_function("array_add_elementwise", 2, { Data_Type::ARRAY, Data_Type::ARRAY },                Data_Type::ARRAY, array_add_elementwise);
+        register_native_function("array_range",           3, { Data_Type::NUM, Data_Type::NUM, Data_Type::NUM },    Data_Type::ARRAY, array_range);
+        register_native_function("array_fill",            2, { Data_Type::NUM, Data_Type::ANY },                    Data_Type::ARRAY, array_fill);
     }
 
-    return new Native_Return_Data(false, NULL);
+    return registry;
+}
+
+void register_native_function(std::string name, int arity, std::vector<Data_Type> arg_types, Data_Type return_type, Native_Handler handler) {
+    auto &registry = get_native_registry();
+
+    if (arity != -1 && (int)arg_types.size() != arity) report_fatal_error("Native bug '" + name + "' has " + std::to_string(arg_types.size()) + " arg types but an arity of " + std::to_string(arity));
+    if (registry.find(name) != registry.end()) report_fatal_error("Native bug '" + name + "' is already registered");
+
+    Native_Function &native = registry[name];
+    native.name = name;
+    native.arity = arity;
+    native.arg_types = arg_types;
+    native.return_type = return_type;
+    native.handler = handler;
+}
+
+Native_Function *find_native_function(std::string name) {
+    auto &registry = get_native_registry();
+    auto found = registry.find(name);
+
+    return found == registry.end() ? NULL : &found->second;
 }
 
-Native_Return_Data *print(std::vector<Data_Atom *> args, Code_Site *site) {
+// Lines are built in a buffer that every print on the thread reuses, then
+// handed to the output buffer in one piece
+static std::string &get_print_line() {
+    static thread_local std::string line;
+
+    line.clear();
+    return line;
+}
+
+// Formats with more args than '%'s are rejected, extra '%'s are printed as is
+Value print(Native_Args args, Code_Site site) {
+    std::string &line = get_print_line();
+
     if (args.size() == 1) {
-        std::cout << atom_to_string(args[0]) << std::endl;
-        return new Native_Return_Data(true, NULL);
+        append_value_string(&line, args[0]);
+    } else {
+        size_t next = 1;
+
+        for (char c : args[0].str->text()) {
+            if (c == '%' && next < args.size()) {
+                append_value_string(&line, args[next++]);
+            } else {
+                line += c;
+            }
+        }
+
+        if (next < args.size()) report_fatal_error("Wrong number of args passed to print", site);
     }
 
-    std::string main_string = ((Str_Atom *)args[0])->value;
-    std::vector<std::string> str_args;
+    line += '\n';
+    write_output(line);
+
+    return Value();
+}
+
+Value print_compiled(const std::vector<std::string> &format_pieces, Native_Args args) {
+    std::string &line = get_print_line();
 
-    for (int i = 1; i < args.size(); i++) {
-        str_args.push_back(atom_to_string(args[i]));
+    line += format_pieces[0];
+
+    for (size_t i = 1; i < args.size(); i++) {
+        append_value_string(&line, args[i]);
+        line += format_pieces[i];
     }
 
-    std::string build = main_string;
+    line += '\n';
+    write_output(line);
+
+    return Value();
+}
+
+Value flush(Native_Args args, Code_Site site) {
+    flush_output();
+    return Value();
+}
+
+// Splits format at the first value_count '%'s, returning false if it has fewer
+bool compile_print_format(const std::string &format, size_t value_count, std::vector<std::string> *format_pieces) {
+    size_t start = 0;
+
+    format_pieces->clear();
 
-    for (auto other : str_args) {
-        size_t start_pos = build.find("%");
+    for (size_t i = 0; i < value_count; i++) {
+        size_t placeholder = format.find('%', start);
 
-        if (start_pos == std::string::npos) std::cerr << "Wrong number of args passed to print" << std::endl;
+        if (placeholder == std::string::npos) return false;
 
-        build.replace(start_pos, 1, other);
+        format_pieces->push_back(format.substr(start, placeholder - start));
+        start = placeholder + 1;
     }
 
-    std::cout << build << std::endl;
+    format_pieces->push_back(format.substr(start));
+    return true;
+}
 
-    return new Native_Return_Data(true, NULL);
+// NaN fails every comparison, and converting it or a fraction to an index is undefined
+static void fail_if_index_invalid(Array_Object *arr, float index, Code_Site site) {
+    if (index != index || index < 0 || index >= arr->size()) report_fatal_error("Index out of range", site);
+    if (index != std::floor(index)) report_fatal_error("Index must be a whole number", site);
 }
 
-Native_Return_Data *array_get(std::vector<Data_Atom *> args, Code_Site *site) {
-    if (args.size() != 2) report_fatal_error("Incorrect number of args passed", site);
+Value array_get(Native_Args args, Code_Site site) {
+    auto arr = args[0].array;
+    auto index = args[1].num;
 
-    auto arr = (Array_Atom *)args[0];
-    auto index = ((Num_Atom *)args[1])->value;
+    fail_if_index_invalid(arr, index, site);
+
+    return arr->get(index);
+}
 
-    if (index >= arr->items.size()) report_fatal_error("Index out of range", site);
+Value array_set(Native_Args args, Code_Site site) {
+    auto arr = args[0].array;
+    auto index = args[1].num;
 
-    return new Native_Return_Data(true, arr->items.at(index));
+    fail_if_index_invalid(arr, index, site);
+
+    // Anything else would box the items or need the write barrier while other threads use them
+    if (is_shared_array(arr)) {
+        if (is_heap_value(args[2])) report_fatal_error("Attempted to store a " + data_type_to_string(args[2].data_type) + " in an arr shared by a par loop", site);
+        if (arr->is_num_only && args[2].data_type != Data_Type::NUM) report_fatal_error("Attempted to store a non-num in a num arr shared by a par loop", site);
+    }
+
+    // Storing a non-num boxes a num arr, which reallocates it
+    size_t old_size = object_size(arr);
+
+    arr->set(index, args[2]);
+    heap.charge_growth(arr, old_size);
+    if (is_heap_value(args[2])) write_barrier(arr);
+
+    return Value();
 }
 
-Native_Return_Data *array_set(std::vector<Data_Atom *> args, Code_Site *site) {
-    if (args.size() != 2) report_fatal_error("Incorrect number of args passed", site);
+Value array_len(Native_Args args, Code_Site site) {
+    return num_value(args[0].array->size());
+}
+
+Value array_add(Native_Args args, Code_Site site) {
+    auto arr = args[0].array;
 
-    auto arr = (Array_Atom *)args[0];
-    auto index = ((Num_Atom *)args[1])->value;
-    auto value = args[2];
+    if (is_shared_array(arr)) report_fatal_error("Attempted to add to an arr shared by a par loop", site);
 
-    arr->items.at(index) = value;
+    size_t old_size = object_size(arr);
 
-    return new Native_Return_Data(true, NULL);
+    arr->add(args[1]);
+    heap.charge_growth(arr, old_size);
+    if (is_heap_value(args[1])) write_barrier(arr);
+
+    return Value();
 }
 
-Native_Return_Data *array_len(std::vector<Data_Atom *> args, Code_Site *site) {
-    if (args.size() != 1) report_fatal_error("Incorrect number of args passed", site);
+// Bulk natives work on the unboxed nums of an arr. Boxed arrs are copied into
+// scratch, as long as everything they hold is a num.
+static const float *get_nums(Array_Object *arr, std::string name, Code_Site site, std::vector<float> *scratch) {
+    if (arr->is_num_only) return arr->nums.data();
 
-    auto arr = (Array_Atom *)args[0];
+    scratch->reserve(arr->items.size());
 
-    return new Native_Return_Data(true, new Num_Atom(arr->items.size()));
+    for (Value item : arr->items) {
+        if (item.data_type != Data_Type::NUM) report_fatal_error("'" + name + "' expects an arr of nums, got an arr holding a " + data_type_to_string(item.data_type), site);
+        scratch->push_back(item.num);
+    }
+
+    return scratch->data();
+}
+
+static void fail_if_lengths_differ(Array_Object *a, Array_Object *b, std::string name, Code_Site site) {
+    if (a->size() != b->size()) {
+        report_fatal_error("'" + name + "' expects arrs of the same length, got " + std::to_string(a->size()) + " and " + std::to_string(b->size()), site);
+    }
+}
+
+Value array_sum(Native_Args args, Code_Site site) {
+    std::vector<float> scratch;
+    auto arr = args[0].array;
+
+    return num_value(sum_nums(get_nums(arr, "array_sum", site, &scratch), arr->size()));
+}
+
+Value array_min(Native_Args args, Code_Site site) {
+    std::vector<float> scratch;
+    auto arr = args[0].array;
+
+    if (arr->size() == 0) report_fatal_error("Attempted to take the min of an empty arr", site);
+
+    return num_value(min_nums(get_nums(arr, "array_min", site, &scratch), arr->size()));
+}
+
+Value array_max(Native_Args args, Code_Site site) {
+    std::vector<float> scratch;
+    auto arr = args[0].array;
+
+    if (arr->size() == 0) report_fatal_error("Attempted to take the max of an empty arr", site);
+
+    return num_value(max_nums(get_nums(arr, "array_max", site, &scratch), arr->size()));
+}
+
+Value array_dot(Native_Args args, Code_Site site) {
+    std::vector<float> a_scratch, b_scratch;
+    auto a = args[0].array;
+    auto b = args[1].array;
+
+    fail_if_lengths_differ(a, b, "array_dot", site);
+
+    return num_value(dot_nums(get_nums(a, "array_dot", site, &a_scratch), get_nums(b, "array_dot", site, &b_scratch), a->size()));
 }
 
-Native_Return_Data *array_add(std::vector<Data_Atom *> args, Code_Site *site) {
-    if (args.size() != 2) report_fatal_error("Incorrect number of args passed", site);
+Value array_scale(Native_Args args, Code_Site site) {
+    std::vector<float> scratch;
+    auto arr = args[0].array;
+    std::vector<float> nums(arr->size());
 
-    auto arr = (Array_Atom *)args[0];
-    auto value = args[1];
+    scale_nums(get_nums(arr, "array_scale", site, &scratch), args[1].num, nums.data(), nums.size());
 
-    arr->items.push_back(value);
+    return array_value(allocate_num_array(std::move(nums)));
+}
+
+Value array_add_elementwise(Native_Args args, Code_Site site) {
+    std::vector<float> a_scratch, b_scratch;
+    auto a = args[0].array;
+    auto b = args[1].array;
+
+    fail_if_lengths_differ(a, b, "array_add_elementwise", site);
+
+    std::vector<float> nums(a->size());
+    add_nums(get_nums(a, "array_add_elementwise", site, &a_scratch), get_nums(b, "array_add_elementwise", site, &b_scratch), nums.data(), nums.size());
+
+    return array_value(allocate_num_array(std::move(nums)));
+}
+
+// Holds exactly the values 'it' takes in 'from start to end step step'
+Value array_range(Native_Args args, Code_Site site) {
+    float start = args[0].num;
+    float end = args[1].num;
+    float step = args[2].num;
+
+    if (step < 0 && start < end) report_fatal_error("from < to but step value is negative", site);
+    if (step > 0 && start > end) report_fatal_error("to > from but step value is positive", site);
+    if (step == 0) report_fatal_error("step value cannot be 0", site);
+
+    std::vector<float> nums;
+    bool is_going_up = step > 0;
+
+    for (float i = start; is_going_up ? i < end : i > end; i += step) {
+        if (i + step == i) report_fatal_error("step value is too small to change the range", site);
+        nums.push_back(i);
+    }
+
+    return array_value(allocate_num_array(std::move(nums)));
+}
+
+static const float MAX_FILL_ITEMS = 1 << 26;
+
+Value array_fill(Native_Args args, Code_Site site) {
+    float count = args[0].num;
+    Value value = args[1];
+
+    // Checked as a float, as converting NaN, infinity or anything past size_t is undefined
+    if (count != count || count < 0 || count > MAX_FILL_ITEMS) report_fatal_error("Attempted to fill an arr with an invalid number of items", site);
+
+    if (value.data_type == Data_Type::NUM) {
+        return array_value(allocate_num_array(std::vector<float>(size_t(count), value.num)));
+    }
 
-    return new Native_Return_Data(true, NULL);
+    return array_value(allocate_array(std::vector<Value>(size_t(count), value)));
 }
@@ -1,20 +1,65 @@
+#ifndef SHEL_LIB_H
+#define SHEL_LIB_H
+
+#include <string>
 #include <vector>
 
 #include "typer.hpp"
 
-struct Native_Return_Data {
-    bool was_success;
-    void *return_value;
+// Args of a native call, a window onto the calling engine's value stack. It
+// is only valid until the native returns, and natives must not keep it.
+struct Native_Args {
+    Value *values;
+    size_t count;
+
+    Native_Args(Value *values, size_t count) {
+        this->values = values;
+        this->count = count;
+    }
+
+    size_t size() const {
+        return count;
+    }
 
-    Native_Return_Data(bool was_success, void *return_value) {
-        this->was_success = was_success;
-        this->return_value = return_value;
+    Value &operator[](size_t index) const {
+        return values[index];
     }
 };
 
-Native_Return_Data *call_native_function(std::string name, std::vector<Data_Atom *> args, Code_Site *site);
-Native_Return_Data *print(std::vector<Data_Atom *> args, Code_Site *site);
-Native_Return_Data *array_get(std::vector<Data_Atom *> args, Code_Site *site);
-Native_Return_Data *array_set(std::vector<Data_Atom *> args, Code_Site *site);
-Native_Return_Data *array_len(std::vector<Data_Atom *> args, Code_Site *site);
-Native_Return_Data *array_add(std::vector<Data_Atom *> args, Code_Site *site);
+// Natives return void as Value(). Arg count and types have already been
+// checked against the registration by the time the handler runs.
+typedef Value (*Native_Handler)(Native_Args args, Code_Site site);
+
+// A bug implemented in C++. The resolver binds calls to these once, and the
+// checker holds calls to their types. ANY args accept anything, and an arity
+// of -1 takes any number of args.
+struct Native_Function {
+    std::string name;
+    int arity;
+    std::vector<Data_Type> arg_types;
+    Data_Type return_type;
+    Native_Handler handler;
+};
+
+// Host applications can add their own natives, as long as they are registered
+// before any script that calls them is compiled. Names must be unique.
+void register_native_function(std::string name, int arity, std::vector<Data_Type> arg_types, Data_Type return_type, Native_Handler handler);
+Native_Function *find_native_function(std::string name);
+Value print(Native_Args args, Code_Site site);
+Value print_compiled(const std::vector<std::string> &format_pieces, Native_Args args);
+Value flush(Native_Args args, Code_Site site);
+bool compile_print_format(const std::string &format, size_t value_count, std::vector<std::string> *format_pieces);
+Value array_get(Native_Args args, Code_Site site);
+Value array_set(Native_Args args, Code_Site site);
+Value array_len(Native_Args args, Code_Site site);
+Value array_add(Native_Args args, Code_Site site);
+Value array_sum(Native_Args args, Code_Site site);
+Value array_min(Native_Args args, Code_Site site);
+Value array_max(Native_Args args, Code_Site site);
+Value array_dot(Native_Args args, Code_Site site);
+Value array_scale(Native_Args args, Code_Site site);
+Value array_add_elementwise(Native_Args args, Code_Site site);
+Value array_range(Native_Args args, Code_Site site);
+Value array_fill(Native_Args args, Code_Site site);
+
+#endif
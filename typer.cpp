@@ -1,5 +1,101 @@
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include "gc.hpp"
 #include "typer.hpp"
 
+Array_Object::Array_Object(std::vector<Value> items) {
+    this->object_type = Data_Type::ARRAY;
+    this->is_num_only = true;
+
+    for (Value item : items) {
+        if (item.data_type != Data_Type::NUM) {
+            this->is_num_only = false;
+            this->items = items;
+            return;
+        }
+    }
+
+    this->nums.reserve(items.size());
+    for (Value item : items) this->nums.push_back(item.num);
+}
+
+Value Array_Object::get(size_t index) {
+    return is_num_only ? num_value(nums[index]) : items[index];
+}
+
+void Array_Object::set(size_t index, Value value) {
+    if (is_num_only && value.data_type != Data_Type::NUM) box();
+
+    if (is_num_only) {
+        nums[index] = value.num;
+    } else {
+        items[index] = value;
+    }
+}
+
+void Array_Object::add(Value value) {
+    if (is_num_only && value.data_type != Data_Type::NUM) box();
+
+    if (is_num_only) {
+        nums.push_back(value.num);
+    } else {
+        items.push_back(value);
+    }
+}
+
+void Array_Object::box() {
+    items.reserve(nums.size());
+    for (float num : nums) items.push_back(num_value(num));
+
+    is_num_only = false;
+    std::vector<float>().swap(nums);
+}
+
+void Str_Object::flatten() {
+    static std::mutex flatten_lock;
+    std::lock_guard<std::mutex> guard(flatten_lock);
+
+    if (is_flat) return;
+
+    size_t old_size = object_size(this);
+
+    // Appending is usually done in a loop, which leaves a rope as deep as the
+    // loop ran, so it is walked with a stack of its own rather than recursion
+    std::string text;
+    std::vector<Str_Object *> pending;
+
+    text.reserve(length);
+    pending.push_back(right);
+    pending.push_back(left);
+
+    while (pending.empty() == false) {
+        Str_Object *node = pending.back();
+        pending.pop_back();
+
+        if (node->is_flat) {
+            text += node->flat_text;
+        } else {
+            pending.push_back(node->right);
+            pending.push_back(node->left);
+        }
+    }
+
+    flat_text.swap(text);
+    left = NULL;
+    right = NULL;
+    is_flat.store(true, std::memory_order_release);
+
+    // The flat copy is new memory as far as the heap is concerned, the halves
+    // it was made from stay charged until they're collected
+    heap.charge_growth(this, old_size);
+}
+
+bool strs_equal(Str_Object *a, Str_Object *b) {
+    return a == b || (a->length == b->length && a->text() == b->text());
+}
+
 std::string data_type_to_string(Data_Type type) {
     switch (type) {
         case Data_Type::NUM:   return "num";
@@ -7,52 +103,79 @@ std::string data_type_to_string(Data_Type type) {
         case Data_Type::BOOL:  return "bool";
         case Data_Type::ARRAY: return "arr";
         case Data_Type::VOID:  return "void";
+        case Data_Type::ANY:   return "any";
         default:               return "";
     }
 }
 
-std::string atom_to_string(Data_Atom *atom) {
-    switch (atom->data_type) {
+std::string value_to_string(Value value) {
+    std::string text;
+    append_value_string(&text, value);
+
+    return text;
+}
+
+// Appends straight onto the end of text, so printing an arr doesn't build a
+// string for every item along the way
+void append_value_string(std::string *text, Value value) {
+    switch (value.data_type) {
         case Data_Type::NUM: {
             const unsigned int dp_count = 2;
-            float value = ((Num_Atom *)atom)->value;
-            std::string base_string = std::to_string(value);
-            int dp_index = base_string.find(".");
-            std::string from_decimal_point = base_string.substr(dp_index);
+            char buffer[64];
+            int length = snprintf(buffer, sizeof(buffer), "%f", value.num);
+            const char *dp = strchr(buffer, '.');
+
+            // inf and nan have no decimal point
+            if (dp == NULL) {
+                text->append(buffer, length);
+                return;
+            }
+
             bool is_all_zeroes = true;
 
-            for (int i = 1; i < from_decimal_point.size(); i++) {
-                if (from_decimal_point[i] != '0') {
+            for (const char *digit = dp + 1; *digit != '\0'; digit++) {
+                if (*digit != '0') {
                     is_all_zeroes = false;
                     break;
                 }
             }
 
-            if (is_all_zeroes) return base_string.substr(0, dp_index);
-            return dp_index + dp_count + 1 > base_string.size() ? base_string : base_string.substr(0, dp_index + dp_count + 1);
+            if (is_all_zeroes) {
+                text->append(buffer, dp - buffer);
+            } else {
+                text->append(buffer, dp + dp_count + 1 > buffer + length ? length : dp - buffer + dp_count + 1);
+            }
+
+            return;
         }
-        case Data_Type::STR: return ((Str_Atom *)atom)->value;
-        case Data_Type::BOOL: return ((Bool_Atom *)atom)->value ? "true" : "false";
-        case Data_Type::ARRAY:   {
-            std::string ret = "[";
-            auto arr = ((Array_Atom *)atom);
-            size_t children_size = arr->items.size();
+        case Data_Type::STR:
+            *text += value.str->text();
+            return;
+        case Data_Type::BOOL:
+            *text += value.boolean ? "true" : "false";
+            return;
+        case Data_Type::ARRAY: {
+            auto arr = value.array;
+            size_t children_size = arr->size();
 
-            for (int i = 0; i < children_size; i++) {
-                ret += atom_to_string(arr->items.at(i));
+            *text += "[";
 
-                if (i < children_size - 1) ret += ", ";
+            for (size_t i = 0; i < children_size; i++) {
+                append_value_string(text, arr->get(i));
+
+                if (i < children_size - 1) *text += ", ";
             }
 
-            ret += "]";
-            return ret;
+            *text += "]";
+            return;
         }
-        default: return "";
+        default:
+            return;
     }
 }
 
-Data_Type token_to_data_type(Token *token) {
-    switch (token->type) {
+Data_Type token_to_data_type(Token token) {
+    switch (token.type) {
         case Token::Type::KEYWORD_NUM:   return Data_Type::NUM;
         case Token::Type::KEYWORD_STR:   return Data_Type::STR;
         case Token::Type::KEYWORD_BOOL:  return Data_Type::BOOL;
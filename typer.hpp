@@ -1,7 +1,9 @@
 #ifndef TYPER_H
 #define TYPER_H
 
+#include <atomic>
 #include <string>
+#include <utility>
 #include <vector>
 #include "lexer.hpp"
 
@@ -10,51 +12,154 @@ enum Data_Type {
     STR,
     BOOL,
     ARRAY,
-    VOID
+    VOID,
+
+    // Never held by a Value, the checker uses it for expressions whose type
+    // is only known at runtime, e.g. items read back out of an arr
+    ANY
 };
 
-struct Data_Atom {
-    Data_Type data_type = Data_Type::VOID;
+// Header shared by everything owned by the garbage collected heap (see gc.hpp)
+struct Heap_Object {
+    Heap_Object *next = NULL;
+    Data_Type object_type;
+    bool is_marked = false;
+    bool is_old = false;
+    bool is_remembered = false;
 };
 
-struct Num_Atom : Data_Atom {
-    float value;
+struct Str_Object;
+struct Array_Object;
+
+// Runtime values are passed around by value. Nums and bools are held inline,
+// only strs and arrs point into the heap.
+struct Value {
+    Data_Type data_type;
+
+    union {
+        float num;
+        bool boolean;
+        Str_Object *str;
+        Array_Object *array;
+        Heap_Object *object;
+    };
 
-    Num_Atom(float value) {
-        this->value = value;
-        this->data_type = Data_Type::NUM;
+    Value() {
+        this->data_type = Data_Type::VOID;
+        this->array = NULL;
     }
 };
 
-struct Str_Atom : Data_Atom {
-    std::string value;
+// Strs are immutable, so values and variables all share one object. '+' on
+// long strs makes a rope node that only points at its two halves, and the text
+// is only built the first time something reads it, after which the node drops
+// its halves and is flat like any other str. Appending to a str over and over
+// is linear rather than copying everything built so far on each '+'.
+//
+// The text should only ever be read through text().
+struct Str_Object : Heap_Object {
+    std::string flat_text;
+    Str_Object *left;
+    Str_Object *right;
+    size_t length;
 
-    Str_Atom(std::string value) {
-        this->value = value;
-        this->data_type = Data_Type::STR;
+    // Set once the halves are gone, checked without a lock so that threads in a
+    // par loop can share a rope and still only flatten it once
+    std::atomic<bool> is_flat;
+
+    Str_Object(std::string value) {
+        this->flat_text = std::move(value);
+        this->left = NULL;
+        this->right = NULL;
+        this->length = flat_text.size();
+        this->is_flat = true;
+        this->object_type = Data_Type::STR;
     }
-};
 
-struct Bool_Atom : Data_Atom {
-    bool value;
+    Str_Object(Str_Object *left, Str_Object *right) {
+        this->left = left;
+        this->right = right;
+        this->length = left->length + right->length;
+        this->is_flat = false;
+        this->object_type = Data_Type::STR;
+    }
 
-    Bool_Atom(bool value) {
-        this->value = value;
-        this->data_type = Data_Type::BOOL;
+    const std::string &text() {
+        if (is_flat.load(std::memory_order_acquire) == false) flatten();
+        return flat_text;
     }
+
+    void flatten();
 };
 
-struct Array_Atom : Data_Atom  {
-    std::vector<Data_Atom *> items;
+bool strs_equal(Str_Object *a, Str_Object *b);
+
+// Arrs that only ever held nums keep them unboxed in nums, a quarter of the
+// size of the equivalent Values and with nothing for the collector to trace.
+// The first time anything else is stored the arr is boxed into items for the
+// rest of its life. Only one of the two vectors is in use at a time, so items
+// should always be accessed through size, get, set and add.
+struct Array_Object : Heap_Object {
+    bool is_num_only;
+    std::vector<float> nums;
+    std::vector<Value> items;
+
+    // Par loop run the arr was allocated in, see is_shared_array
+    unsigned int epoch = 0;
 
-    Array_Atom(std::vector<Data_Atom *> items) {
-        this->items = items;
-        this->data_type = Data_Type::ARRAY;
+    Array_Object(std::vector<Value> items);
+
+    Array_Object(std::vector<float> nums) {
+        this->object_type = Data_Type::ARRAY;
+        this->is_num_only = true;
+        this->nums.swap(nums);
+    }
+
+    size_t size() {
+        return is_num_only ? nums.size() : items.size();
     }
+
+    Value get(size_t index);
+    void set(size_t index, Value value);
+    void add(Value value);
+    void box();
 };
 
+inline bool is_heap_value(Value value) {
+    return value.data_type == Data_Type::STR || value.data_type == Data_Type::ARRAY;
+}
+
+inline Value num_value(float num) {
+    Value value;
+    value.data_type = Data_Type::NUM;
+    value.num = num;
+    return value;
+}
+
+inline Value bool_value(bool boolean) {
+    Value value;
+    value.data_type = Data_Type::BOOL;
+    value.boolean = boolean;
+    return value;
+}
+
+inline Value str_value(Str_Object *str) {
+    Value value;
+    value.data_type = Data_Type::STR;
+    value.str = str;
+    return value;
+}
+
+inline Value array_value(Array_Object *array) {
+    Value value;
+    value.data_type = Data_Type::ARRAY;
+    value.array = array;
+    return value;
+}
+
 std::string data_type_to_string(Data_Type type);
-std::string atom_to_string(Data_Atom *atom);
-Data_Type token_to_data_type(Token *token);
+std::string value_to_string(Value value);
+void append_value_string(std::string *text, Value value);
+Data_Type token_to_data_type(Token token);
 
 #endif
@@ -0,0 +1,51 @@
+#include <chrono>
+#include <iostream>
+
+#include "cache.hpp"
+#include "checker.hpp"
+#include "folder.hpp"
+#include "memo.hpp"
+#include "resolver.hpp"
+#include "unit.hpp"
+
+void Compilation_Unit::compile(const std::string &source) {
+    lexer = arena.make<Lexer>(file_name, source, &arena);
+
+    if (load_cached_tree(this, source)) return;
+
+    auto lex_start = std::chrono::steady_clock::now();
+    lexer->lex();
+    std::chrono::duration<double, std::milli> lex_time = std::chrono::steady_clock::now() - lex_start;
+    lex_ms = lex_time.count();
+
+    parser = arena.make<Parser>(&lexer->tokens, Token::Type::END_OF_FILE, &arena);
+    root = parser->parse();
+
+    Folder folder(&arena);
+    folder.fold(root);
+    folded_count = folder.folded_count;
+
+    Resolver resolver;
+    resolver.resolve(root);
+
+    Checker checker;
+    checker.check(root);
+
+    Memoizer memoizer(&arena);
+    memoizer.memoize(root);
+    memoized = memoizer.memoized;
+
+    save_cached_tree(this, source);
+}
+
+void report_lex_stats(Compilation_Unit *unit) {
+    if (unit->is_from_cache) {
+        std::cerr << "[LEX] " << unit->lexer->file_string.size() << " bytes, skipped as the tree was loaded from the cache" << std::endl;
+        return;
+    }
+
+    double megabytes = unit->lexer->file_string.size() / (1024.0 * 1024.0);
+    double throughput = unit->lex_ms > 0 ? megabytes / (unit->lex_ms / 1000.0) : 0;
+
+    std::cerr << "[LEX] " << unit->lexer->file_string.size() << " bytes, " << unit->lexer->tokens.size() << " tokens in " << unit->lex_ms << " ms (" << throughput << " MB/s)" << std::endl;
+}
@@ -0,0 +1,43 @@
+#ifndef UNIT_H
+#define UNIT_H
+
+#include <string>
+#include <vector>
+#include "arena.hpp"
+#include "lexer.hpp"
+#include "parser.hpp"
+
+// Owns everything produced while compiling a single source file. The token
+// stream and Ast_Nodes are all allocated from the unit's arena and are
+// released together when the unit is destroyed, so the unit has to outlive
+// any engine that is running its tree.
+struct Compilation_Unit {
+    std::string file_name;
+    Arena arena;
+    Lexer *lexer = NULL;
+    Parser *parser = NULL;
+    Ast_Block *root = NULL;
+
+    double lex_ms = 0;
+    int folded_count = 0;
+
+    // Set when the tree came from the cache, see cache.hpp. The lexer still
+    // holds the source for sites to point into, but never ran.
+    bool is_from_cache = false;
+    std::vector<Ast_Function_Definition *> memoized;
+
+    Compilation_Unit(const std::string file_name) {
+        this->file_name = file_name;
+    }
+
+    ~Compilation_Unit() {
+        // Sites can outlive the unit, they just can't be resolved to a line any more
+        if (lexer != NULL) release_source_file(lexer->file_id);
+    }
+
+    void compile(const std::string &source);
+};
+
+void report_lex_stats(Compilation_Unit *unit);
+
+#endif
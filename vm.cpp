@@ -0,0 +1,601 @@
+#include <cmath>
+#include <iostream>
+#include <sstream>
+
+#include "checker.hpp"
+#include "compiler.hpp"
+#include "gc.hpp"
+#include "interp.hpp"
+#include "jit.hpp"
+#include "logger.hpp"
+#include "par.hpp"
+#include "shel_lib.hpp"
+#include "vm.hpp"
+
+#define READ_U8()  (*ip++)
+#define READ_U16() (ip += 2, (uint16_t)(ip[-2] | (ip[-1] << 8)))
+#define READ_U32() (ip += 4, (uint32_t)ip[-4] | ((uint32_t)ip[-3] << 8) | ((uint32_t)ip[-2] << 16) | ((uint32_t)ip[-1] << 24))
+
+#define PUSH(value) (*stack_top++ = (value))
+#define POP()       (*--stack_top)
+
+#define LOAD_FRAME() do { \
+    code = frame->function->chunk.code.data(); \
+    constants = frame->function->chunk.constants.data(); \
+    ip = frame->ip; \
+    slots = frame->slots; \
+} while (false)
+
+// Everything live is on the value stack between instructions, so the
+// collector can run after any instruction that allocates
+#define SAFEPOINT() do { \
+    if (heap.should_collect()) collect_garbage(); \
+} while (false)
+
+// Instructions that end a statement or go round a loop are where the VM
+// notices the profiler's ticks, see profile.hpp
+#define PROFILE_POINT() do { \
+    if (profile_ticks.load(std::memory_order_relaxed) != seen_profile_ticks) sample_profile(frame, ip); \
+} while (false)
+
+#define BINARY_NUM_OP(result) do { \
+    Value right = POP(); \
+    Value left = POP(); \
+    if (left.data_type != Data_Type::NUM || right.data_type != Data_Type::NUM) fail_binary_op(this, frame, ip, left, right); \
+    float l = left.num; \
+    float r = right.num; \
+    PUSH(result); \
+} while (false)
+
+#define BINARY_BOOL_OP(result) do { \
+    Value right = POP(); \
+    Value left = POP(); \
+    if (left.data_type != Data_Type::BOOL || right.data_type != Data_Type::BOOL) fail_binary_op(this, frame, ip, left, right); \
+    bool l = left.boolean; \
+    bool r = right.boolean; \
+    PUSH(bool_value(result)); \
+} while (false)
+
+static void fail_binary_op(VM *vm, Call_Frame *frame, uint8_t *ip, Value left, Value right) {
+    auto *node = (Ast_Binary_Op *)vm->origin_of(frame, ip);
+
+    // Reports the same errors as the tree walker when it can...
+    fail_if_binary_op_invalid(left, right, node->op);
+
+    // ...but the walker lets arrays through to arithmetic, which we don't
+    std::stringstream ss;
+    ss << "Cannot perform '" << node->op.value() << "' on expressions of type '" << data_type_to_string(left.data_type) << "'";
+    report_fatal_error(ss.str(), node->op.site);
+}
+
+static void fail_unary_op(VM *vm, Call_Frame *frame, uint8_t *ip, Value value) {
+    auto *node = (Ast_Unary_Op *)vm->origin_of(frame, ip);
+
+    std::stringstream ss;
+    ss << "Attempted invalid unary operation on " << data_type_to_string(value.data_type) << " value";
+    report_fatal_error(ss.str(), node->op.site);
+}
+
+static void fail_store_outside_par_loop(VM *vm, Call_Frame *frame, uint8_t *ip) {
+    Ast_Node *origin = vm->origin_of(frame, ip);
+
+    // Folding a reduction back in stores on behalf of the variable itself
+    Ast_Variable *var = origin->node_type == Ast_Node::Type::ASSIGNMENT ? ((Ast_Assignment *)origin)->left : (Ast_Variable *)origin;
+
+    std::stringstream ss;
+    ss << "Attempted to reassign '" << var->name << "' from inside a par loop, which can only change variables declared in its body";
+    report_fatal_error(ss.str(), var->site);
+}
+
+static bool values_equal(Value left, Value right, bool *is_valid) {
+    *is_valid = true;
+
+    switch (left.data_type) {
+        case Data_Type::NUM:  return left.num == right.num;
+        case Data_Type::STR:  return strs_equal(left.str, right.str);
+        case Data_Type::BOOL: return left.boolean == right.boolean;
+        default:
+            *is_valid = false;
+            return false;
+    }
+}
+
+Ast_Node *VM::origin_of(Call_Frame *frame, uint8_t *ip) {
+    Chunk *chunk = &frame->function->chunk;
+    return chunk->origin_at(ip - chunk->code.data() - 1);
+}
+
+void VM::report_runtime_error(std::string error, Call_Frame *frame, uint8_t *ip) {
+    Ast_Node *origin = origin_of(frame, ip);
+
+    if (origin == NULL) report_fatal_error(error);
+    report_fatal_error(error, origin->site);
+}
+
+void VM::collect_garbage() {
+    heap.begin_collection();
+
+    for (Value *value = stack; value < stack_top; value++) heap.mark_value(*value);
+
+    for (Bytecode_Function *function : program->functions) {
+        for (Value constant : function->chunk.constants) heap.mark_value(constant);
+    }
+
+    heap.finish_collection();
+}
+
+void VM::sample_profile(Call_Frame *frame, uint8_t *ip) {
+    unsigned int ticks = profile_ticks.load(std::memory_order_relaxed);
+    unsigned int weight = ticks - seen_profile_ticks;
+    seen_profile_ticks = ticks;
+
+    if (is_profiling == false) return;
+
+    // Callers' ips were saved just past their calls
+    frame->ip = ip;
+    profile_frames.clear();
+
+    for (int i = 0; i < frame_count; i++) {
+        Bytecode_Function *function = frames[i].function;
+        Ast_Node *origin = origin_of(&frames[i], frames[i].ip);
+
+        profile_frames.push_back(Profile_Frame(function->definition, origin != NULL ? origin->site : function->site));
+    }
+
+    record_profile_sample(profile_frames, weight);
+}
+
+void VM::run() {
+    Call_Frame *frame = &frames[frame_count - 1];
+    uint8_t *code;
+    uint8_t *ip;
+    Value *constants;
+    Value *slots;
+
+    LOAD_FRAME();
+
+    for (;;) {
+        switch (READ_U8()) {
+            case OP_CONSTANT: {
+                PUSH(constants[READ_U32()]);
+                break;
+            }
+            case OP_VOID: {
+                PUSH(Value());
+                break;
+            }
+            case OP_POP: {
+                stack_top--;
+                PROFILE_POINT();
+                break;
+            }
+            case OP_LOAD_LOCAL: {
+                Value value = slots[READ_U16()];
+
+                // Variables can never hold void, so a void slot hasn't been assigned yet
+                if (value.data_type == Data_Type::VOID) {
+                    std::stringstream ss;
+                    ss << "Use of unassigned variable '" << ((Ast_Variable *)origin_of(frame, ip))->name << "'";
+                    report_runtime_error(ss.str(), frame, ip);
+                }
+
+                PUSH(value);
+                break;
+            }
+            case OP_LOAD_OUTER: {
+                Call_Frame *outer = frame;
+
+                for (int hops = READ_U8(); hops > 0; hops--) outer = outer->enclosing;
+
+                Value value = outer->slots[READ_U16()];
+
+                if (value.data_type == Data_Type::VOID) {
+                    std::stringstream ss;
+                    ss << "Use of unassigned variable '" << ((Ast_Variable *)origin_of(frame, ip))->name << "'";
+                    report_runtime_error(ss.str(), frame, ip);
+                }
+
+                PUSH(value);
+                break;
+            }
+            case OP_DECLARE_LOCAL: {
+                uint16_t slot = READ_U16();
+                Data_Type data_type = (Data_Type)READ_U8();
+                Value value = POP();
+
+                if (value.data_type != data_type) {
+                    std::stringstream ss;
+                    ss << "Tried to assign expression of type '" << data_type_to_string(value.data_type)
+                        << "' to variable of type '" << data_type_to_string(data_type) << "'";
+                    report_fatal_error(ss.str(), ((Ast_Assignment *)origin_of(frame, ip))->right->site);
+                }
+
+                slots[slot] = value;
+                PROFILE_POINT();
+                break;
+            }
+            case OP_CLEAR_LOCALS: {
+                uint16_t first = READ_U16();
+                uint16_t count = READ_U16();
+
+                for (Value *slot = slots + first; slot < slots + first + count; slot++) *slot = Value();
+                break;
+            }
+            case OP_STORE_LOCAL:
+            case OP_STORE_OUTER: {
+                Call_Frame *outer = frame;
+
+                if (code[ip - code - 1] == OP_STORE_OUTER) {
+                    for (int hops = READ_U8(); hops > 0; hops--) outer = outer->enclosing;
+                }
+
+                Value *target = &outer->slots[READ_U16()];
+                Value value = POP();
+
+                if (target < par_floor) fail_store_outside_par_loop(this, frame, ip);
+
+                auto *node = (Ast_Assignment *)origin_of(frame, ip);
+
+                if (target->data_type == Data_Type::VOID) {
+                    std::stringstream ss;
+                    ss << "Attempted to reassign variable with the name '" << node->left->name << "', but none by that name exists.";
+                    report_fatal_error(ss.str());
+                }
+
+                if (target->data_type != value.data_type) {
+                    std::stringstream ss;
+                    ss << "Tried to reassign variable of type '" <<  data_type_to_string(target->data_type)
+                        << "' to expression of type '" << data_type_to_string(value.data_type) << "'";
+                    report_fatal_error(ss.str(), node->right->site);
+                }
+
+                *target = value;
+                PROFILE_POINT();
+                break;
+            }
+            case OP_ADD: {
+                Value right = POP();
+                Value left = POP();
+
+                if (left.data_type == Data_Type::NUM && right.data_type == Data_Type::NUM) {
+                    PUSH(num_value(left.num + right.num));
+                } else if (left.data_type == Data_Type::STR && right.data_type == Data_Type::STR) {
+                    PUSH(str_value(concat_strs(left.str, right.str)));
+                    SAFEPOINT();
+                } else {
+                    fail_binary_op(this, frame, ip, left, right);
+                }
+
+                break;
+            }
+            case OP_SUBTRACT:               BINARY_NUM_OP(num_value(l - r)); break;
+            case OP_MULTIPLY:               BINARY_NUM_OP(num_value(l * r)); break;
+            case OP_DIVIDE:                 BINARY_NUM_OP(num_value(l / r)); break;
+            case OP_MODULO:                 BINARY_NUM_OP(num_value(float(int(l) % int(r)))); break;
+            case OP_EXPONENT:               BINARY_NUM_OP(num_value(pow(l, r))); break;
+            case OP_LESS_THAN:              BINARY_NUM_OP(bool_value(l < r)); break;
+            case OP_GREATER_THAN:           BINARY_NUM_OP(bool_value(l > r)); break;
+            case OP_LESS_THAN_EQUALS:       BINARY_NUM_OP(bool_value(l <= r)); break;
+            case OP_GREATER_THAN_EQUALS:    BINARY_NUM_OP(bool_value(l >= r)); break;
+            case OP_AND:                    BINARY_BOOL_OP(l && r); break;
+            case OP_OR:                     BINARY_BOOL_OP(l || r); break;
+            case OP_EQUALS:
+            case OP_NOT_EQUALS: {
+                Value right = POP();
+                Value left = POP();
+                bool is_valid = left.data_type == right.data_type;
+                bool is_equal = is_valid && values_equal(left, right, &is_valid);
+
+                if (is_valid == false) fail_binary_op(this, frame, ip, left, right);
+
+                PUSH(bool_value(code[ip - code - 1] == OP_EQUALS ? is_equal : !is_equal));
+                break;
+            }
+            case OP_NOT: {
+                Value value = POP();
+
+                if (value.data_type != Data_Type::BOOL) fail_unary_op(this, frame, ip, value);
+
+                PUSH(bool_value(!value.boolean));
+                break;
+            }
+            case OP_NEGATE: {
+                Value value = POP();
+
+                if (value.data_type != Data_Type::NUM) fail_unary_op(this, frame, ip, value);
+
+                PUSH(num_value(-value.num));
+                break;
+            }
+            case OP_POSITIVE: {
+                if (stack_top[-1].data_type != Data_Type::NUM) fail_unary_op(this, frame, ip, stack_top[-1]);
+                break;
+            }
+            case OP_ARRAY: {
+                uint16_t count = READ_U16();
+                std::vector<Value> items(stack_top - count, stack_top);
+
+                stack_top -= count;
+                PUSH(array_value(allocate_array(items)));
+                SAFEPOINT();
+                break;
+            }
+            case OP_JUMP: {
+                uint32_t target = READ_U32();
+                PROFILE_POINT();
+                ip = code + target;
+                break;
+            }
+            case OP_JUMP_IF_FALSE: {
+                uint32_t target = READ_U32();
+                Value condition = POP();
+
+                if (condition.data_type != Data_Type::BOOL) report_runtime_error("Invalid comparison", frame, ip);
+                if (condition.boolean == false) ip = code + target;
+
+                PROFILE_POINT();
+                break;
+            }
+            case OP_LOOP_PREPARE: {
+                uint16_t base = READ_U16();
+                Value step = POP();
+                Value to = POP();
+                Value from = POP();
+
+                if (from.data_type != Data_Type::NUM || to.data_type != Data_Type::NUM || step.data_type != Data_Type::NUM) {
+                    report_runtime_error("Attempted to use non-num expression as control in a from loop", frame, ip);
+                }
+
+                if (step.num < 0 && from.num < to.num) report_runtime_error("from < to but step value is negative", frame, ip);
+                if (step.num > 0 && from.num > to.num) report_runtime_error("to > from but step value is positive", frame, ip);
+                if (step.num == 0) report_runtime_error("step value cannot be 0", frame, ip);
+
+                // The counter lives in a hidden slot and is updated in place
+                slots[base] = from;
+                slots[base + 1] = to;
+                slots[base + 2] = step;
+                break;
+            }
+            case OP_LOOP_TEST: {
+                uint16_t base = READ_U16();
+                uint16_t it_slot = READ_U16();
+                uint32_t exit = READ_U32();
+                float i = slots[base].num;
+                float to = slots[base + 1].num;
+                bool is_going_up = slots[base + 2].num > 0;
+
+                if (is_going_up ? i < to : i > to) {
+                    slots[it_slot] = num_value(i);
+                } else {
+                    ip = code + exit;
+                }
+
+                break;
+            }
+            case OP_LOOP_NEXT: {
+                uint16_t base = READ_U16();
+                uint32_t test = READ_U32();
+
+                slots[base].num += slots[base + 2].num;
+                PROFILE_POINT();
+                ip = code + test;
+                break;
+            }
+            case OP_PAR_PREPARE: {
+                uint16_t it_slot = READ_U16();
+                Value outer = POP();
+                Value step = POP();
+                Value to = POP();
+                Value from = POP();
+
+                if (from.data_type != Data_Type::NUM || to.data_type != Data_Type::NUM || step.data_type != Data_Type::NUM) {
+                    report_runtime_error("Attempted to use non-num expression as control in a from loop", frame, ip);
+                }
+
+                if (step.num < 0 && from.num < to.num) report_runtime_error("from < to but step value is negative", frame, ip);
+                if (step.num > 0 && from.num > to.num) report_runtime_error("to > from but step value is positive", frame, ip);
+                if (step.num == 0) report_runtime_error("step value cannot be 0", frame, ip);
+
+                Par_Loop_State loop;
+                loop.loop_node = (Ast_Loop *)origin_of(frame, ip);
+                loop.index = 0;
+                loop.count = count_par_iterations(from.num, to.num, step.num, loop.loop_node->site);
+                loop.chunk_size = get_par_chunk_size(loop.count);
+                loop.from = from.num;
+                loop.step = step.num;
+                loop.total = outer;
+                loop.outer_epoch = par_epoch;
+                loop.floor = &slots[it_slot];
+
+                if (loop.loop_node->reduction != NULL) {
+                    fail_if_reduction_invalid(loop.loop_node, outer);
+                    slots[it_slot + 1] = get_reduce_identity(loop.loop_node->reduce_op.type);
+                }
+
+                par_loops.push_back(loop);
+                par_floor = loop.floor;
+                par_epoch = next_par_epoch();
+                break;
+            }
+            case OP_PAR_TEST: {
+                uint16_t it_slot = READ_U16();
+                uint32_t exit = READ_U32();
+                Par_Loop_State &loop = par_loops.back();
+                Ast_Loop *loop_node = loop.loop_node;
+
+                // Each chunk's copy of the reduce variable is folded in as it finishes
+                if (loop_node->reduction != NULL && loop.index > 0 && (loop.index % loop.chunk_size == 0 || loop.index == loop.count)) {
+                    loop.total = reduce_values(loop_node->reduce_op.type, loop.total, slots[it_slot + 1]);
+                    slots[it_slot + 1] = get_reduce_identity(loop_node->reduce_op.type);
+                }
+
+                if (loop.index < loop.count) {
+                    slots[it_slot] = num_value(get_par_iteration(loop.from, loop.step, loop.index));
+                    break;
+                }
+
+                if (loop_node->reduction != NULL) PUSH(loop.total);
+
+                par_epoch = loop.outer_epoch;
+                par_loops.pop_back();
+                par_floor = par_loops.empty() ? stack : par_loops.back().floor;
+                ip = code + exit;
+                break;
+            }
+            case OP_PAR_NEXT: {
+                uint32_t test = READ_U32();
+
+                par_loops.back().index++;
+                PROFILE_POINT();
+                ip = code + test;
+                break;
+            }
+            case OP_CALL: {
+                Bytecode_Function *function = program->functions[READ_U32()];
+                int hops = READ_U8();
+                Value *args = stack_top - function->arity;
+
+                if (function->memo != NULL) {
+                    Value result;
+
+                    if (function->memo->lookup(args, &result)) {
+                        stack_top = args;
+                        PUSH(result);
+                        break;
+                    }
+                }
+
+                // Args were already checked, so compiled code can take them as is
+                Jit_Function *jit = get_jit_function(function->definition, false);
+
+                if (jit != NULL) {
+                    Value result = call_jit_function(jit, args, false);
+
+                    if (function->memo != NULL) function->memo->insert(args, result);
+
+                    stack_top = args;
+                    PUSH(result);
+                    break;
+                }
+
+                if (function->memo != NULL) memo_keys.insert(memo_keys.end(), args, stack_top);
+
+                if (frame_count == FRAMES_MAX || args + function->frame_size + function->max_stack > stack + STACK_MAX) {
+                    report_runtime_error("Stack overflow", frame, ip);
+                }
+
+                for (Value *slot = stack_top; slot < args + function->frame_size; slot++) *slot = Value();
+
+                Call_Frame *enclosing = frame;
+                for (; hops > 0; hops--) enclosing = enclosing->enclosing;
+
+                frame->ip = ip;
+                frame = &frames[frame_count++];
+                frame->function = function;
+                frame->ip = function->chunk.code.data();
+                frame->slots = args;
+                frame->enclosing = enclosing;
+
+                stack_top = args + function->frame_size;
+                LOAD_FRAME();
+                break;
+            }
+            case OP_CALL_NATIVE: {
+                Ast_Function_Call *call = frame->function->chunk.native_calls[READ_U32()];
+                int arg_count = READ_U8();
+                Native_Args args(stack_top - arg_count, arg_count);
+
+                // Args are read in place and their slots reused for the result
+                Value result = call->format_pieces.empty() ? call->native->handler(args, call->site) : print_compiled(call->format_pieces, args);
+
+                stack_top -= arg_count;
+                PUSH(result);
+                SAFEPOINT();
+                PROFILE_POINT();
+                break;
+            }
+            case OP_CHECK_ARG: {
+                int index = READ_U8();
+                Data_Type expected = (Data_Type)READ_U8();
+                Data_Type actual = stack_top[-1].data_type;
+
+                if (actual != expected) {
+                    auto *call = (Ast_Function_Call *)origin_of(frame, ip);
+                    report_fatal_error(get_arg_type_error(call->name, index, expected, actual), call->args[index]->site);
+                }
+
+                break;
+            }
+            case OP_TAIL_CALL: {
+                Bytecode_Function *function = frame->function;
+                Value *args = stack_top - function->arity;
+
+                // The new args are above the frame's slots, so they can't overlap
+                for (int i = 0; i < function->arity; i++) slots[i] = args[i];
+                for (int i = function->arity; i < function->frame_size; i++) slots[i] = Value();
+
+                stack_top = slots + function->frame_size;
+                ip = code;
+                break;
+            }
+            case OP_RETURN:
+            case OP_RETURN_VOID: {
+                bool is_void = code[ip - code - 1] == OP_RETURN_VOID;
+                PROFILE_POINT();
+                Value result = is_void ? Value() : POP();
+                Bytecode_Function *function = frame->function;
+
+                // The checker rejects 'return;' in non-void bugs, so this is falling off the end
+                if (function->depth > 0 && is_void && function->return_type != Data_Type::VOID) {
+                    report_fatal_error(get_missing_return_error(function->name, function->return_type), function->site);
+                }
+
+                if (function->depth > 0 && is_void == false && result.data_type != function->return_type) {
+                    std::stringstream ss;
+                    ss << "Unexpected return type from function - wanted " << data_type_to_string(function->return_type)
+                        << ", but got " << data_type_to_string(result.data_type);
+                    report_runtime_error(ss.str(), frame, ip);
+                }
+
+                if (function->memo != NULL) {
+                    function->memo->insert(memo_keys.data() + memo_keys.size() - function->arity, result);
+                    memo_keys.resize(memo_keys.size() - function->arity);
+                }
+
+                // Returning from the top level ends the script
+                if (--frame_count == 0) return;
+
+                stack_top = frame->slots;
+                PUSH(result);
+
+                frame = &frames[frame_count - 1];
+                LOAD_FRAME();
+                break;
+            }
+            default:
+                report_runtime_error("Unknown instruction", frame, ip);
+                return;
+        }
+    }
+}
+
+void VM::interpret() {
+    auto *compiler = new Compiler();
+
+    program = compiler->compile(unit->root);
+
+    Bytecode_Function *main = program->functions[0];
+
+    if (main->frame_size + main->max_stack > STACK_MAX) report_fatal_error("Stack overflow");
+
+    for (int i = 0; i < main->frame_size; i++) stack[i] = Value();
+
+    Call_Frame *frame = &frames[frame_count++];
+    frame->function = main;
+    frame->ip = main->chunk.code.data();
+    frame->slots = stack;
+    frame->enclosing = NULL;
+
+    stack_top = stack + main->frame_size;
+    run();
+}
@@ -0,0 +1,80 @@
+#ifndef VM_H
+#define VM_H
+
+#include <string>
+#include <vector>
+#include "bytecode.hpp"
+#include "parser.hpp"
+#include "profile.hpp"
+#include "unit.hpp"
+
+struct Call_Frame {
+    Bytecode_Function *function;
+    uint8_t *ip;
+    Value *slots;
+
+    // Frame of the lexically enclosing bug, used to reach outer variables
+    Call_Frame *enclosing;
+};
+
+// Progress through a par loop, which the VM runs on one thread chunk by chunk
+struct Par_Loop_State {
+    Ast_Loop *loop_node;
+    size_t index;
+    size_t count;
+    size_t chunk_size;
+    float from;
+    float step;
+    Value total;
+    unsigned int outer_epoch;
+
+    // Slot of 'it', nothing below it on the stack may be reassigned while the loop runs
+    Value *floor;
+};
+
+struct VM {
+    static const int STACK_MAX = 1 << 20;
+    static const int FRAMES_MAX = 1 << 16;
+
+    Compilation_Unit *unit;
+    Program *program;
+
+    Value *stack;
+    Value *stack_top;
+    Call_Frame *frames;
+    int frame_count;
+
+    // Args of the memoized calls in progress, see Memo_Table
+    std::vector<Value> memo_keys;
+
+    // Innermost last, par_floor is the floor of the innermost or the bottom
+    // of the stack outside of par loops
+    std::vector<Par_Loop_State> par_loops;
+    Value *par_floor;
+
+    // Scratch space for the stack of each profile sample, see profile.hpp
+    std::vector<Profile_Frame> profile_frames;
+    unsigned int seen_profile_ticks;
+
+    VM(Compilation_Unit *unit) {
+        this->unit = unit;
+        this->program = NULL;
+        // Raw allocation so the untouched part of the stack is never paged in,
+        // slots are always written before they're read
+        this->stack = (Value *)::operator new(sizeof(Value) * STACK_MAX);
+        this->stack_top = stack;
+        this->par_floor = stack;
+        this->frames = new Call_Frame[FRAMES_MAX];
+        this->frame_count = 0;
+        this->seen_profile_ticks = 0;
+    }
+
+    void run();
+    void collect_garbage();
+    void sample_profile(Call_Frame *frame, uint8_t *ip);
+    void interpret();
+    void report_runtime_error(std::string error, Call_Frame *frame, uint8_t *ip);
+    Ast_Node *origin_of(Call_Frame *frame, uint8_t *ip);
+};
+
+#endif